@@ -32,6 +32,9 @@
 #if HAVE_MALLOC_H
 #include <malloc.h>
 #endif
+#if SYS_LINUX
+#include <sys/mman.h>
+#endif
 
 const int x264_bit_depth = BIT_DEPTH;
 
@@ -50,6 +53,7 @@ void x264_param_default( x264_param_t *param )
     /* CPU autodetect */
     param->cpu = x264_cpu_detect();
     param->i_threads = X264_THREADS_AUTO;
+    param->i_lookahead_threads = X264_THREADS_AUTO;
     param->b_deterministic = 1;
     param->i_sync_lookahead = X264_SYNC_LOOKAHEAD_AUTO;
 
@@ -632,8 +636,34 @@ int x264_param_parse( x264_param_t *p, const char *name, const char *value )
         else
             p->i_threads = atoi(value);
     }
+    OPT("lookahead-threads")
+    {
+        if( !strcmp(value, "auto") )
+            p->i_lookahead_threads = X264_THREADS_AUTO;
+        else
+            p->i_lookahead_threads = atoi(value);
+    }
     OPT("sliced-threads")
         p->b_sliced_threads = atobool(value);
+    OPT("frame-threads")
+        p->i_frame_threads = atoi(value);
+    OPT("filter-thread")
+        p->b_filter_thread = atobool(value);
+    OPT("numa")
+        p->b_numa = atobool(value);
+    OPT("huge-pages")
+    {
+        b_error |= parse_enum( value, x264_huge_pages_names, &p->i_huge_pages );
+        if( b_error )
+        {
+            b_error = 0;
+            p->i_huge_pages = atoi(value);
+        }
+    }
+    OPT("frame-pool")
+        p->b_frame_pool = atobool(value);
+    OPT("stage-timing")
+        p->b_stage_timing = atobool(value);
     OPT("sync-lookahead")
     {
         if( !strcmp(value, "auto") )
@@ -858,6 +888,8 @@ int x264_param_parse( x264_param_t *p, const char *name, const char *value )
 #endif
     OPT("dump-yuv")
         p->psz_dump_yuv = strdup(value);
+    OPT("trace")
+        p->psz_trace = strdup(value);
     OPT2("analyse", "partitions")
     {
         p->analyse.inter = 0;
@@ -1184,6 +1216,83 @@ void x264_free( void *p )
     }
 }
 
+/****************************************************************************
+ * x264_malloc_huge:
+ ****************************************************************************/
+#define HUGE_PAGE_SIZE (2*1024*1024)
+/* Smaller buffers would mostly leave their huge page empty. */
+#define HUGE_PAGE_THRESHOLD (HUGE_PAGE_SIZE*7/8)
+/* Room in front of the buffer for its mapping size or malloc'd block,
+ * keeping the buffer cacheline-aligned. */
+#define HUGE_HEADER_SIZE 64
+
+void *x264_malloc_huge( int i_size, int i_mode )
+{
+    uint8_t *buf;
+#if SYS_LINUX
+    if( i_mode != X264_HUGE_PAGES_NONE && i_size >= HUGE_PAGE_THRESHOLD )
+    {
+        size_t map_size = ALIGN( (size_t)i_size + HUGE_HEADER_SIZE, HUGE_PAGE_SIZE );
+        buf = MAP_FAILED;
+#ifdef MAP_HUGETLB
+        /* Explicit huge pages have to be reserved (vm.nr_hugepages); fall back
+         * to transparent ones when there aren't enough. */
+        if( i_mode == X264_HUGE_PAGES_EXPLICIT )
+            buf = mmap( NULL, map_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0 );
+#endif
+        if( buf == MAP_FAILED )
+        {
+            /* Transparent huge pages need huge page alignment: map one more huge
+             * page than needed and trim the ends. */
+            uint8_t *map = mmap( NULL, map_size + HUGE_PAGE_SIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0 );
+            if( map != MAP_FAILED )
+            {
+                buf = (uint8_t*)ALIGN( (uintptr_t)map, HUGE_PAGE_SIZE );
+                if( buf > map )
+                    munmap( map, buf - map );
+                munmap( buf + map_size, map + HUGE_PAGE_SIZE - buf );
+#ifdef MADV_HUGEPAGE
+                madvise( buf, map_size, MADV_HUGEPAGE );
+#endif
+            }
+        }
+        if( buf != MAP_FAILED )
+        {
+            *(size_t*)buf = map_size;
+            return buf + HUGE_HEADER_SIZE;
+        }
+    }
+#endif
+    /* x264_malloc only aligns to 16 bytes; keep the buffer cacheline-aligned
+     * like the mapped ones. */
+    uint8_t *base = x264_malloc( i_size + 2*HUGE_HEADER_SIZE );
+    if( !base )
+        return NULL;
+    buf = (uint8_t*)ALIGN( (uintptr_t)base + HUGE_HEADER_SIZE, HUGE_HEADER_SIZE ) - HUGE_HEADER_SIZE;
+    *(size_t*)buf = 0;
+    *(void**)(buf + sizeof(size_t)) = base;
+    return buf + HUGE_HEADER_SIZE;
+}
+
+/****************************************************************************
+ * x264_free_huge:
+ ****************************************************************************/
+void x264_free_huge( void *p )
+{
+    if( p )
+    {
+        uint8_t *buf = (uint8_t*)p - HUGE_HEADER_SIZE;
+#if SYS_LINUX
+        if( *(size_t*)buf )
+        {
+            munmap( buf, *(size_t*)buf );
+            return;
+        }
+#endif
+        x264_free( *(void**)(buf + sizeof(size_t)) );
+    }
+}
+
 /****************************************************************************
  * x264_reduce_fraction:
  ****************************************************************************/
@@ -1285,7 +1394,13 @@ char *x264_param2string( x264_param_t *p, int b_res )
     s += sprintf( s, " fast_pskip=%d", p->analyse.b_fast_pskip );
     s += sprintf( s, " chroma_qp_offset=%d", p->analyse.i_chroma_qp_offset );
     s += sprintf( s, " threads=%d", p->i_threads );
+    s += sprintf( s, " lookahead_threads=%d", p->i_lookahead_threads );
     s += sprintf( s, " sliced_threads=%d", p->b_sliced_threads );
+    if( p->b_sliced_threads )
+        s += sprintf( s, " frame_threads=%d", p->i_frame_threads );
+    s += sprintf( s, " filter_thread=%d", p->b_filter_thread );
+    s += sprintf( s, " numa=%d", p->b_numa );
+    s += sprintf( s, " huge_pages=%d", p->i_huge_pages );
     if( p->i_slice_count )
         s += sprintf( s, " slices=%d", p->i_slice_count );
     if( p->i_slice_max_size )
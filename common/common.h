@@ -56,6 +56,7 @@ do {\
 #define X264_BFRAME_MAX 16
 #define X264_REF_MAX 16
 #define X264_THREAD_MAX 128
+#define X264_LOOKAHEAD_THREAD_MAX 16
 #define X264_PCM_COST (FRAME_SIZE(256*BIT_DEPTH)+16)
 #define X264_LOOKAHEAD_MAX 250
 #define QP_BD_OFFSET (6*(BIT_DEPTH-8))
@@ -212,6 +213,7 @@ static const uint8_t x264_scan8[16*3 + 3] =
 #include "quant.h"
 #include "cpu.h"
 #include "threadpool.h"
+#include "trace.h"
 
 /****************************************************************************
  * General functions
@@ -220,12 +222,19 @@ static const uint8_t x264_scan8[16*3 + 3] =
  * you have to use x264_free for buffers allocated with x264_malloc */
 void *x264_malloc( int );
 void  x264_free( void * );
+/* x264_malloc_huge : for large frame buffers; with i_mode other than
+ * X264_HUGE_PAGES_NONE they are put on huge pages where possible.
+ * Buffers are cacheline-aligned and have to be freed with x264_free_huge */
+void *x264_malloc_huge( int i_size, int i_mode );
+void  x264_free_huge( void * );
 
 /* x264_slurp_file: malloc space for the whole file and read it */
 char *x264_slurp_file( const char *filename );
 
 /* mdate: return the current date in microsecond */
 int64_t x264_mdate( void );
+/* ndate: return a monotonic time in nanoseconds, for timing short intervals */
+int64_t x264_ndate( void );
 
 /* x264_param2string: return a (malloced) string containing most of
  * the encoding options */
@@ -418,12 +427,19 @@ typedef struct x264_lookahead_t
     int                           i_slicetype_length;
     x264_frame_t                  *last_nonb;
     x264_pthread_t                thread_handle;
-    x264_sync_frame_list_t        ifbuf;
+    int                           i_frames; /* frames put in and not yet taken out, only used by the api thread */
+    x264_sync_frame_ring_t        ifbuf;
     x264_sync_frame_list_t        next;
-    x264_sync_frame_list_t        ofbuf;
+    x264_sync_frame_ring_t        ofbuf;
+    /* lowres cost wavefront: last finished mb column of each row, -1 once the row is done */
+    int                           *row_progress;
+    x264_pthread_mutex_t          row_mutex;
+    x264_pthread_cond_t           row_cv;
+    uint16_t                      *propagate_sums;
 } x264_lookahead_t;
 
 typedef struct x264_ratecontrol_t   x264_ratecontrol_t;
+typedef struct x264_filter_thread_t x264_filter_thread_t;
 
 typedef struct x264_left_table_t
 {
@@ -445,6 +461,18 @@ struct x264_t
     int             i_threadslice_start; /* first row in this thread slice */
     int             i_threadslice_end; /* row after the end of this thread slice */
     x264_threadpool_t *threadpool;
+    x264_filter_thread_t *filter_thread; /* companion running this frame thread's row filter */
+    x264_numa_t     *numa;          /* NULL unless threads are placed on NUMA nodes */
+    int             i_numa_node;    /* node this thread runs and allocates its frames on */
+    int64_t         i_ref_wait_time; /* time this thread spent waiting for rows of reference frames, in us */
+    int64_t         i_stage_time[X264_STAGE_MAX]; /* ns this thread spent in each stage since its last frame was counted */
+    x264_trace_t    *tracer;        /* NULL unless tracing to psz_trace */
+    x264_trace_track_t *trace;      /* timeline of the thread running this context */
+    x264_trace_track_t *trace_api;  /* timeline of the thread calling the API */
+    int64_t         i_trace_api_start; /* start of the application's open x264_encoder_trace interval */
+    x264_t          *slice_thread[X264_THREAD_MAX]; /* contexts encoding the slices of this thread's frame; [0] is the frame thread */
+    x264_threadpool_t *lookaheadpool;
+    x264_t          *lookahead_thread[X264_LOOKAHEAD_THREAD_MAX];
 
     /* bitstream output */
     struct
@@ -467,7 +495,8 @@ struct x264_t
     int             i_frame_num;
 
     int             i_thread_frames; /* Number of different frames being encoded by threads;
-                                      * 1 when sliced-threads is on. */
+                                      * 1 when sliced-threads is on, unless frame-threads is set. */
+    int             i_thread_slices; /* Number of threads encoding each frame; 1 without sliced-threads. */
     int             i_nal_type;
     int             i_nal_ref_idc;
 
@@ -885,6 +914,9 @@ struct x264_t
         int     i_direct_frames[2];
         /* num p-frames weighted */
         int     i_wpred[2];
+        /* ns spent in each stage, with b_stage_timing */
+        int64_t i_stage_time[3][X264_STAGE_MAX];
+        float   f_last_qp;
 
     } stat;
 
@@ -903,8 +935,11 @@ struct x264_t
     void *scratch_buffer; /* for any temporary storage that doesn't want repeated malloc */
     pixel *intra_border_backup[5][3]; /* bottom pixels of the previous mb row, used for intra prediction after the framebuffer has been deblocked */
     /* Deblock strength values are stored for each 4x4 partition. In MBAFF
-     * there are four extra values that need to be stored, located in [4][i]. */
-    uint8_t (*deblock_strength[2])[2][8][4];
+     * there are four extra values that need to be stored, located in [4][i].
+     * Rows are indexed by mb_y & i_deblock_strength_mask: only the rows that
+     * are not yet deblocked are kept, which is all of them with a filter thread. */
+    uint8_t (**deblock_strength)[2][8][4];
+    int i_deblock_strength_mask;
 
     /* CPU functions dependents */
     x264_predict_t      predict_16x16[4+3];
@@ -931,6 +966,22 @@ struct x264_t
     x264_lookahead_t *lookahead;
 };
 
+/* Stage timing: x264_stage_end adds the time since start to the thread's total
+ * for the stage, and returns the time for the next stage to start from. */
+static ALWAYS_INLINE int64_t x264_stage_start( x264_t *h )
+{
+    return h->param.b_stage_timing ? x264_ndate() : 0;
+}
+
+static ALWAYS_INLINE int64_t x264_stage_end( x264_t *h, int stage, int64_t start )
+{
+    if( !h->param.b_stage_timing )
+        return 0;
+    int64_t now = x264_ndate();
+    h->i_stage_time[stage] += now - start;
+    return now;
+}
+
 // included at the end because it needs x264_t
 #include "macroblock.h"
 
@@ -31,6 +31,8 @@
 
 #if HAVE_POSIXTHREAD && SYS_LINUX
 #include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
 #endif
 #if SYS_BEOS
 #include <kernel/OS.h>
@@ -62,14 +64,20 @@ const x264_cpu_name_t x264_cpu_names[] =
     {"SSE4.1",      SSE2|X264_CPU_SSE3|X264_CPU_SSSE3|X264_CPU_SSE4},
     {"SSE4",        SSE2|X264_CPU_SSE3|X264_CPU_SSSE3|X264_CPU_SSE4},
     {"SSE4.2",      SSE2|X264_CPU_SSE3|X264_CPU_SSSE3|X264_CPU_SSE4|X264_CPU_SSE42},
-    {"AVX",         SSE2|X264_CPU_SSE3|X264_CPU_SSSE3|X264_CPU_SSE4|X264_CPU_SSE42|X264_CPU_AVX},
-    {"XOP",         SSE2|X264_CPU_SSE3|X264_CPU_SSSE3|X264_CPU_SSE4|X264_CPU_SSE42|X264_CPU_AVX|X264_CPU_XOP},
-    {"FMA4",        SSE2|X264_CPU_SSE3|X264_CPU_SSSE3|X264_CPU_SSE4|X264_CPU_SSE42|X264_CPU_AVX|X264_CPU_FMA4},
+#define AVX SSE2|X264_CPU_SSE3|X264_CPU_SSSE3|X264_CPU_SSE4|X264_CPU_SSE42|X264_CPU_AVX
+    {"AVX",         AVX},
+    {"XOP",         AVX|X264_CPU_XOP},
+    {"FMA4",        AVX|X264_CPU_FMA4},
+    {"FMA3",        AVX|X264_CPU_FMA3},
+    {"AVX2",        AVX|X264_CPU_FMA3|X264_CPU_AVX2},
+#undef AVX
 #undef SSE2
     {"Cache32",         X264_CPU_CACHELINE_32},
     {"Cache64",         X264_CPU_CACHELINE_64},
     {"SSEMisalign",     X264_CPU_SSE_MISALIGN},
     {"LZCNT",           X264_CPU_LZCNT},
+    {"BMI1",            X264_CPU_BMI1},
+    {"BMI2",            X264_CPU_BMI1|X264_CPU_BMI2},
     {"Slow_mod4_stack", X264_CPU_STACK_MOD4},
     {"ARMv6",           X264_CPU_ARMV6},
     {"NEON",            X264_CPU_NEON},
@@ -108,6 +116,7 @@ uint32_t x264_cpu_detect( void )
     uint32_t cpu = 0;
     uint32_t eax, ebx, ecx, edx;
     uint32_t vendor[4] = {0};
+    uint32_t max_basic_cap;
     uint32_t max_extended_cap;
     int cache;
 
@@ -117,7 +126,8 @@ uint32_t x264_cpu_detect( void )
 #endif
 
     x264_cpu_cpuid( 0, &eax, vendor+0, vendor+2, vendor+1 );
-    if( eax == 0 )
+    max_basic_cap = eax;
+    if( max_basic_cap == 0 )
         return 0;
 
     x264_cpu_cpuid( 1, &eax, &ebx, &ecx, &edx );
@@ -143,7 +153,25 @@ uint32_t x264_cpu_detect( void )
         /* Check for OS support */
         x264_cpu_xgetbv( 0, &eax, &edx );
         if( (eax&0x6) == 0x6 )
+        {
             cpu |= X264_CPU_AVX;
+            if( ecx&0x00001000 )
+                cpu |= X264_CPU_FMA3;
+        }
+    }
+
+    if( max_basic_cap >= 7 )
+    {
+        x264_cpu_cpuid( 7, &eax, &ebx, &ecx, &edx );
+        /* AVX2 needs the same OS support for YMM state as AVX, BMI1/2 don't */
+        if( (cpu&X264_CPU_AVX) && (ebx&0x00000020) )
+            cpu |= X264_CPU_AVX2;
+        if( ebx&0x00000008 )
+        {
+            cpu |= X264_CPU_BMI1;
+            if( ebx&0x00000100 )
+                cpu |= X264_CPU_BMI2;
+        }
     }
 
     if( cpu & X264_CPU_SSSE3 )
@@ -154,6 +182,13 @@ uint32_t x264_cpu_detect( void )
     x264_cpu_cpuid( 0x80000000, &eax, &ebx, &ecx, &edx );
     max_extended_cap = eax;
 
+    if( max_extended_cap >= 0x80000001 )
+    {
+        x264_cpu_cpuid( 0x80000001, &eax, &ebx, &ecx, &edx );
+        if( ecx&0x00000020 ) /* LZCNT, also supported by Intel chips starting with Haswell */
+            cpu |= X264_CPU_LZCNT;
+    }
+
     if( !strcmp((char*)vendor, "AuthenticAMD") && max_extended_cap >= 0x80000001 )
     {
         cpu |= X264_CPU_SLOW_CTZ;
@@ -414,3 +449,144 @@ int x264_cpu_num_processors( void )
     return 1;
 #endif
 }
+
+/****************************************************************************
+ * NUMA: nodes are numbered 0..nodes-1 over the online nodes that have cpus
+ * this process may run on.
+ ****************************************************************************/
+#if HAVE_POSIXTHREAD && SYS_LINUX
+
+#define MPOL_PREFERRED 1
+
+struct x264_numa_t
+{
+    int nodes;
+    int id[X264_NUMA_NODE_MAX]; /* kernel node number */
+    cpu_set_t cpus[X264_NUMA_NODE_MAX];
+    int64_t memory[X264_NUMA_NODE_MAX]; /* bytes bound to each node */
+    uintptr_t page_size;
+};
+
+/* Reads the cpus of a node's cpulist, e.g. "0-7,16-23", that are also in allowed.
+ * Returns their number, or -1 if there is no such node. */
+static int x264_numa_read_cpus( int id, cpu_set_t *set, cpu_set_t *allowed )
+{
+    char path[64];
+    int first, last, c, count = 0;
+    sprintf( path, "/sys/devices/system/node/node%d/cpulist", id );
+    FILE *f = fopen( path, "r" );
+    if( !f )
+        return -1;
+    CPU_ZERO( set );
+    while( fscanf( f, "%d", &first ) == 1 )
+    {
+        last = first;
+        c = fgetc( f );
+        if( c == '-' )
+        {
+            if( fscanf( f, "%d", &last ) != 1 )
+                break;
+            c = fgetc( f );
+        }
+        for( int cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++ )
+            if( CPU_ISSET( cpu, allowed ) )
+            {
+                CPU_SET( cpu, set );
+                count++;
+            }
+        if( c != ',' )
+            break;
+    }
+    fclose( f );
+    return count;
+}
+
+x264_numa_t *x264_numa_init( void )
+{
+    cpu_set_t allowed, set;
+    x264_numa_t *numa = x264_malloc( sizeof(x264_numa_t) );
+    if( !numa )
+        return NULL;
+    memset( numa, 0, sizeof(x264_numa_t) );
+    if( sched_getaffinity( 0, sizeof(allowed), &allowed ) )
+        goto fail;
+    for( int id = 0, count; id < X264_NUMA_NODE_MAX && (count = x264_numa_read_cpus( id, &set, &allowed )) >= 0; id++ )
+    {
+        if( !count )
+            continue;
+        numa->id[numa->nodes] = id;
+        numa->cpus[numa->nodes++] = set;
+    }
+    if( numa->nodes < 2 )
+        goto fail;
+    numa->page_size = sysconf( _SC_PAGESIZE );
+    return numa;
+fail:
+    x264_free( numa );
+    return NULL;
+}
+
+int x264_numa_nodes( x264_numa_t *numa )
+{
+    return numa ? numa->nodes : 1;
+}
+
+void x264_numa_pin_thread( x264_numa_t *numa, int node )
+{
+    sched_setaffinity( 0, sizeof(cpu_set_t), &numa->cpus[node] );
+}
+
+void x264_numa_bind( x264_numa_t *numa, void *p, int64_t size, int node )
+{
+    numa->memory[node] += size;
+#ifdef __NR_mbind
+    /* Only whole pages can be bound; the partial ones at the ends go wherever they're first touched. */
+    uintptr_t start = ((uintptr_t)p + numa->page_size - 1) & ~(numa->page_size - 1);
+    uintptr_t end = ((uintptr_t)p + size) & ~(numa->page_size - 1);
+    unsigned long mask[(X264_NUMA_NODE_MAX + 8*sizeof(long) - 1) / (8*sizeof(long))] = {0};
+    mask[numa->id[node] / (8*sizeof(long))] = 1UL << (numa->id[node] % (8*sizeof(long)));
+    if( end > start )
+        syscall( __NR_mbind, start, end - start, MPOL_PREFERRED, mask, 8*sizeof(mask) + 1, 0 );
+#endif
+}
+
+int64_t x264_numa_memory( x264_numa_t *numa, int node )
+{
+    return numa->memory[node];
+}
+
+void x264_numa_delete( x264_numa_t *numa )
+{
+    x264_free( numa );
+}
+
+#else
+
+x264_numa_t *x264_numa_init( void )
+{
+    return NULL;
+}
+
+int x264_numa_nodes( x264_numa_t *numa )
+{
+    return 1;
+}
+
+void x264_numa_pin_thread( x264_numa_t *numa, int node )
+{
+}
+
+void x264_numa_bind( x264_numa_t *numa, void *p, int64_t size, int node )
+{
+}
+
+int64_t x264_numa_memory( x264_numa_t *numa, int node )
+{
+    return 0;
+}
+
+void x264_numa_delete( x264_numa_t *numa )
+{
+}
+
+#endif
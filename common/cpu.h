@@ -28,6 +28,19 @@
 
 uint32_t x264_cpu_detect( void );
 int      x264_cpu_num_processors( void );
+
+/* NUMA placement of threads and memory, for now only on Linux. */
+#define X264_NUMA_NODE_MAX 64
+typedef struct x264_numa_t x264_numa_t;
+/* returns NULL unless threads can run on more than one node */
+x264_numa_t *x264_numa_init( void );
+int      x264_numa_nodes( x264_numa_t *numa );
+/* restricts the calling thread to the cpus of node */
+void     x264_numa_pin_thread( x264_numa_t *numa, int node );
+/* asks for the not yet touched pages of p to be placed on node */
+void     x264_numa_bind( x264_numa_t *numa, void *p, int64_t size, int node );
+int64_t  x264_numa_memory( x264_numa_t *numa, int node );
+void     x264_numa_delete( x264_numa_t *numa );
 void     x264_cpu_emms( void );
 void     x264_cpu_sfence( void );
 #if HAVE_MMX
@@ -385,7 +385,7 @@ static ALWAYS_INLINE void x264_macroblock_cache_load_neighbours_deblock( x264_t
         h->mb.i_neighbour |= MB_TOP;
 }
 
-void x264_frame_deblock_row( x264_t *h, int mb_y )
+void x264_frame_deblock_row( x264_t *h, int mb_y, int mb_x_start, int mb_x_end )
 {
     int b_interlaced = SLICE_MBAFF;
     int a = h->sh.i_alpha_c0_offset - QP_BD_OFFSET;
@@ -397,7 +397,7 @@ void x264_frame_deblock_row( x264_t *h, int mb_y )
     int chroma_height = 16 >> CHROMA_V_SHIFT;
     intptr_t uvdiff = chroma444 ? h->fdec->plane[2] - h->fdec->plane[1] : 1;
 
-    for( int mb_x = 0; mb_x < h->mb.i_mb_width; mb_x += (~b_interlaced | mb_y)&1, mb_y ^= b_interlaced )
+    for( int mb_x = mb_x_start; mb_x < mb_x_end; mb_x += (~b_interlaced | mb_y)&1, mb_y ^= b_interlaced )
     {
         x264_prefetch_fenc( h, h->fdec, mb_x, mb_y );
         x264_macroblock_cache_load_neighbours_deblock( h, mb_x, mb_y );
@@ -405,7 +405,7 @@ void x264_frame_deblock_row( x264_t *h, int mb_y )
         int mb_xy = h->mb.i_mb_xy;
         int transform_8x8 = h->mb.mb_transform_size[h->mb.i_mb_xy];
         int intra_cur = IS_INTRA( h->mb.type[mb_xy] );
-        uint8_t (*bs)[8][4] = h->deblock_strength[mb_y&1][mb_x];
+        uint8_t (*bs)[8][4] = h->deblock_strength[mb_y&h->i_deblock_strength_mask][mb_x];
 
         pixel *pixy = h->fdec->plane[0] + 16*mb_y*stridey  + 16*mb_x;
         pixel *pixuv = h->fdec->plane[1] + chroma_height*mb_y*strideuv + 16*mb_x;
@@ -598,7 +598,7 @@ void x264_macroblock_deblock( x264_t *h )
     if( (h->mb.i_partition == D_16x16 && !h->mb.i_cbp_luma && !intra_cur) || qp <= qp_thresh )
         return;
 
-    uint8_t (*bs)[8][4] = h->deblock_strength[h->mb.i_mb_y&1][h->mb.i_mb_x];
+    uint8_t (*bs)[8][4] = h->deblock_strength[h->mb.i_mb_y&h->i_deblock_strength_mask][h->mb.i_mb_x];
     if( intra_cur )
     {
         memset( &bs[0][1], 3, 3*4*sizeof(uint8_t) );
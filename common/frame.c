@@ -65,6 +65,114 @@ static int x264_frame_internal_csp( int external_csp )
     }
 }
 
+/* Frame slabs: all of a frame's buffers are carved out of one allocation,
+ * each one starting on its own cacheline.  PREALLOC records a buffer's offset
+ * in the slab, and PREALLOC_END turns the offsets into pointers once the slab
+ * exists.  The slab starts with its header. */
+#define PREALLOC_BUF_SIZE 1024
+
+#define PREALLOC_INIT\
+    int     prealloc_idx = 0;\
+    int64_t prealloc_size = ALIGN( sizeof(x264_frame_slab_t), 64 );\
+    uint8_t **preallocs[PREALLOC_BUF_SIZE];
+
+#define PREALLOC( var, size )\
+do {\
+    var = (void*)(intptr_t)prealloc_size;\
+    preallocs[prealloc_idx++] = (uint8_t**)&var;\
+    prealloc_size += ALIGN( (int64_t)(size), 64 );\
+} while( 0 )
+
+#define PREALLOC_END( ptr, node )\
+do {\
+    if( prealloc_size > INT_MAX )\
+        goto fail;\
+    ptr = x264_frame_slab_new( h, prealloc_size, node );\
+    if( !ptr )\
+        goto fail;\
+    while( prealloc_idx-- )\
+        *preallocs[prealloc_idx] += (intptr_t)ptr;\
+} while( 0 )
+
+/* Encoders opened with b_frame_pool leave their slabs here when they close,
+ * for later encoders with the same frame layout to pick up. */
+struct x264_frame_slab_t
+{
+    struct x264_frame_slab_t *next;
+    int i_size;
+    int i_huge_pages;
+    int i_numa_node;  /* -1 when not bound to a node */
+    int b_pooled;
+};
+
+#if HAVE_THREAD
+static x264_pthread_mutex_t frame_pool_mutex = X264_PTHREAD_MUTEX_INITIALIZER;
+#endif
+static x264_frame_slab_t *frame_pool = NULL;
+
+static x264_frame_slab_t *x264_frame_slab_new( x264_t *h, int i_size, int i_numa_node )
+{
+    x264_frame_slab_t *slab = NULL;
+    if( h->param.b_frame_pool )
+    {
+        x264_pthread_mutex_lock( &frame_pool_mutex );
+        for( x264_frame_slab_t **p = &frame_pool; *p; p = &(*p)->next )
+            if( (*p)->i_size == i_size && (*p)->i_huge_pages == h->param.i_huge_pages &&
+                (*p)->i_numa_node == i_numa_node )
+            {
+                slab = *p;
+                *p = slab->next;
+                break;
+            }
+        x264_pthread_mutex_unlock( &frame_pool_mutex );
+    }
+    if( !slab )
+    {
+        slab = x264_malloc_huge( i_size, h->param.i_huge_pages );
+        if( !slab )
+            return NULL;
+        slab->i_size = i_size;
+        slab->i_huge_pages = h->param.i_huge_pages;
+        slab->i_numa_node = i_numa_node;
+    }
+    /* Pooled slabs were bound to the same node already; binding again keeps the
+     * per-node accounting right. */
+    if( i_numa_node >= 0 )
+        x264_numa_bind( h->numa, slab, i_size, i_numa_node );
+    slab->next = NULL;
+    slab->b_pooled = h->param.b_frame_pool;
+    return slab;
+}
+
+static void x264_frame_slab_delete( x264_frame_slab_t *slab )
+{
+    if( !slab )
+        return;
+    if( slab->b_pooled )
+    {
+        x264_pthread_mutex_lock( &frame_pool_mutex );
+        slab->next = frame_pool;
+        frame_pool = slab;
+        x264_pthread_mutex_unlock( &frame_pool_mutex );
+    }
+    else
+        x264_free_huge( slab );
+}
+
+void x264_frame_pool_flush( void )
+{
+    x264_pthread_mutex_lock( &frame_pool_mutex );
+    x264_frame_slab_t *slab = frame_pool;
+    frame_pool = NULL;
+    x264_pthread_mutex_unlock( &frame_pool_mutex );
+    while( slab )
+    {
+        x264_frame_slab_t *next = slab->next;
+        x264_free_huge( slab );
+        slab = next;
+    }
+}
+
 static x264_frame_t *x264_frame_new( x264_t *h, int b_fdec )
 {
     x264_frame_t *frame;
@@ -74,6 +182,8 @@ static x264_frame_t *x264_frame_new( x264_t *h, int b_fdec )
     int i_padv = PADV << PARAM_INTERLACED;
     int align = h->param.cpu&X264_CPU_CACHELINE_64 ? 64 : h->param.cpu&X264_CPU_CACHELINE_32 ? 32 : 16;
     int disalign = h->param.cpu&X264_CPU_ALTIVEC ? 1<<9 : 1<<10;
+    int chroma_padv = 0, luma_plane_size[3] = {0}, lowres_plane_size = 0;
+    PREALLOC_INIT
 
     CHECKED_MALLOCZERO( frame, sizeof(x264_frame_t) );
 
@@ -112,10 +222,6 @@ static x264_frame_t *x264_frame_new( x264_t *h, int b_fdec )
     frame->i_lines_lowres = frame->i_lines[0]/2;
     frame->i_stride_lowres = align_stride( frame->i_width_lowres + 2*PADH, align, disalign<<1 );
 
-    for( int i = 0; i < h->param.i_bframe + 2; i++ )
-        for( int j = 0; j < h->param.i_bframe + 2; j++ )
-            CHECKED_MALLOC( frame->i_row_satds[i][j], i_lines/16 * sizeof(int) );
-
     frame->i_poc = -1;
     frame->i_type = X264_TYPE_AUTO;
     frame->i_qpplus1 = X264_QP_AUTO;
@@ -124,6 +230,7 @@ static x264_frame_t *x264_frame_new( x264_t *h, int b_fdec )
     frame->i_frame_num = -1;
     frame->i_lines_completed = -1;
     frame->b_fdec = b_fdec;
+    frame->i_numa_node = h->i_numa_node;
     frame->i_pic_struct = PIC_STRUCT_AUTO;
     frame->i_field_cnt = -1;
     frame->i_duration =
@@ -135,17 +242,15 @@ static x264_frame_t *x264_frame_new( x264_t *h, int b_fdec )
 
     frame->orig = frame;
 
+    /* The planes come first, so that the big buffers which want huge pages
+     * start the slab, followed by the per-row and per-macroblock arrays. */
     if( i_csp == X264_CSP_NV12 || i_csp == X264_CSP_NV16 )
     {
-        int chroma_padv = i_padv >> (i_csp == X264_CSP_NV12);
+        chroma_padv = i_padv >> (i_csp == X264_CSP_NV12);
         int chroma_plane_size = (frame->i_stride[1] * (frame->i_lines[1] + 2*chroma_padv));
-        CHECKED_MALLOC( frame->buffer[1], chroma_plane_size * sizeof(pixel) );
-        frame->plane[1] = frame->buffer[1] + frame->i_stride[1] * chroma_padv + PADH;
+        PREALLOC( frame->buffer[1], chroma_plane_size * sizeof(pixel) );
         if( PARAM_INTERLACED )
-        {
-            CHECKED_MALLOC( frame->buffer_fld[1], chroma_plane_size * sizeof(pixel) );
-            frame->plane_fld[1] = frame->buffer_fld[1] + frame->i_stride[1] * chroma_padv + PADH;
-        }
+            PREALLOC( frame->buffer_fld[1], chroma_plane_size * sizeof(pixel) );
     }
 
     /* all 4 luma planes allocated together, since the cacheline split code
@@ -153,26 +258,88 @@ static x264_frame_t *x264_frame_new( x264_t *h, int b_fdec )
 
     for( int p = 0; p < luma_plane_count; p++ )
     {
-        int luma_plane_size = align_plane_size( frame->i_stride[p] * (frame->i_lines[p] + 2*i_padv), disalign );
+        luma_plane_size[p] = align_plane_size( frame->i_stride[p] * (frame->i_lines[p] + 2*i_padv), disalign );
+        int planes = h->param.analyse.i_subpel_refine && b_fdec ? 4 : 1;
+        /* FIXME: Don't allocate both buffers in non-adaptive MBAFF. */
+        PREALLOC( frame->buffer[p], planes*luma_plane_size[p] * sizeof(pixel) );
+        if( PARAM_INTERLACED )
+            PREALLOC( frame->buffer_fld[p], planes*luma_plane_size[p] * sizeof(pixel) );
+    }
+
+    if( b_fdec ) /* fdec frame */
+    {
+        if( h->param.analyse.i_me_method >= X264_ME_ESA )
+            PREALLOC( frame->buffer[3], frame->i_stride[0] * (frame->i_lines[0] + 2*i_padv) * sizeof(uint16_t) << h->frames.b_have_sub8x8_esa );
+        PREALLOC( frame->mb_type, i_mb_count * sizeof(int8_t) );
+        PREALLOC( frame->mb_partition, i_mb_count * sizeof(uint8_t) );
+        PREALLOC( frame->mv[0], 2*16 * i_mb_count * sizeof(int16_t) );
+        PREALLOC( frame->mv16x16, 2*(i_mb_count+1) * sizeof(int16_t) );
+        PREALLOC( frame->ref[0], 4 * i_mb_count * sizeof(int8_t) );
+        if( h->param.i_bframe )
+        {
+            PREALLOC( frame->mv[1], 2*16 * i_mb_count * sizeof(int16_t) );
+            PREALLOC( frame->ref[1], 4 * i_mb_count * sizeof(int8_t) );
+        }
+        PREALLOC( frame->i_row_bits, i_lines/16 * sizeof(int) );
+        PREALLOC( frame->f_row_qp, i_lines/16 * sizeof(float) );
+        PREALLOC( frame->f_row_qscale, i_lines/16 * sizeof(float) );
+        if( PARAM_INTERLACED )
+            PREALLOC( frame->field, i_mb_count * sizeof(uint8_t) );
+    }
+    else /* fenc frame */
+    {
+        if( h->frames.b_have_lowres )
+        {
+            lowres_plane_size = align_plane_size( frame->i_stride_lowres * (frame->i_lines[0]/2 + 2*PADV), disalign );
+
+            PREALLOC( frame->buffer_lowres[0], 4 * lowres_plane_size * sizeof(pixel) );
+            for( int j = 0; j <= !!h->param.i_bframe; j++ )
+                for( int i = 0; i <= h->param.i_bframe; i++ )
+                {
+                    PREALLOC( frame->lowres_mvs[j][i], 2*h->mb.i_mb_count*sizeof(int16_t) );
+                    PREALLOC( frame->lowres_mv_costs[j][i], h->mb.i_mb_count*sizeof(int) );
+                }
+            PREALLOC( frame->i_propagate_cost, (i_mb_count+7) * sizeof(uint16_t) );
+            for( int j = 0; j <= h->param.i_bframe+1; j++ )
+                for( int i = 0; i <= h->param.i_bframe+1; i++ )
+                    PREALLOC( frame->lowres_costs[j][i], (i_mb_count+3) * sizeof(uint16_t) );
+        }
+        if( h->param.rc.i_aq_mode )
+        {
+            PREALLOC( frame->f_qp_offset, h->mb.i_mb_count * sizeof(float) );
+            PREALLOC( frame->f_qp_offset_aq, h->mb.i_mb_count * sizeof(float) );
+            if( h->frames.b_have_lowres )
+                PREALLOC( frame->i_inv_qscale_factor, (h->mb.i_mb_count+3) * sizeof(uint16_t) );
+        }
+    }
+
+    for( int i = 0; i < h->param.i_bframe + 2; i++ )
+        for( int j = 0; j < h->param.i_bframe + 2; j++ )
+            PREALLOC( frame->i_row_satds[i][j], i_lines/16 * sizeof(int) );
+
+    PREALLOC_END( frame->slab, h->numa && b_fdec ? frame->i_numa_node : -1 );
+
+    if( i_csp == X264_CSP_NV12 || i_csp == X264_CSP_NV16 )
+    {
+        frame->plane[1] = frame->buffer[1] + frame->i_stride[1] * chroma_padv + PADH;
+        if( PARAM_INTERLACED )
+            frame->plane_fld[1] = frame->buffer_fld[1] + frame->i_stride[1] * chroma_padv + PADH;
+    }
+
+    for( int p = 0; p < luma_plane_count; p++ )
+    {
         if( h->param.analyse.i_subpel_refine && b_fdec )
         {
-            /* FIXME: Don't allocate both buffers in non-adaptive MBAFF. */
-            CHECKED_MALLOC( frame->buffer[p], 4*luma_plane_size * sizeof(pixel) );
-            if( PARAM_INTERLACED )
-                CHECKED_MALLOC( frame->buffer_fld[p], 4*luma_plane_size * sizeof(pixel) );
             for( int i = 0; i < 4; i++ )
             {
-                frame->filtered[p][i] = frame->buffer[p] + i*luma_plane_size + frame->i_stride[p] * i_padv + PADH;
-                frame->filtered_fld[p][i] = frame->buffer_fld[p] + i*luma_plane_size + frame->i_stride[p] * i_padv + PADH;
+                frame->filtered[p][i] = frame->buffer[p] + i*luma_plane_size[p] + frame->i_stride[p] * i_padv + PADH;
+                frame->filtered_fld[p][i] = frame->buffer_fld[p] + i*luma_plane_size[p] + frame->i_stride[p] * i_padv + PADH;
             }
             frame->plane[p] = frame->filtered[p][0];
             frame->plane_fld[p] = frame->filtered_fld[p][0];
         }
         else
         {
-            CHECKED_MALLOC( frame->buffer[p], luma_plane_size * sizeof(pixel) );
-            if( PARAM_INTERLACED )
-                CHECKED_MALLOC( frame->buffer_fld[p], luma_plane_size * sizeof(pixel) );
             frame->filtered[p][0] = frame->plane[p] = frame->buffer[p] + frame->i_stride[p] * i_padv + PADH;
             frame->filtered_fld[p][0] = frame->plane_fld[p] = frame->buffer_fld[p] + frame->i_stride[p] * i_padv + PADH;
         }
@@ -182,66 +349,26 @@ static x264_frame_t *x264_frame_new( x264_t *h, int b_fdec )
 
     if( b_fdec ) /* fdec frame */
     {
-        CHECKED_MALLOC( frame->mb_type, i_mb_count * sizeof(int8_t));
-        CHECKED_MALLOC( frame->mb_partition, i_mb_count * sizeof(uint8_t));
-        CHECKED_MALLOC( frame->mv[0], 2*16 * i_mb_count * sizeof(int16_t) );
-        CHECKED_MALLOC( frame->mv16x16, 2*(i_mb_count+1) * sizeof(int16_t) );
         M32( frame->mv16x16[0] ) = 0;
         frame->mv16x16++;
-        CHECKED_MALLOC( frame->ref[0], 4 * i_mb_count * sizeof(int8_t) );
-        if( h->param.i_bframe )
-        {
-            CHECKED_MALLOC( frame->mv[1], 2*16 * i_mb_count * sizeof(int16_t) );
-            CHECKED_MALLOC( frame->ref[1], 4 * i_mb_count * sizeof(int8_t) );
-        }
-        else
-        {
-            frame->mv[1]  = NULL;
-            frame->ref[1] = NULL;
-        }
-        CHECKED_MALLOC( frame->i_row_bits, i_lines/16 * sizeof(int) );
-        CHECKED_MALLOC( frame->f_row_qp, i_lines/16 * sizeof(float) );
-        CHECKED_MALLOC( frame->f_row_qscale, i_lines/16 * sizeof(float) );
         if( h->param.analyse.i_me_method >= X264_ME_ESA )
-        {
-            CHECKED_MALLOC( frame->buffer[3],
-                            frame->i_stride[0] * (frame->i_lines[0] + 2*i_padv) * sizeof(uint16_t) << h->frames.b_have_sub8x8_esa );
             frame->integral = (uint16_t*)frame->buffer[3] + frame->i_stride[0] * i_padv + PADH;
-        }
-        if( PARAM_INTERLACED )
-            CHECKED_MALLOC( frame->field, i_mb_count * sizeof(uint8_t) );
     }
     else /* fenc frame */
     {
         if( h->frames.b_have_lowres )
         {
-            int luma_plane_size = align_plane_size( frame->i_stride_lowres * (frame->i_lines[0]/2 + 2*PADV), disalign );
-
-            CHECKED_MALLOC( frame->buffer_lowres[0], 4 * luma_plane_size * sizeof(pixel) );
             for( int i = 0; i < 4; i++ )
-                frame->lowres[i] = frame->buffer_lowres[0] + (frame->i_stride_lowres * PADV + PADH) + i * luma_plane_size;
-
+                frame->lowres[i] = frame->buffer_lowres[0] + (frame->i_stride_lowres * PADV + PADH) + i * lowres_plane_size;
             for( int j = 0; j <= !!h->param.i_bframe; j++ )
                 for( int i = 0; i <= h->param.i_bframe; i++ )
-                {
-                    CHECKED_MALLOCZERO( frame->lowres_mvs[j][i], 2*h->mb.i_mb_count*sizeof(int16_t) );
-                    CHECKED_MALLOC( frame->lowres_mv_costs[j][i], h->mb.i_mb_count*sizeof(int) );
-                }
-            CHECKED_MALLOC( frame->i_propagate_cost, (i_mb_count+7) * sizeof(uint16_t) );
-            for( int j = 0; j <= h->param.i_bframe+1; j++ )
-                for( int i = 0; i <= h->param.i_bframe+1; i++ )
-                    CHECKED_MALLOC( frame->lowres_costs[j][i], (i_mb_count+3) * sizeof(uint16_t) );
+                    memset( frame->lowres_mvs[j][i], 0, 2*h->mb.i_mb_count*sizeof(int16_t) );
             frame->i_intra_cost = frame->lowres_costs[0][0];
             memset( frame->i_intra_cost, -1, (i_mb_count+3) * sizeof(uint16_t) );
         }
-        if( h->param.rc.i_aq_mode )
-        {
-            CHECKED_MALLOC( frame->f_qp_offset, h->mb.i_mb_count * sizeof(float) );
-            CHECKED_MALLOC( frame->f_qp_offset_aq, h->mb.i_mb_count * sizeof(float) );
-            if( h->frames.b_have_lowres )
-                /* shouldn't really be initialized, just silences a valgrind false-positive in x264_mbtree_propagate_cost_sse2 */
-                CHECKED_MALLOCZERO( frame->i_inv_qscale_factor, (h->mb.i_mb_count+3) * sizeof(uint16_t) );
-        }
+        if( h->param.rc.i_aq_mode && h->frames.b_have_lowres )
+            /* shouldn't really be initialized, just silences a valgrind false-positive in x264_mbtree_propagate_cost_sse2 */
+            memset( frame->i_inv_qscale_factor, 0, (h->mb.i_mb_count+3) * sizeof(uint16_t) );
     }
 
     if( x264_pthread_mutex_init( &frame->mutex, NULL ) )
@@ -252,6 +379,8 @@ static x264_frame_t *x264_frame_new( x264_t *h, int b_fdec )
     return frame;
 
 fail:
+    if( frame )
+        x264_frame_slab_delete( frame->slab );
     x264_free( frame );
     return NULL;
 }
@@ -262,41 +391,7 @@ void x264_frame_delete( x264_frame_t *frame )
      * so freeing those pointers would cause a double free later. */
     if( !frame->b_duplicate )
     {
-        for( int i = 0; i < 4; i++ )
-        {
-            x264_free( frame->buffer[i] );
-            x264_free( frame->buffer_fld[i] );
-        }
-        for( int i = 0; i < 4; i++ )
-            x264_free( frame->buffer_lowres[i] );
-        for( int i = 0; i < X264_BFRAME_MAX+2; i++ )
-            for( int j = 0; j < X264_BFRAME_MAX+2; j++ )
-                x264_free( frame->i_row_satds[i][j] );
-        for( int j = 0; j < 2; j++ )
-            for( int i = 0; i <= X264_BFRAME_MAX; i++ )
-            {
-                x264_free( frame->lowres_mvs[j][i] );
-                x264_free( frame->lowres_mv_costs[j][i] );
-            }
-        x264_free( frame->i_propagate_cost );
-        for( int j = 0; j <= X264_BFRAME_MAX+1; j++ )
-            for( int i = 0; i <= X264_BFRAME_MAX+1; i++ )
-                x264_free( frame->lowres_costs[j][i] );
-        x264_free( frame->f_qp_offset );
-        x264_free( frame->f_qp_offset_aq );
-        x264_free( frame->i_inv_qscale_factor );
-        x264_free( frame->i_row_bits );
-        x264_free( frame->f_row_qp );
-        x264_free( frame->f_row_qscale );
-        x264_free( frame->field );
-        x264_free( frame->mb_type );
-        x264_free( frame->mb_partition );
-        x264_free( frame->mv[0] );
-        x264_free( frame->mv[1] );
-        if( frame->mv16x16 )
-            x264_free( frame->mv16x16-1 );
-        x264_free( frame->ref[0] );
-        x264_free( frame->ref[1] );
+        x264_frame_slab_delete( frame->slab );
         x264_pthread_mutex_destroy( &frame->mutex );
         x264_pthread_cond_destroy( &frame->cv );
     }
@@ -546,6 +641,19 @@ void x264_frame_expand_border_filtered( x264_t *h, x264_frame_t *frame, int mb_y
         }
 }
 
+/* Pads the left edge of the planes the hpel filter reads, for the rows x264_frame_expand_border
+ * pads at mb_y, before the rest of the row has been deblocked. */
+void x264_frame_expand_border_left( x264_t *h, x264_frame_t *frame, int mb_y )
+{
+    for( int p = 0; p < (CHROMA444 ? 3 : 1); p++ )
+    {
+        int stride = frame->i_stride[p];
+        pixel *pix = frame->plane[p] + X264_MAX(0, 16*mb_y-4)*stride;
+        for( int y = 0; y < 16; y++, pix += stride )
+            pixel_memset( pix-PADH, pix, PADH, sizeof(pixel) );
+    }
+}
+
 void x264_frame_expand_border_lowres( x264_frame_t *frame )
 {
     for( int i = 0; i < 4; i++ )
@@ -602,20 +710,42 @@ void x264_expand_border_mbpair( x264_t *h, int mb_x, int mb_y )
 }
 
 /* threading */
+/* Readers poll i_lines_completed and only sleep on the condvar when the writer is more than
+ * a row behind or doesn't get there within ROW_SPIN_COUNT polls, so the writer only needs the
+ * mutex when somebody is asleep.  Both sides store before loading with a full barrier in
+ * between, so either the writer sees the waiter or the waiter sees the new lines. */
+#define ROW_SPIN_COUNT 1000
+#define ROW_SPIN_LINES 16
+
 void x264_frame_cond_broadcast( x264_frame_t *frame, int i_lines_completed )
 {
-    x264_pthread_mutex_lock( &frame->mutex );
     frame->i_lines_completed = i_lines_completed;
-    x264_pthread_cond_broadcast( &frame->cv );
-    x264_pthread_mutex_unlock( &frame->mutex );
+    x264_atomic_barrier();
+    if( frame->i_waiters )
+    {
+        x264_pthread_mutex_lock( &frame->mutex );
+        x264_pthread_cond_broadcast( &frame->cv );
+        x264_pthread_mutex_unlock( &frame->mutex );
+    }
 }
 
-void x264_frame_cond_wait( x264_frame_t *frame, int i_lines_completed )
+/* Returns the time spent waiting, in microseconds. */
+int64_t x264_frame_cond_wait( x264_frame_t *frame, int i_lines_completed )
 {
+    if( frame->i_lines_completed >= i_lines_completed )
+        return 0;
+    int64_t start = x264_mdate();
+    if( i_lines_completed - frame->i_lines_completed <= ROW_SPIN_LINES )
+        for( int i = 0; i < ROW_SPIN_COUNT; i++ )
+            if( frame->i_lines_completed >= i_lines_completed )
+                return x264_mdate() - start;
     x264_pthread_mutex_lock( &frame->mutex );
+    x264_atomic_add( &frame->i_waiters, 1 );
     while( frame->i_lines_completed < i_lines_completed )
         x264_pthread_cond_wait( &frame->cv, &frame->mutex );
+    x264_atomic_add( &frame->i_waiters, -1 );
     x264_pthread_mutex_unlock( &frame->mutex );
+    return x264_mdate() - start;
 }
 
 /* list operators */
@@ -667,10 +797,21 @@ void x264_frame_push_unused( x264_t *h, x264_frame_t *frame )
 
 x264_frame_t *x264_frame_pop_unused( x264_t *h, int b_fdec )
 {
-    x264_frame_t *frame;
-    if( h->frames.unused[b_fdec][0] )
-        frame = x264_frame_pop( h->frames.unused[b_fdec] );
-    else
+    x264_frame_t *frame = NULL;
+    x264_frame_t **list = h->frames.unused[b_fdec];
+    if( h->numa && b_fdec )
+    {
+        /* Only reuse frames on this thread's node; each node grows its own set. */
+        for( int i = 0; list[i]; i++ )
+            if( list[i]->i_numa_node == h->i_numa_node )
+            {
+                frame = x264_frame_shift( list + i );
+                break;
+            }
+    }
+    else if( list[0] )
+        frame = x264_frame_pop( list );
+    if( !frame )
         frame = x264_frame_new( h, b_fdec );
     if( !frame )
         return NULL;
@@ -681,6 +822,7 @@ x264_frame_t *x264_frame_pop_unused( x264_t *h, int b_fdec )
     frame->b_keyframe = 0;
     frame->b_corrupt = 0;
 
+    memset( frame->i_stage_time, 0, sizeof(frame->i_stage_time) );
     memset( frame->weight, 0, sizeof(frame->weight) );
     memset( frame->f_weighted_cost_delta, 0, sizeof(frame->f_weighted_cost_delta) );
 
@@ -783,3 +925,111 @@ x264_frame_t *x264_sync_frame_list_pop( x264_sync_frame_list_t *slist )
     x264_pthread_mutex_unlock( &slist->mutex );
     return frame;
 }
+
+/* polls of the other side of the ring before sleeping */
+#define RING_SPIN_COUNT 1000
+
+int x264_sync_frame_ring_init( x264_sync_frame_ring_t *ring, int max_size )
+{
+    if( max_size <= 0 )
+        return -1;
+    ring->i_max_size = max_size;
+    ring->i_mask = max_size > 1 ? 0xffffffffu >> x264_clz( max_size - 1 ) : 0;
+    ring->i_head = ring->i_tail = 0;
+    ring->b_closed = ring->i_parked = 0;
+    CHECKED_MALLOCZERO( ring->list, (ring->i_mask + 1) * sizeof(x264_frame_t*) );
+    if( x264_pthread_mutex_init( &ring->mutex, NULL ) ||
+        x264_pthread_cond_init( &ring->cv, NULL ) )
+        return -1;
+    return 0;
+fail:
+    return -1;
+}
+
+void x264_sync_frame_ring_delete( x264_sync_frame_ring_t *ring )
+{
+    x264_pthread_mutex_destroy( &ring->mutex );
+    x264_pthread_cond_destroy( &ring->cv );
+    for( unsigned i = ring->i_head; i != ring->i_tail; i++ )
+        x264_frame_delete( ring->list[i & ring->i_mask] );
+    x264_free( ring->list );
+}
+
+/* The consumer waits for frames (count == 0), the producer for room for count frames.
+ * Both can't be waiting at once, so one condition variable serves both. */
+static int x264_sync_frame_ring_ready( x264_sync_frame_ring_t *ring, int count )
+{
+    int size = x264_sync_frame_ring_size( ring );
+    return count ? ring->i_max_size - size >= count : size || ring->b_closed;
+}
+
+static void x264_sync_frame_ring_park( x264_sync_frame_ring_t *ring, int count )
+{
+    for( int i = 0; i < RING_SPIN_COUNT; i++ )
+        if( x264_sync_frame_ring_ready( ring, count ) )
+            return;
+    x264_pthread_mutex_lock( &ring->mutex );
+    x264_atomic_add( &ring->i_parked, 1 );
+    while( !x264_sync_frame_ring_ready( ring, count ) )
+        x264_pthread_cond_wait( &ring->cv, &ring->mutex );
+    x264_atomic_add( &ring->i_parked, -1 );
+    x264_pthread_mutex_unlock( &ring->mutex );
+}
+
+static void x264_sync_frame_ring_wake( x264_sync_frame_ring_t *ring )
+{
+    x264_atomic_barrier();
+    if( ring->i_parked )
+    {
+        x264_pthread_mutex_lock( &ring->mutex );
+        x264_pthread_cond_broadcast( &ring->cv );
+        x264_pthread_mutex_unlock( &ring->mutex );
+    }
+}
+
+/* Pushes all count frames at once, so the consumer never sees part of them. */
+void x264_sync_frame_ring_push( x264_sync_frame_ring_t *ring, x264_frame_t **frames, int count )
+{
+    assert( count <= ring->i_max_size );
+    x264_sync_frame_ring_park( ring, count );
+    for( int i = 0; i < count; i++ )
+        ring->list[(ring->i_tail + i) & ring->i_mask] = frames[i];
+    x264_atomic_barrier();
+    ring->i_tail += count;
+    x264_sync_frame_ring_wake( ring );
+}
+
+/* Pops up to max_count frames without waiting, returns the number popped. */
+int x264_sync_frame_ring_pop( x264_sync_frame_ring_t *ring, x264_frame_t **frames, int max_count )
+{
+    int count = X264_MIN( x264_sync_frame_ring_size( ring ), max_count );
+    x264_atomic_barrier();
+    for( int i = 0; i < count; i++ )
+        frames[i] = ring->list[(ring->i_head + i) & ring->i_mask];
+    x264_atomic_barrier();
+    ring->i_head += count;
+    if( count )
+        x264_sync_frame_ring_wake( ring );
+    return count;
+}
+
+x264_frame_t *x264_sync_frame_ring_peek( x264_sync_frame_ring_t *ring )
+{
+    if( !x264_sync_frame_ring_size( ring ) )
+        return NULL;
+    x264_atomic_barrier();
+    return ring->list[ring->i_head & ring->i_mask];
+}
+
+/* Waits until there are frames to pop or the ring is closed, returns the number of frames. */
+int x264_sync_frame_ring_wait( x264_sync_frame_ring_t *ring )
+{
+    x264_sync_frame_ring_park( ring, 0 );
+    return x264_sync_frame_ring_size( ring );
+}
+
+void x264_sync_frame_ring_close( x264_sync_frame_ring_t *ring )
+{
+    ring->b_closed = 1;
+    x264_sync_frame_ring_wake( ring );
+}
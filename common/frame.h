@@ -32,6 +32,8 @@
 #define PADH 32
 #define PADV 32
 
+typedef struct x264_frame_slab_t x264_frame_slab_t;
+
 typedef struct x264_frame
 {
     /* */
@@ -57,6 +59,8 @@ typedef struct x264_frame
     int     i_pic_struct;
     int     b_keyframe;
     uint8_t b_fdec;
+    int     i_numa_node; /* node the planes of fdec frames are placed on */
+    int64_t i_stage_time[X264_STAGE_MAX]; /* ns of lookahead stages spent on this frame */
     uint8_t b_last_minigop_bframe; /* this frame is the last b in a sequence of bframes */
     uint8_t i_bframes;   /* number of bframes following this nonb in coded order */
     float   f_qp_avg_rc; /* QPs as decided by ratecontrol */
@@ -84,6 +88,7 @@ typedef struct x264_frame
     pixel *buffer[4];
     pixel *buffer_fld[4];
     pixel *buffer_lowres[4];
+    x264_frame_slab_t *slab; /* single allocation holding all of the above and the arrays below */
 
     x264_weight_t weight[X264_REF_MAX][3]; /* [ref_index][plane] */
     pixel *weighted[X264_REF_MAX]; /* plane[0] weighted of the reference frames */
@@ -145,9 +150,10 @@ typedef struct x264_frame
     int64_t i_cpb_delay_lookahead;
 
     /* threading */
-    int     i_lines_completed; /* in pixels */
+    volatile int i_lines_completed; /* in pixels */
     int     i_lines_weighted; /* FIXME: this only supports weighting of one reference frame */
     int     i_reference_count; /* number of threads using this frame (not necessarily the number of pointers) */
+    volatile int i_waiters; /* threads sleeping on cv for more lines */
     x264_pthread_mutex_t mutex;
     x264_pthread_cond_t  cv;
 
@@ -175,6 +181,22 @@ typedef struct
    x264_pthread_cond_t      cv_empty; /* event signaling that the list became emptier */
 } x264_sync_frame_list_t;
 
+/* synchronized frame ring for one producer and one consumer thread:
+ * frames are handed over without locking, the mutex is only used to sleep
+ * after spinning on a full or empty ring for a while */
+typedef struct
+{
+   x264_frame_t **list;   /* power of 2 entries, so the counters below can wrap */
+   int i_max_size;
+   unsigned i_mask;
+   volatile unsigned i_head; /* number of frames popped, written only by the consumer */
+   volatile unsigned i_tail; /* number of frames pushed, written only by the producer */
+   volatile int b_closed;    /* the producer won't push any more frames */
+   volatile int i_parked;    /* threads sleeping on cv */
+   x264_pthread_mutex_t     mutex;
+   x264_pthread_cond_t      cv;
+} x264_sync_frame_ring_t;
+
 typedef void (*x264_deblock_inter_t)( pixel *pix, int stride, int alpha, int beta, int8_t *tc0 );
 typedef void (*x264_deblock_intra_t)( pixel *pix, int stride, int alpha, int beta );
 typedef struct
@@ -206,21 +228,23 @@ int           x264_frame_copy_picture( x264_t *h, x264_frame_t *dst, x264_pictur
 
 void          x264_frame_expand_border( x264_t *h, x264_frame_t *frame, int mb_y, int b_end );
 void          x264_frame_expand_border_filtered( x264_t *h, x264_frame_t *frame, int mb_y, int b_end );
+void          x264_frame_expand_border_left( x264_t *h, x264_frame_t *frame, int mb_y );
 void          x264_frame_expand_border_lowres( x264_frame_t *frame );
 void          x264_frame_expand_border_chroma( x264_t *h, x264_frame_t *frame, int plane );
 void          x264_frame_expand_border_mod16( x264_t *h, x264_frame_t *frame );
 void          x264_expand_border_mbpair( x264_t *h, int mb_x, int mb_y );
 
-void          x264_frame_deblock_row( x264_t *h, int mb_y );
+void          x264_frame_deblock_row( x264_t *h, int mb_y, int mb_x_start, int mb_x_end );
 void          x264_macroblock_deblock( x264_t *h );
 
 void          x264_frame_filter( x264_t *h, x264_frame_t *frame, int mb_y, int b_end );
+void          x264_frame_deblock_filter_row( x264_t *h, int mb_y, int b_deblock );
 void          x264_frame_init_lowres( x264_t *h, x264_frame_t *frame );
 
 void          x264_deblock_init( int cpu, x264_deblock_function_t *pf, int b_mbaff );
 
 void          x264_frame_cond_broadcast( x264_frame_t *frame, int i_lines_completed );
-void          x264_frame_cond_wait( x264_frame_t *frame, int i_lines_completed );
+int64_t       x264_frame_cond_wait( x264_frame_t *frame, int i_lines_completed );
 
 void          x264_frame_push( x264_frame_t **list, x264_frame_t *frame );
 x264_frame_t *x264_frame_pop( x264_frame_t **list );
@@ -239,4 +263,17 @@ void          x264_sync_frame_list_delete( x264_sync_frame_list_t *slist );
 void          x264_sync_frame_list_push( x264_sync_frame_list_t *slist, x264_frame_t *frame );
 x264_frame_t *x264_sync_frame_list_pop( x264_sync_frame_list_t *slist );
 
+int           x264_sync_frame_ring_init( x264_sync_frame_ring_t *ring, int max_size );
+void          x264_sync_frame_ring_delete( x264_sync_frame_ring_t *ring );
+void          x264_sync_frame_ring_push( x264_sync_frame_ring_t *ring, x264_frame_t **frames, int count );
+int           x264_sync_frame_ring_pop( x264_sync_frame_ring_t *ring, x264_frame_t **frames, int max_count );
+x264_frame_t *x264_sync_frame_ring_peek( x264_sync_frame_ring_t *ring );
+int           x264_sync_frame_ring_wait( x264_sync_frame_ring_t *ring );
+void          x264_sync_frame_ring_close( x264_sync_frame_ring_t *ring );
+
+static ALWAYS_INLINE int x264_sync_frame_ring_size( x264_sync_frame_ring_t *ring )
+{
+    return ring->i_tail - ring->i_head;
+}
+
 #endif
@@ -368,11 +368,13 @@ int x264_macroblock_thread_allocate( x264_t *h, int b_lookahead )
                 if( !PARAM_INTERLACED )
                     h->intra_border_backup[1][j] = h->intra_border_backup[i][j];
             }
-        for( int i = 0; i <= PARAM_INTERLACED; i++ )
-        {
-            CHECKED_MALLOC( h->deblock_strength[i], sizeof(**h->deblock_strength) * h->mb.i_mb_width );
-            h->deblock_strength[1] = h->deblock_strength[i];
-        }
+        /* A filter thread deblocks rows after the encoder has moved on to later ones. */
+        int rows = h->param.b_filter_thread ? h->mb.i_mb_height : 1 + PARAM_INTERLACED;
+        h->i_deblock_strength_mask = rows > 1 ? 0xffffffffu >> x264_clz( rows - 1 ) : 0;
+        CHECKED_MALLOC( h->deblock_strength, (h->i_deblock_strength_mask + 1) * sizeof(*h->deblock_strength) );
+        CHECKED_MALLOC( h->deblock_strength[0], sizeof(**h->deblock_strength) * h->mb.i_mb_width * rows );
+        for( int i = 1; i <= h->i_deblock_strength_mask; i++ )
+            h->deblock_strength[i] = h->deblock_strength[0] + (i % rows) * h->mb.i_mb_width;
     }
 
     /* Allocate scratch buffer */
@@ -402,8 +404,9 @@ void x264_macroblock_thread_free( x264_t *h, int b_lookahead )
 {
     if( !b_lookahead )
     {
-        for( int i = 0; i <= PARAM_INTERLACED; i++ )
-            x264_free( h->deblock_strength[i] );
+        if( h->deblock_strength )
+            x264_free( h->deblock_strength[0] );
+        x264_free( h->deblock_strength );
         for( int i = 0; i <= 4*PARAM_INTERLACED; i++ )
             for( int j = 0; j < (CHROMA444 ? 3 : 2); j++ )
                 x264_free( h->intra_border_backup[i][j] - 16 );
@@ -1438,7 +1441,7 @@ static void x264_macroblock_deblock_strength_mbaff( x264_t *h, uint8_t (*bs)[8][
 
 void x264_macroblock_deblock_strength( x264_t *h )
 {
-    uint8_t (*bs)[8][4] = h->deblock_strength[h->mb.i_mb_y&1][h->mb.i_mb_x];
+    uint8_t (*bs)[8][4] = h->deblock_strength[h->mb.i_mb_y&h->i_deblock_strength_mask][h->mb.i_mb_x];
     if( IS_INTRA( h->mb.i_type ) )
     {
         memset( bs[0][1], 3, 3*4*sizeof(uint8_t) );
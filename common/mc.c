@@ -532,6 +532,45 @@ void x264_mc_init( int cpu, x264_mc_functions_t *pf )
 #endif
 }
 
+/* generate integral image:
+ * frame->integral contains 2 planes. in the upper plane, each element is
+ * the sum of an 8x8 pixel region with top-left corner on that point.
+ * in the lower plane, 4x4 sums (needed only with --partitions p4x4). */
+static void frame_filter_integral( x264_t *h, x264_frame_t *frame, int start, int height, int b_end )
+{
+    if( frame->integral )
+    {
+        int stride = frame->i_stride[0];
+        if( start < 0 )
+        {
+            memset( frame->integral - PADV * stride - PADH, 0, stride * sizeof(uint16_t) );
+            start = -PADV;
+        }
+        if( b_end )
+            height += PADV-9;
+        for( int y = start; y < height; y++ )
+        {
+            pixel    *pix  = frame->plane[0] + y * stride - PADH;
+            uint16_t *sum8 = frame->integral + (y+1) * stride - PADH;
+            uint16_t *sum4;
+            if( h->frames.b_have_sub8x8_esa )
+            {
+                h->mc.integral_init4h( sum8, pix, stride );
+                sum8 -= 8*stride;
+                sum4 = sum8 + stride * (frame->i_lines[0] + PADV*2);
+                if( y >= 8-PADV )
+                    h->mc.integral_init4v( sum8, sum4, stride );
+            }
+            else
+            {
+                h->mc.integral_init8h( sum8, pix, stride );
+                if( y >= 8-PADV )
+                    h->mc.integral_init8v( sum8-8*stride, stride );
+            }
+        }
+    }
+}
+
 void x264_frame_filter( x264_t *h, x264_frame_t *frame, int mb_y, int b_end )
 {
     const int b_interlaced = PARAM_INTERLACED;
@@ -576,40 +615,68 @@ void x264_frame_filter( x264_t *h, x264_frame_t *frame, int mb_y, int b_end )
         }
     }
 
-    /* generate integral image:
-     * frame->integral contains 2 planes. in the upper plane, each element is
-     * the sum of an 8x8 pixel region with top-left corner on that point.
-     * in the lower plane, 4x4 sums (needed only with --partitions p4x4). */
+    frame_filter_integral( h, frame, start, height, b_end );
+}
+
+#define FILTER_TILE_MBS 8
 
-    if( frame->integral )
+/* Filters columns [x_start, x_end) of rows [start, start+16) of a plane.  The SIMD filters
+ * leave the first centre columns of each call unfinished, since the intermediate row they
+ * filter horizontally starts there, so a call that doesn't start at the left edge begins
+ * 16 columns early and puts back the columns left of that overlap afterwards. */
+static void frame_filter_tile( x264_t *h, x264_frame_t *frame, int p, int start, int x_start, int x_end )
+{
+    int stride = frame->i_stride[p];
+    pixel save[16][24];
+    pixel *dstc = frame->filtered[p][3] + start*stride;
+    int b_restore = x_start > -8;
+    if( b_restore )
     {
-        int stride = frame->i_stride[0];
-        if( start < 0 )
-        {
-            memset( frame->integral - PADV * stride - PADH, 0, stride * sizeof(uint16_t) );
-            start = -PADV;
-        }
-        if( b_end )
-            height += PADV-9;
-        for( int y = start; y < height; y++ )
-        {
-            pixel    *pix  = frame->plane[0] + y * stride - PADH;
-            uint16_t *sum8 = frame->integral + (y+1) * stride - PADH;
-            uint16_t *sum4;
-            if( h->frames.b_have_sub8x8_esa )
-            {
-                h->mc.integral_init4h( sum8, pix, stride );
-                sum8 -= 8*stride;
-                sum4 = sum8 + stride * (frame->i_lines[0] + PADV*2);
-                if( y >= 8-PADV )
-                    h->mc.integral_init4v( sum8, sum4, stride );
-            }
-            else
-            {
-                h->mc.integral_init8h( sum8, pix, stride );
-                if( y >= 8-PADV )
-                    h->mc.integral_init8v( sum8-8*stride, stride );
-            }
-        }
+        x_start -= 16;
+        for( int y = 0; y < 16; y++ )
+            memcpy( save[y], dstc + y*stride + x_start - 16, sizeof(save[y]) );
     }
+    int offs = start*stride + x_start;
+    h->mc.hpel_filter(
+        frame->filtered[p][1] + offs,
+        frame->filtered[p][2] + offs,
+        frame->filtered[p][3] + offs,
+        frame->plane[p] + offs,
+        stride, x_end - x_start, 16,
+        h->scratch_buffer );
+    if( b_restore )
+        for( int y = 0; y < 16; y++ )
+            memcpy( dstc + y*stride + x_start - 16, save[y], sizeof(save[y]) );
+}
+
+/* Equivalent to deblocking row mb_y of h->fdec, expanding its border and filtering it with
+ * x264_frame_filter, but works through the row in tiles of FILTER_TILE_MBS mbs, filtering
+ * each tile right after deblocking it while its pixels are still in cache.  Deblocking a
+ * tile changes up to 3 pixels left of it and the filter reads 3 pixels to the right, so
+ * each tile's filtered columns end 8 pixels short of its deblocked ones.  Progressive only,
+ * and not for the first or last row, whose vertical padding needs the whole row. */
+void x264_frame_deblock_filter_row( x264_t *h, int mb_y, int b_deblock )
+{
+    x264_frame_t *frame = h->fdec;
+    int start = mb_y*16 - 8;
+
+    for( int mb_x = 0; mb_x < h->mb.i_mb_width; mb_x += FILTER_TILE_MBS )
+    {
+        int mb_x_end = X264_MIN( mb_x + FILTER_TILE_MBS, h->mb.i_mb_width );
+        int b_last = mb_x_end == h->mb.i_mb_width;
+        if( b_deblock )
+            x264_frame_deblock_row( h, mb_y, mb_x, mb_x_end );
+        /* The first and last tiles read the padding on their side. */
+        if( !mb_x )
+            x264_frame_expand_border_left( h, frame, mb_y );
+        if( b_last )
+            x264_frame_expand_border( h, frame, mb_y, 0 );
+        int x_start = mb_x ? mb_x*16 - 8 : -8;
+        int x_end = b_last ? mb_x_end*16 + 8 : mb_x_end*16 - 8;
+        for( int p = 0; p < (CHROMA444 ? 3 : 1); p++ )
+            frame_filter_tile( h, frame, p, start, x_start, x_end );
+    }
+
+    x264_frame_expand_border_filtered( h, frame, mb_y, 0 );
+    frame_filter_integral( h, frame, start, mb_y*16 + 8, 0 );
 }
@@ -54,6 +54,16 @@ int64_t x264_mdate( void )
 #endif
 }
 
+int64_t x264_ndate( void )
+{
+#if defined(CLOCK_MONOTONIC) && !SYS_WINDOWS
+    struct timespec ts;
+    if( !clock_gettime( CLOCK_MONOTONIC, &ts ) )
+        return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+    return x264_mdate() * 1000;
+}
+
 #if HAVE_WIN32THREAD || PTW32_STATIC_LIB
 /* state of the threading library being initialized */
 static volatile LONG x264_threading_is_init = 0;
@@ -169,6 +169,7 @@ static inline int x264_pthread_create( x264_pthread_t *t, void *a, void *(*f)(vo
 #define x264_pthread_cond_destroy    pthread_cond_destroy
 #define x264_pthread_cond_broadcast  pthread_cond_broadcast
 #define x264_pthread_cond_wait       pthread_cond_wait
+#define x264_pthread_cond_signal     pthread_cond_signal
 #define x264_pthread_attr_t          pthread_attr_t
 #define x264_pthread_attr_init       pthread_attr_init
 #define x264_pthread_attr_destroy    pthread_attr_destroy
@@ -195,12 +196,23 @@ static inline int x264_pthread_create( x264_pthread_t *t, void *a, void *(*f)(vo
 #define x264_pthread_cond_destroy(c)
 #define x264_pthread_cond_broadcast(c)
 #define x264_pthread_cond_wait(c,m)
+#define x264_pthread_cond_signal(c)
 #define x264_pthread_attr_t          int
 #define x264_pthread_attr_init(a)    0
 #define x264_pthread_attr_destroy(a)
 #define X264_PTHREAD_MUTEX_INITIALIZER 0
 #endif
 
+/* atomic operations, all of which are full memory barriers */
+#if HAVE_THREAD
+#define x264_atomic_cas(p,o,n)       __sync_bool_compare_and_swap(p,o,n)
+#define x264_atomic_add(p,v)         __sync_add_and_fetch(p,v)
+#define x264_atomic_barrier()        __sync_synchronize()
+#else
+#define x264_atomic_add(p,v)         (*(p) += (v))
+#define x264_atomic_barrier()
+#endif
+
 #if HAVE_WIN32THREAD || PTW32_STATIC_LIB
 int x264_threading_init( void );
 #else
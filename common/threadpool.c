@@ -25,49 +25,122 @@
 
 #include "common.h"
 
-typedef struct
+/* Jobs are placed in per-worker queues without taking a lock.  A worker runs the oldest
+ * job of its own queue and steals the oldest job of another worker's queue when its own
+ * is empty; it only sleeps once all queues are empty.  Each job doubles as the future
+ * for its result.  The number of jobs is the number of workers, so the queues never
+ * overflow and every queued job finds a worker even while others are blocked. */
+
+#define JOB_FREE    0 /* available for x264_threadpool_submit */
+#define JOB_CLAIMED 1 /* taken by x264_threadpool_submit, func and arg not yet set */
+#define JOB_QUEUED  2 /* submitted, and either waiting in a queue or running */
+#define JOB_DONE    3 /* finished, result not yet collected */
+
+/* polls of a job's state before sleeping on it */
+#define SPIN_COUNT 256
+
+struct x264_threadpool_job_t
 {
     void *(*func)(void *);
     void *arg;
     void *ret;
-} x264_threadpool_job_t;
+    volatile int state;
+    int seq; /* submission order */
+};
+
+typedef struct
+{
+    x264_threadpool_t *pool;
+    int id;
+} x264_threadpool_worker_t;
 
 struct x264_threadpool_t
 {
-    int            exit;
+    volatile int   exit;
     int            threads;
     x264_pthread_t *thread_handle;
+    x264_threadpool_worker_t *workers;
     void           (*init_func)(void *);
     void           *init_arg;
 
-    /* requires a synchronized list structure and associated methods,
-       so use what is already implemented for frames */
-    x264_sync_frame_list_t uninit; /* list of jobs that are awaiting use */
-    x264_sync_frame_list_t run;    /* list of jobs that are queued for processing by the pool */
-    x264_sync_frame_list_t done;   /* list of jobs that have finished processing */
+    x264_threadpool_job_t *jobs;
+    /* one queue per worker, each of threads slots; empty slots are NULL */
+    x264_threadpool_job_t **queues;
+    volatile int   seq;
+
+    /* only used to sleep: workers on cv_run, waiters for results or free jobs on cv_done */
+    volatile int   queued;   /* jobs in the queues */
+    volatile int   sleeping; /* workers sleeping on cv_run */
+    volatile int   waiting;  /* threads sleeping on cv_done */
+    x264_pthread_mutex_t mutex;
+    x264_pthread_cond_t  cv_run;
+    x264_pthread_cond_t  cv_done;
 };
 
-static void x264_threadpool_thread( x264_threadpool_t *pool )
+static x264_threadpool_job_t *x264_threadpool_take( x264_threadpool_t *pool, int id )
+{
+    for( int i = 0; i < pool->threads; i++ )
+    {
+        x264_threadpool_job_t * volatile *queue = pool->queues + ((id + i) % pool->threads) * pool->threads;
+        x264_threadpool_job_t *job;
+        do
+        {
+            int slot = -1;
+            job = NULL;
+            for( int j = 0; j < pool->threads; j++ )
+            {
+                x264_threadpool_job_t *t = queue[j];
+                if( t && (!job || (int)((unsigned)t->seq - job->seq) < 0) )
+                {
+                    job = t;
+                    slot = j;
+                }
+            }
+            if( job && x264_atomic_cas( queue+slot, job, NULL ) )
+                return job;
+        } while( job ); /* lost the race for it, look again */
+    }
+    return NULL;
+}
+
+/* Wakes threads sleeping on cv, after the caller has published what they wait for. */
+static void x264_threadpool_wake( x264_threadpool_t *pool, volatile int *sleepers, x264_pthread_cond_t *cv )
 {
+    x264_atomic_barrier();
+    if( *sleepers )
+    {
+        x264_pthread_mutex_lock( &pool->mutex );
+        x264_pthread_cond_broadcast( cv );
+        x264_pthread_mutex_unlock( &pool->mutex );
+    }
+}
+
+static void x264_threadpool_thread( x264_threadpool_worker_t *worker )
+{
+    x264_threadpool_t *pool = worker->pool;
     if( pool->init_func )
         pool->init_func( pool->init_arg );
 
-    while( !pool->exit )
+    while( 1 )
     {
-        x264_threadpool_job_t *job = NULL;
-        x264_pthread_mutex_lock( &pool->run.mutex );
-        while( !pool->exit && !pool->run.i_size )
-            x264_pthread_cond_wait( &pool->run.cv_fill, &pool->run.mutex );
-        if( pool->run.i_size )
+        x264_threadpool_job_t *job = x264_threadpool_take( pool, worker->id );
+        if( job )
         {
-            job = (void*)x264_frame_shift( pool->run.list );
-            pool->run.i_size--;
-        }
-        x264_pthread_mutex_unlock( &pool->run.mutex );
-        if( !job )
+            x264_atomic_add( &pool->queued, -1 );
+            job->ret = job->func( job->arg ); /* execute the function */
+            x264_atomic_barrier();
+            job->state = JOB_DONE;
+            x264_threadpool_wake( pool, &pool->waiting, &pool->cv_done );
             continue;
-        job->ret = job->func( job->arg ); /* execute the function */
-        x264_sync_frame_list_push( &pool->done, (void*)job );
+        }
+        x264_pthread_mutex_lock( &pool->mutex );
+        x264_atomic_add( &pool->sleeping, 1 );
+        while( !pool->exit && pool->queued <= 0 )
+            x264_pthread_cond_wait( &pool->cv_run, &pool->mutex );
+        x264_atomic_add( &pool->sleeping, -1 );
+        x264_pthread_mutex_unlock( &pool->mutex );
+        if( pool->exit )
+            break;
     }
 }
 
@@ -86,83 +159,121 @@ int x264_threadpool_init( x264_threadpool_t **p_pool, int threads,
     pool->threads   = X264_MIN( threads, X264_THREAD_MAX );
 
     CHECKED_MALLOC( pool->thread_handle, pool->threads * sizeof(x264_pthread_t) );
+    CHECKED_MALLOC( pool->workers, pool->threads * sizeof(x264_threadpool_worker_t) );
+    CHECKED_MALLOCZERO( pool->jobs, pool->threads * sizeof(x264_threadpool_job_t) );
+    CHECKED_MALLOCZERO( pool->queues, pool->threads * pool->threads * sizeof(x264_threadpool_job_t*) );
 
-    if( x264_sync_frame_list_init( &pool->uninit, pool->threads ) ||
-        x264_sync_frame_list_init( &pool->run, pool->threads ) ||
-        x264_sync_frame_list_init( &pool->done, pool->threads ) )
+    if( x264_pthread_mutex_init( &pool->mutex, NULL ) ||
+        x264_pthread_cond_init( &pool->cv_run, NULL ) ||
+        x264_pthread_cond_init( &pool->cv_done, NULL ) )
         goto fail;
 
     for( int i = 0; i < pool->threads; i++ )
     {
-       x264_threadpool_job_t *job;
-       CHECKED_MALLOC( job, sizeof(x264_threadpool_job_t) );
-       x264_sync_frame_list_push( &pool->uninit, (void*)job );
-    }
-    for( int i = 0; i < pool->threads; i++ )
-        if( x264_pthread_create( pool->thread_handle+i, NULL, (void*)x264_threadpool_thread, pool ) )
+        pool->workers[i].pool = pool;
+        pool->workers[i].id = i;
+        if( x264_pthread_create( pool->thread_handle+i, NULL, (void*)x264_threadpool_thread, pool->workers+i ) )
             goto fail;
+    }
 
     return 0;
 fail:
     return -1;
 }
 
-void x264_threadpool_run( x264_threadpool_t *pool, void *(*func)(void *), void *arg )
+static x264_threadpool_job_t *x264_threadpool_claim( x264_threadpool_t *pool )
 {
-    x264_threadpool_job_t *job = (void*)x264_sync_frame_list_pop( &pool->uninit );
-    job->func = func;
-    job->arg  = arg;
-    x264_sync_frame_list_push( &pool->run, (void*)job );
+    for( int i = 0; i < pool->threads; i++ )
+        if( pool->jobs[i].state == JOB_FREE && x264_atomic_cas( &pool->jobs[i].state, JOB_FREE, JOB_CLAIMED ) )
+            return pool->jobs+i;
+    return NULL;
 }
 
-void *x264_threadpool_wait( x264_threadpool_t *pool, void *arg )
+x264_threadpool_job_t *x264_threadpool_submit( x264_threadpool_t *pool, void *(*func)(void *), void *arg )
 {
-    x264_threadpool_job_t *job = NULL;
+    x264_threadpool_job_t *job = x264_threadpool_claim( pool );
+    if( !job )
+    {
+        /* more jobs in flight than workers: wait for a result to be collected */
+        x264_pthread_mutex_lock( &pool->mutex );
+        x264_atomic_add( &pool->waiting, 1 );
+        while( !(job = x264_threadpool_claim( pool )) )
+            x264_pthread_cond_wait( &pool->cv_done, &pool->mutex );
+        x264_atomic_add( &pool->waiting, -1 );
+        x264_pthread_mutex_unlock( &pool->mutex );
+    }
+    job->func = func;
+    job->arg  = arg;
+    job->seq  = x264_atomic_add( &pool->seq, 1 );
+    /* only now can x264_threadpool_wait match the job by its arg */
+    x264_atomic_barrier();
+    job->state = JOB_QUEUED;
 
-    x264_pthread_mutex_lock( &pool->done.mutex );
-    while( !job )
+    /* a free job is in no queue, so there is always a free slot */
+    x264_threadpool_job_t * volatile *queue = pool->queues + ((unsigned)job->seq % pool->threads) * pool->threads;
+    for( int i = 0; !x264_atomic_cas( queue+i, NULL, job ); i = (i+1) % pool->threads );
+    x264_atomic_add( &pool->queued, 1 );
+    if( pool->sleeping )
     {
-        for( int i = 0; i < pool->done.i_size; i++ )
-        {
-            x264_threadpool_job_t *t = (void*)pool->done.list[i];
-            if( t->arg == arg )
-            {
-                job = (void*)x264_frame_shift( pool->done.list+i );
-                pool->done.i_size--;
-            }
-        }
-        if( !job )
-            x264_pthread_cond_wait( &pool->done.cv_fill, &pool->done.mutex );
+        x264_pthread_mutex_lock( &pool->mutex );
+        x264_pthread_cond_signal( &pool->cv_run );
+        x264_pthread_mutex_unlock( &pool->mutex );
     }
-    x264_pthread_mutex_unlock( &pool->done.mutex );
+    return job;
+}
 
+void *x264_threadpool_join( x264_threadpool_t *pool, x264_threadpool_job_t *job )
+{
+    for( int i = 0; i < SPIN_COUNT && job->state != JOB_DONE; i++ );
+    if( job->state != JOB_DONE )
+    {
+        x264_pthread_mutex_lock( &pool->mutex );
+        x264_atomic_add( &pool->waiting, 1 );
+        while( job->state != JOB_DONE )
+            x264_pthread_cond_wait( &pool->cv_done, &pool->mutex );
+        x264_atomic_add( &pool->waiting, -1 );
+        x264_pthread_mutex_unlock( &pool->mutex );
+    }
+    x264_atomic_barrier();
     void *ret = job->ret;
-    x264_sync_frame_list_push( &pool->uninit, (void*)job );
+    job->state = JOB_FREE;
+    x264_threadpool_wake( pool, &pool->waiting, &pool->cv_done );
     return ret;
 }
 
-static void x264_threadpool_list_delete( x264_sync_frame_list_t *slist )
+void x264_threadpool_run( x264_threadpool_t *pool, void *(*func)(void *), void *arg )
+{
+    x264_threadpool_submit( pool, func, arg );
+}
+
+void *x264_threadpool_wait( x264_threadpool_t *pool, void *arg )
 {
-    for( int i = 0; slist->list[i]; i++ )
+    for( int i = 0; i < pool->threads; i++ )
     {
-        x264_free( slist->list[i] );
-        slist->list[i] = NULL;
+        /* a claimed job still holds the arg of the job it last ran */
+        int state = pool->jobs[i].state;
+        x264_atomic_barrier();
+        if( (state == JOB_QUEUED || state == JOB_DONE) && pool->jobs[i].arg == arg )
+            return x264_threadpool_join( pool, pool->jobs+i );
     }
-    x264_sync_frame_list_delete( slist );
+    return NULL;
 }
 
 void x264_threadpool_delete( x264_threadpool_t *pool )
 {
-    x264_pthread_mutex_lock( &pool->run.mutex );
+    x264_pthread_mutex_lock( &pool->mutex );
     pool->exit = 1;
-    x264_pthread_cond_broadcast( &pool->run.cv_fill );
-    x264_pthread_mutex_unlock( &pool->run.mutex );
+    x264_pthread_cond_broadcast( &pool->cv_run );
+    x264_pthread_mutex_unlock( &pool->mutex );
     for( int i = 0; i < pool->threads; i++ )
         x264_pthread_join( pool->thread_handle[i], NULL );
 
-    x264_threadpool_list_delete( &pool->uninit );
-    x264_threadpool_list_delete( &pool->run );
-    x264_threadpool_list_delete( &pool->done );
+    x264_pthread_mutex_destroy( &pool->mutex );
+    x264_pthread_cond_destroy( &pool->cv_run );
+    x264_pthread_cond_destroy( &pool->cv_done );
+    x264_free( pool->queues );
+    x264_free( pool->jobs );
+    x264_free( pool->workers );
     x264_free( pool->thread_handle );
     x264_free( pool );
 }
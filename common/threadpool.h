@@ -27,15 +27,23 @@
 #define X264_THREADPOOL_H
 
 typedef struct x264_threadpool_t x264_threadpool_t;
+typedef struct x264_threadpool_job_t x264_threadpool_job_t;
 
 #if HAVE_THREAD
 int   x264_threadpool_init( x264_threadpool_t **p_pool, int threads,
                             void (*init_func)(void *), void *init_arg );
+/* submit returns the job as a future; join waits for it and returns func's result.
+ * At most as many jobs as threads can be outstanding; submit blocks beyond that. */
+x264_threadpool_job_t *x264_threadpool_submit( x264_threadpool_t *pool, void *(*func)(void *), void *arg );
+void *x264_threadpool_join( x264_threadpool_t *pool, x264_threadpool_job_t *job );
+/* run/wait identify the job by its arg instead */
 void  x264_threadpool_run( x264_threadpool_t *pool, void *(*func)(void *), void *arg );
 void *x264_threadpool_wait( x264_threadpool_t *pool, void *arg );
 void  x264_threadpool_delete( x264_threadpool_t *pool );
 #else
 #define x264_threadpool_init(p,t,f,a) -1
+#define x264_threadpool_submit(p,f,a) NULL
+#define x264_threadpool_join(p,j)     NULL
 #define x264_threadpool_run(p,f,a)
 #define x264_threadpool_wait(p,a)     NULL
 #define x264_threadpool_delete(p)
@@ -0,0 +1,145 @@
+/*****************************************************************************
+ * trace.c: thread timeline tracing
+ *****************************************************************************
+ * Copyright (C) 2011 x264 project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at licensing@x264.com.
+ *****************************************************************************/
+
+#include "common.h"
+
+/* events kept per track; older ones are overwritten */
+#define TRACE_EVENTS (1<<15)
+#define TRACE_TRACKS_MAX (2*X264_THREAD_MAX+2)
+
+typedef struct
+{
+    int64_t i_start;
+    int64_t i_end;
+    const char *name;
+    const char *arg_name;
+    int i_arg;
+    char c_phase; /* trace-event phase: X complete, i instant, C counter */
+} x264_trace_event_t;
+
+struct x264_trace_track_t
+{
+    char name[48];
+    int64_t i_events; /* events recorded, including overwritten ones */
+    x264_trace_event_t event[TRACE_EVENTS];
+};
+
+struct x264_trace_t
+{
+    int64_t i_start;
+    int i_tracks;
+    x264_trace_track_t *track[TRACE_TRACKS_MAX];
+};
+
+x264_trace_t *x264_trace_init( void )
+{
+    x264_trace_t *trace;
+    CHECKED_MALLOCZERO( trace, sizeof(x264_trace_t) );
+    trace->i_start = x264_ndate();
+    return trace;
+fail:
+    return NULL;
+}
+
+x264_trace_track_t *x264_trace_track( x264_trace_t *trace, const char *name )
+{
+    x264_trace_track_t *track;
+    if( trace->i_tracks == TRACE_TRACKS_MAX )
+        return NULL;
+    CHECKED_MALLOC( track, sizeof(x264_trace_track_t) );
+    snprintf( track->name, sizeof(track->name), "%s", name );
+    track->i_events = 0;
+    trace->track[trace->i_tracks++] = track;
+    return track;
+fail:
+    return NULL;
+}
+
+static void x264_trace_event( x264_trace_track_t *track, char c_phase, const char *name,
+                              int64_t start, int64_t end, const char *arg_name, int arg )
+{
+    x264_trace_event_t *e = &track->event[track->i_events++ & (TRACE_EVENTS-1)];
+    e->i_start = start;
+    e->i_end = end;
+    e->name = name;
+    e->arg_name = arg_name;
+    e->i_arg = arg;
+    e->c_phase = c_phase;
+}
+
+void x264_trace_complete( x264_trace_track_t *track, const char *name, int64_t start, int64_t end, const char *arg_name, int arg )
+{
+    x264_trace_event( track, 'X', name, start, end, arg_name, arg );
+}
+
+void x264_trace_instant( x264_trace_track_t *track, const char *name, const char *arg_name, int arg )
+{
+    int64_t now = x264_ndate();
+    x264_trace_event( track, 'i', name, now, now, arg_name, arg );
+}
+
+void x264_trace_counter( x264_trace_track_t *track, const char *name, const char *arg_name, int arg )
+{
+    int64_t now = x264_ndate();
+    x264_trace_event( track, 'C', name, now, now, arg_name, arg );
+}
+
+int x264_trace_write( x264_trace_t *trace, const char *filename )
+{
+    FILE *f = fopen( filename, "w" );
+    if( !f )
+        return -1;
+    fprintf( f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" );
+    for( int tid = 0; tid < trace->i_tracks; tid++ )
+    {
+        x264_trace_track_t *track = trace->track[tid];
+        fprintf( f, "%s{\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"name\":\"thread_name\",\"args\":{\"name\":\"%s\"}},\n"
+                    "{\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"name\":\"thread_sort_index\",\"args\":{\"sort_index\":%d}}",
+                 tid ? ",\n" : "", tid, track->name, tid, tid );
+        int64_t first = X264_MAX( track->i_events - TRACE_EVENTS, 0 );
+        for( int64_t i = first; i < track->i_events; i++ )
+        {
+            x264_trace_event_t *e = &track->event[i & (TRACE_EVENTS-1)];
+            fprintf( f, ",\n{\"ph\":\"%c\",\"pid\":1,\"tid\":%d,\"name\":\"%s\",\"ts\":%.3f",
+                     e->c_phase, tid, e->name, (e->i_start - trace->i_start) / 1000.0 );
+            if( e->c_phase == 'X' )
+                fprintf( f, ",\"dur\":%.3f", (e->i_end - e->i_start) / 1000.0 );
+            else if( e->c_phase == 'i' )
+                fprintf( f, ",\"s\":\"t\"" );
+            if( e->arg_name )
+                fprintf( f, ",\"args\":{\"%s\":%d}", e->arg_name, e->i_arg );
+            fprintf( f, "}" );
+        }
+    }
+    fprintf( f, "\n]}\n" );
+    return fclose( f ) ? -1 : 0;
+}
+
+void x264_trace_delete( x264_trace_t *trace )
+{
+    if( !trace )
+        return;
+    for( int i = 0; i < trace->i_tracks; i++ )
+        x264_free( trace->track[i] );
+    x264_free( trace );
+}
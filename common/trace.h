@@ -0,0 +1,48 @@
+/*****************************************************************************
+ * trace.h: thread timeline tracing
+ *****************************************************************************
+ * Copyright (C) 2011 x264 project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at licensing@x264.com.
+ *****************************************************************************/
+
+#ifndef X264_TRACE_H
+#define X264_TRACE_H
+
+/* A trace is a set of tracks, one per encoder context that runs on a thread
+ * of its own (frame and slice threads, filter companions, the lookahead, and
+ * the caller of the API).  Only one thread at a time records into a track, so
+ * recording takes no locks.  Each track keeps its most recent events. */
+typedef struct x264_trace_t x264_trace_t;
+typedef struct x264_trace_track_t x264_trace_track_t;
+
+x264_trace_t       *x264_trace_init( void );
+/* name is copied; tracks are shown in the order they were added */
+x264_trace_track_t *x264_trace_track( x264_trace_t *trace, const char *name );
+/* name and arg_name have to remain valid until the trace is written.
+ * complete: an interval from start to end, in x264_ndate time
+ * instant:  a point in time
+ * counter:  a value plotted over time */
+void x264_trace_complete( x264_trace_track_t *track, const char *name, int64_t start, int64_t end, const char *arg_name, int arg );
+void x264_trace_instant( x264_trace_track_t *track, const char *name, const char *arg_name, int arg );
+void x264_trace_counter( x264_trace_track_t *track, const char *name, const char *arg_name, int arg );
+/* writes Chrome trace-event JSON, as read by chrome://tracing and Perfetto */
+int  x264_trace_write( x264_trace_t *trace, const char *filename );
+void x264_trace_delete( x264_trace_t *trace );
+
+#endif
@@ -39,6 +39,7 @@ cglobal cpu_cpuid, 5,7
     push  r2
     push  r1
     mov  eax, r0d
+    xor  ecx, ecx ; subleaf 0 for the leaves that have them
     cpuid
     pop  rsi
     mov [rsi], eax
@@ -479,7 +479,14 @@ static void x264_mb_analyse_init( x264_t *h, x264_mb_analysis_t *a, int qp )
                 for( int i = (h->sh.i_type == SLICE_TYPE_B); i >= 0; i-- )
                     for( int j = 0; j < h->i_ref[i]; j++ )
                     {
-                        x264_frame_cond_wait( h->fref[i][j]->orig, thresh );
+                        int64_t wait = x264_frame_cond_wait( h->fref[i][j]->orig, thresh );
+                        h->i_ref_wait_time += wait;
+                        h->i_stage_time[X264_STAGE_WAIT] += wait * 1000;
+                        if( h->trace && wait )
+                        {
+                            int64_t end = x264_ndate();
+                            x264_trace_complete( h->trace, "wait ref", end - wait*1000, end, "frame", h->fref[i][j]->i_frame );
+                        }
                         thread_mvy_range = X264_MIN( thread_mvy_range, h->fref[i][j]->orig->i_lines_completed - pix_y );
                     }
 
@@ -488,7 +495,9 @@ static void x264_mb_analyse_init( x264_t *h, x264_mb_analysis_t *a, int qp )
                 if( PARAM_INTERLACED )
                     thread_mvy_range >>= 1;
 
-                x264_analyse_weight_frame( h, pix_y + thread_mvy_range );
+                /* Slice threads share fenc's weighted planes, which are weighted in full up front. */
+                if( !h->param.b_sliced_threads )
+                    x264_analyse_weight_frame( h, pix_y + thread_mvy_range );
             }
 
             if( PARAM_INTERLACED )
@@ -35,6 +35,7 @@ void x264_macroblock_analyse( x264_t *h );
 void x264_slicetype_decide( x264_t *h );
 
 void x264_slicetype_analyse( x264_t *h, int keyframe );
+void x264_slicetype_stage_time( x264_t *h, x264_frame_t **frames, int count, int64_t start, int64_t mbtree_start );
 
 int x264_weighted_reference_duplicate( x264_t *h, int i_ref, const x264_weight_t *w );
 
@@ -375,6 +375,164 @@ static void x264_encoder_thread_init( x264_t *h )
 }
 #endif
 
+/* With --filter-thread, the in-loop x264_fdec_filter_row of each frame thread runs on a
+ * companion thread instead, trailing the encoder by at least one row.  The encoder
+ * never reads back deblocked or filtered pixels of the frame it is encoding (intra
+ * prediction uses intra_border_backup), so it only has to wait for the companion
+ * at the end of the frame; other frame threads wait on the rows it broadcasts. */
+struct x264_filter_thread_t
+{
+    x264_t *h; /* the companion's context, sharing the frame thread's mb arrays */
+    x264_pthread_t handle;
+    x264_pthread_mutex_t mutex;
+    x264_pthread_cond_t cv;
+    int i_posted;   /* last mb_y the encoder asked to filter */
+    int i_filtered; /* last mb_y the companion has filtered */
+    int b_exit;
+};
+
+static void x264_filter_thread_post( x264_filter_thread_t *f, int mb_y )
+{
+    x264_pthread_mutex_lock( &f->mutex );
+    f->i_posted = mb_y;
+    x264_pthread_cond_broadcast( &f->cv );
+    x264_pthread_mutex_unlock( &f->mutex );
+}
+
+static void x264_fdec_filter_row( x264_t *h, int mb_y, int b_inloop );
+
+#if HAVE_THREAD
+static void *x264_filter_thread( x264_filter_thread_t *f )
+{
+    x264_encoder_thread_init( f->h );
+    if( f->h->numa )
+        x264_numa_pin_thread( f->h->numa, f->h->i_numa_node );
+    x264_pthread_mutex_lock( &f->mutex );
+    while( 1 )
+    {
+        while( !f->b_exit && f->i_filtered == f->i_posted )
+            x264_pthread_cond_wait( &f->cv, &f->mutex );
+        if( f->b_exit )
+            break;
+        /* The encoder asks for every row in order, so catch up one row at a time. */
+        int mb_y = f->i_filtered + 1;
+        x264_pthread_mutex_unlock( &f->mutex );
+        x264_stack_align( x264_fdec_filter_row, f->h, mb_y, 1 );
+        x264_pthread_mutex_lock( &f->mutex );
+        f->i_filtered = mb_y;
+        x264_pthread_cond_broadcast( &f->cv );
+    }
+    x264_pthread_mutex_unlock( &f->mutex );
+    return NULL;
+}
+
+static int x264_filter_threads_init( x264_t *h )
+{
+    for( int i = 0; i < h->i_thread_frames; i++ )
+    {
+        x264_filter_thread_t *f;
+        CHECKED_MALLOCZERO( f, sizeof(x264_filter_thread_t) );
+        h->thread[i]->filter_thread = f;
+        CHECKED_MALLOC( f->h, sizeof(x264_t) );
+        *f->h = *h->thread[i];
+        f->h->filter_thread = NULL;
+        if( h->tracer )
+        {
+            char name[48];
+            sprintf( name, "filter thread %d", i );
+            if( !(f->h->trace = x264_trace_track( h->tracer, name )) )
+            {
+                x264_free( f->h );
+                h->thread[i]->filter_thread = NULL;
+                x264_free( f );
+                return -1;
+            }
+        }
+        int buf_hpel = (h->thread[i]->fdec->i_width[0]+96) * sizeof(int16_t);
+        int buf_ssim = h->param.analyse.b_ssim * 8 * (h->param.i_width/4+3) * sizeof(int);
+        CHECKED_MALLOC( f->h->scratch_buffer, X264_MAX( buf_hpel, buf_ssim ) );
+        if( x264_pthread_mutex_init( &f->mutex, NULL ) ||
+            x264_pthread_cond_init( &f->cv, NULL ) ||
+            x264_pthread_create( &f->handle, NULL, (void*)x264_filter_thread, f ) )
+        {
+            x264_free( f->h->scratch_buffer );
+            x264_free( f->h );
+            h->thread[i]->filter_thread = NULL;
+            x264_free( f );
+            return -1;
+        }
+    }
+    return 0;
+fail:
+    return -1;
+}
+
+static void x264_filter_threads_delete( x264_t *h )
+{
+    for( int i = 0; i < h->i_thread_frames; i++ )
+    {
+        x264_filter_thread_t *f = h->thread[i]->filter_thread;
+        if( !f )
+            continue;
+        x264_pthread_mutex_lock( &f->mutex );
+        f->b_exit = 1;
+        x264_pthread_cond_broadcast( &f->cv );
+        x264_pthread_mutex_unlock( &f->mutex );
+        x264_pthread_join( f->handle, NULL );
+        x264_pthread_mutex_destroy( &f->mutex );
+        x264_pthread_cond_destroy( &f->cv );
+        x264_free( f->h->scratch_buffer );
+        x264_free( f->h );
+        x264_free( f );
+        h->thread[i]->filter_thread = NULL;
+    }
+}
+#else
+#define x264_filter_threads_init(h) 0
+#define x264_filter_threads_delete(h)
+#endif
+
+/* Hands the frame about to be encoded to the companion, which is idle between frames. */
+static void x264_filter_thread_start( x264_t *h )
+{
+    x264_filter_thread_t *f = h->filter_thread;
+    x264_t *t = f->h;
+    x264_pthread_mutex_lock( &f->mutex );
+    t->param = h->param;
+    t->sh    = h->sh;
+    t->fenc  = h->fenc;
+    t->fdec  = h->fdec;
+    t->i_ref[0] = h->i_ref[0];
+    t->i_ref[1] = h->i_ref[1];
+    memcpy( t->fref, h->fref, sizeof(h->fref) );
+    t->i_threadslice_start = h->i_threadslice_start;
+    t->i_threadslice_end   = h->i_threadslice_end;
+    /* Point the companion at this frame's mb arrays and deblock ref table. */
+    x264_macroblock_slice_init( t );
+    memset( &t->stat.frame, 0, sizeof(t->stat.frame) );
+    f->i_posted = f->i_filtered = h->i_threadslice_start;
+    x264_pthread_mutex_unlock( &f->mutex );
+}
+
+/* Waits for the companion to filter every row asked for and collects its quality stats. */
+static void x264_filter_thread_finish( x264_t *h )
+{
+    x264_filter_thread_t *f = h->filter_thread;
+    x264_pthread_mutex_lock( &f->mutex );
+    while( f->i_filtered != f->i_posted )
+        x264_pthread_cond_wait( &f->cv, &f->mutex );
+    x264_pthread_mutex_unlock( &f->mutex );
+    for( int i = 0; i < 3; i++ )
+        h->stat.frame.i_ssd[i] += f->h->stat.frame.i_ssd[i];
+    h->stat.frame.f_ssim += f->h->stat.frame.f_ssim;
+    h->stat.frame.i_ssim_cnt += f->h->stat.frame.i_ssim_cnt;
+    for( int i = 0; i < X264_STAGE_MAX; i++ )
+    {
+        h->i_stage_time[i] += f->h->i_stage_time[i];
+        f->h->i_stage_time[i] = 0;
+    }
+}
+
 /****************************************************************************
  *
  ****************************************************************************
@@ -484,12 +642,27 @@ static int x264_validate_parameters( x264_t *h, int b_open )
         if( h->param.b_sliced_threads )
         {
             int max_threads = (h->param.i_height+15)/16 / 4;
-            h->param.i_threads = X264_MIN( h->param.i_threads, max_threads );
+            int frames = x264_clip3( h->param.i_frame_threads, 1, h->param.i_threads );
+            int slices = X264_MIN( h->param.i_threads / frames, max_threads );
+            if( frames == 1 )
+                h->param.i_threads = slices;
+            else if( slices < 2 )
+            {
+                /* Not enough threads or rows to split each frame: plain frame threading. */
+                h->param.b_sliced_threads = 0;
+                h->param.i_threads = frames;
+            }
+            else
+                h->param.i_threads = frames * slices;
+            h->param.i_frame_threads = frames;
         }
     }
     else
         h->param.b_sliced_threads = 0;
-    h->i_thread_frames = h->param.b_sliced_threads ? 1 : h->param.i_threads;
+    if( !h->param.b_sliced_threads )
+        h->param.i_frame_threads = 0;
+    h->i_thread_frames = h->param.b_sliced_threads ? h->param.i_frame_threads : h->param.i_threads;
+    h->i_thread_slices = h->param.i_threads / h->i_thread_frames;
     if( h->i_thread_frames > 1 )
         h->param.nalu_process = NULL;
 
@@ -620,7 +793,7 @@ static int x264_validate_parameters( x264_t *h, int b_open )
 
     int max_slices = (h->param.i_height+((16<<PARAM_INTERLACED)-1))/(16<<PARAM_INTERLACED);
     if( h->param.b_sliced_threads )
-        h->param.i_slice_count = x264_clip3( h->param.i_threads, 0, max_slices );
+        h->param.i_slice_count = x264_clip3( h->i_thread_slices, 0, max_slices );
     else
     {
         h->param.i_slice_count = x264_clip3( h->param.i_slice_count, 0, max_slices );
@@ -718,9 +891,33 @@ static int x264_validate_parameters( x264_t *h, int b_open )
     h->param.i_sync_lookahead = X264_MIN( h->param.i_sync_lookahead, X264_LOOKAHEAD_MAX );
     if( h->param.rc.b_stat_read || h->i_thread_frames == 1 )
         h->param.i_sync_lookahead = 0;
+    if( h->param.i_lookahead_threads == X264_THREADS_AUTO )
+    {
+        /* With sliced threads the lookahead runs while every slice thread is idle;
+         * with frame threads it only has to keep pace with the frame threads. */
+        if( h->param.b_sliced_threads && h->i_thread_frames == 1 )
+            h->param.i_lookahead_threads = h->param.i_threads;
+        else
+            h->param.i_lookahead_threads = h->param.i_threads / 4;
+    }
+    /* Lookahead threads share the context that runs the lookahead, which frame
+     * threads only leave alone when the lookahead has a thread of its own. */
+    if( h->i_thread_frames > 1 && !h->param.i_sync_lookahead )
+        h->param.i_lookahead_threads = 1;
+    /* The lowres cost is a wavefront over lowres rows, so more threads than
+     * half the rows only adds synchronization. */
+    h->param.i_lookahead_threads = X264_MIN( h->param.i_lookahead_threads, (h->param.i_height+15)/16 / 2 );
+    h->param.i_lookahead_threads = x264_clip3( h->param.i_lookahead_threads, 1, X264_LOOKAHEAD_THREAD_MAX );
+    /* Sliced threads already filter each slice next to the others' encoding, and
+     * interlaced coding swaps the intra borders as part of the row filter. */
+    if( h->param.b_sliced_threads || h->param.b_interlaced )
+        h->param.b_filter_thread = 0;
 #else
     h->param.i_sync_lookahead = 0;
+    h->param.i_lookahead_threads = 1;
+    h->param.b_filter_thread = 0;
 #endif
+    h->param.i_huge_pages = x264_clip3( h->param.i_huge_pages, X264_HUGE_PAGES_NONE, X264_HUGE_PAGES_EXPLICIT );
 
     h->param.i_deblocking_filter_alphac0 = x264_clip3( h->param.i_deblocking_filter_alphac0, -6, 6 );
     h->param.i_deblocking_filter_beta    = x264_clip3( h->param.i_deblocking_filter_beta, -6, 6 );
@@ -922,6 +1119,7 @@ static int x264_validate_parameters( x264_t *h, int b_open )
     BOOLIFY( b_deblocking_filter );
     BOOLIFY( b_deterministic );
     BOOLIFY( b_sliced_threads );
+    BOOLIFY( b_filter_thread );
     BOOLIFY( b_interlaced );
     BOOLIFY( b_intra_refresh );
     BOOLIFY( b_visualize );
@@ -1150,9 +1348,12 @@ x264_t *x264_encoder_open( x264_param_t *param )
     h->frames.i_largest_pts = h->frames.i_second_largest_pts = -1;
     h->frames.i_poc_last_open_gop = -1;
 
+    if( h->param.b_numa && h->param.i_threads > 1 )
+        h->numa = x264_numa_init();
+
     CHECKED_MALLOCZERO( h->frames.unused[0], (h->frames.i_delay + 3) * sizeof(x264_frame_t *) );
-    /* Allocate room for max refs plus a few extra just in case. */
-    CHECKED_MALLOCZERO( h->frames.unused[1], (h->i_thread_frames + X264_REF_MAX + 4) * sizeof(x264_frame_t *) );
+    /* Allocate room for max refs plus a few extra just in case, on each node. */
+    CHECKED_MALLOCZERO( h->frames.unused[1], (h->i_thread_frames + X264_REF_MAX + 4) * x264_numa_nodes( h->numa ) * sizeof(x264_frame_t *) );
     CHECKED_MALLOCZERO( h->frames.current, (h->param.i_sync_lookahead + h->param.i_bframe
                         + h->i_thread_frames + 3) * sizeof(x264_frame_t *) );
     if( h->param.analyse.i_weighted_pred > 0 )
@@ -1248,25 +1449,60 @@ x264_t *x264_encoder_open( x264_param_t *param )
         x264_threadpool_init( &h->threadpool, h->param.i_threads, (void*)x264_encoder_thread_init, h ) )
         goto fail;
 
+    if( h->param.psz_trace )
+    {
+        /* fail now rather than after the whole encode */
+        FILE *f = fopen( h->param.psz_trace, "w" );
+        if( !f )
+        {
+            x264_log( h, X264_LOG_ERROR, "trace: can't write to %s\n", h->param.psz_trace );
+            goto fail;
+        }
+        fclose( f );
+        h->tracer = x264_trace_init();
+        if( !h->tracer || !(h->trace_api = x264_trace_track( h->tracer, "api" )) )
+            goto fail;
+    }
+
     h->thread[0] = h;
     for( int i = 1; i < h->param.i_threads + !!h->param.i_sync_lookahead; i++ )
         CHECKED_MALLOC( h->thread[i], sizeof(x264_t) );
 
+    /* The frame threads come first, followed by the other slice threads of each
+     * frame thread in turn.  Slice threads share their frame thread's fdec and
+     * macroblock cache. */
     for( int i = 0; i < h->param.i_threads; i++ )
     {
         int init_nal_count = h->param.i_slice_count + 3;
-        int allocate_threadlocal_data = !h->param.b_sliced_threads || !i;
+        int allocate_threadlocal_data = i < h->i_thread_frames;
+        int frame = allocate_threadlocal_data ? i : (i - h->i_thread_frames) / (h->i_thread_slices - 1);
+        int slice = allocate_threadlocal_data ? 0 : (i - h->i_thread_frames) % (h->i_thread_slices - 1) + 1;
         if( i > 0 )
-            *h->thread[i] = *h;
+            *h->thread[i] = allocate_threadlocal_data ? *h : *h->thread[frame];
+        /* Consecutive threads share a node, so do most frame threads and the ones they reference. */
+        if( h->numa )
+            h->thread[i]->i_numa_node = (frame * h->i_thread_slices + slice) * x264_numa_nodes( h->numa ) / h->param.i_threads;
+        if( h->tracer )
+        {
+            char name[48];
+            if( slice )
+                sprintf( name, "frame thread %d slice %d", frame, slice );
+            else
+                sprintf( name, "frame thread %d", frame );
+            if( !(h->thread[i]->trace = x264_trace_track( h->tracer, name )) )
+                goto fail;
+        }
 
         if( allocate_threadlocal_data )
         {
-            h->thread[i]->fdec = x264_frame_pop_unused( h, 1 );
+            for( int j = 0; j < h->i_thread_slices; j++ )
+                h->thread[i]->slice_thread[j] = j ? h->thread[h->i_thread_frames + i*(h->i_thread_slices-1) + j-1] : h->thread[i];
+            h->thread[i]->fdec = x264_frame_pop_unused( h->thread[i], 1 );
             if( !h->thread[i]->fdec )
                 goto fail;
         }
         else
-            h->thread[i]->fdec = h->thread[0]->fdec;
+            h->thread[i]->fdec = h->thread[frame]->fdec;
 
         CHECKED_MALLOC( h->thread[i]->out.p_bitstream, h->out.i_bitstream );
         /* Start each thread with room for init_nal_count NAL units; it'll realloc later if needed. */
@@ -1284,6 +1520,9 @@ x264_t *x264_encoder_open( x264_param_t *param )
         if( x264_macroblock_thread_allocate( h->thread[i], 0 ) < 0 )
             goto fail;
 
+    if( h->param.b_filter_thread && x264_filter_threads_init( h ) )
+        goto fail;
+
     if( x264_ratecontrol_new( h ) < 0 )
         goto fail;
 
@@ -1336,6 +1575,7 @@ x264_t *x264_encoder_open( x264_param_t *param )
 
     return h;
 fail:
+    x264_trace_delete( h->tracer );
     x264_free( h );
     return NULL;
 }
@@ -1824,6 +2064,11 @@ static inline void x264_reference_build_list( x264_t *h, int i_poc )
 static void x264_fdec_filter_row( x264_t *h, int mb_y, int b_inloop )
 {
     /* mb_y is the mb to be encoded next, not the mb to be filtered here */
+    if( h->filter_thread && b_inloop )
+    {
+        x264_filter_thread_post( h->filter_thread, mb_y );
+        return;
+    }
     int b_hpel = h->fdec->b_kept_as_ref;
     int b_deblock = h->sh.i_disable_deblocking_filter_idc != 1;
     int b_end = mb_y == h->i_threadslice_end;
@@ -1844,10 +2089,17 @@ static void x264_fdec_filter_row( x264_t *h, int mb_y, int b_inloop )
         return;
     if( min_y < h->i_threadslice_start )
         return;
-
-    if( b_deblock )
+    int64_t stage_start = x264_stage_start( h );
+
+    /* Rows away from the top and bottom of a progressive frame are deblocked and filtered
+     * in one pass over column tiles. */
+    int b_tiled = b_hpel && h->param.analyse.i_subpel_refine && !PARAM_INTERLACED
+                  && min_y > 0 && mb_y < h->mb.i_mb_height;
+    if( b_tiled )
+        x264_frame_deblock_filter_row( h, min_y, b_deblock );
+    else if( b_deblock )
         for( int y = min_y; y < mb_y; y += (1 << SLICE_MBAFF) )
-            x264_frame_deblock_row( h, y );
+            x264_frame_deblock_row( h, y, 0, h->mb.i_mb_width );
 
     /* FIXME: Prediction requires different borders for interlaced/progressive mc,
      * but the actual image data is equivalent. For now, maintain this
@@ -1859,7 +2111,7 @@ static void x264_fdec_filter_row( x264_t *h, int mb_y, int b_inloop )
                         h->fdec->plane[p]     + i*h->fdec->i_stride[p],
                         h->mb.i_mb_width*16*sizeof(pixel) );
 
-    if( b_hpel )
+    if( b_hpel && !b_tiled )
     {
         int end = mb_y == h->mb.i_mb_height;
         x264_frame_expand_border( h, h->fdec, min_y, end );
@@ -1877,8 +2129,17 @@ static void x264_fdec_filter_row( x264_t *h, int mb_y, int b_inloop )
             XCHG( pixel *, h->intra_border_backup[1][i], h->intra_border_backup[4][i] );
         }
 
+    /* With sliced threads only the first slice's rows are final as they finish;
+     * the rest of the frame is published once all of its slices are done. */
     if( h->i_thread_frames > 1 && h->fdec->b_kept_as_ref )
-        x264_frame_cond_broadcast( h->fdec, mb_y*16 + (b_end ? 10000 : -(X264_THREAD_HEIGHT << SLICE_MBAFF)) );
+    {
+        if( !h->param.b_sliced_threads )
+            x264_frame_cond_broadcast( h->fdec, mb_y*16 + (b_end ? 10000 : -(X264_THREAD_HEIGHT << SLICE_MBAFF)) );
+        else if( !h->i_threadslice_start && !b_end )
+            x264_frame_cond_broadcast( h->fdec, mb_y*16 - (X264_THREAD_HEIGHT << SLICE_MBAFF) );
+        if( h->trace && (!h->param.b_sliced_threads || (!h->i_threadslice_start && !b_end)) )
+            x264_trace_instant( h->trace, b_end ? "frame done" : "row", "row", mb_y );
+    }
 
     if( b_measure_quality )
     {
@@ -1918,6 +2179,7 @@ static void x264_fdec_filter_row( x264_t *h, int mb_y, int b_inloop )
             h->stat.frame.i_ssim_cnt += ssim_cnt;
         }
     }
+    x264_stage_end( h, X264_STAGE_FILTER, stage_start );
 }
 
 static inline int x264_reference_update( x264_t *h )
@@ -2165,11 +2427,14 @@ static int x264_slice_write( x264_t *h )
         else
             x264_macroblock_cache_load_progressive( h, i_mb_x, i_mb_y );
 
+        int64_t stage_start = x264_stage_start( h );
         x264_macroblock_analyse( h );
+        stage_start = x264_stage_end( h, X264_STAGE_ANALYSE, stage_start );
 
         /* encode this macroblock -> be careful it can change the mb type to P_SKIP if needed */
 reencode:
         x264_macroblock_encode( h );
+        stage_start = x264_stage_end( h, X264_STAGE_ENCODE, stage_start );
 
         if( h->param.b_cabac )
         {
@@ -2212,6 +2477,7 @@ reencode:
                 }
             }
         }
+        x264_stage_end( h, X264_STAGE_ENTROPY, stage_start );
 
         int total_bits = bs_pos(&h->out.bs) + x264_cabac_pos(&h->cabac);
         int mb_size = total_bits - mb_spos;
@@ -2351,7 +2617,9 @@ reencode:
         if( b_deblock )
             x264_macroblock_deblock_strength( h );
 
+        stage_start = x264_stage_start( h );
         x264_ratecontrol_mb( h, mb_size );
+        x264_stage_end( h, X264_STAGE_RATECONTROL, stage_start );
 
         if( mb_xy == h->sh.i_last_mb )
             break;
@@ -2430,6 +2698,12 @@ static void *x264_slices_write( x264_t *h )
 {
     int i_slice_num = 0;
     int last_thread_mb = h->sh.i_last_mb;
+    int64_t trace_start = h->trace ? x264_ndate() : 0;
+
+    /* Pool threads move to the node of the context they encode for; the first
+     * slice of sliced threads alone runs on the caller's thread. */
+    if( h->numa && (h->i_thread_frames > 1 || h != h->slice_thread[0]) )
+        x264_numa_pin_thread( h->numa, h->i_numa_node );
 
 #if HAVE_VISUALIZE
     if( h->param.b_visualize )
@@ -2440,6 +2714,8 @@ static void *x264_slices_write( x264_t *h )
     /* init stats */
     memset( &h->stat.frame, 0, sizeof(h->stat.frame) );
     h->mb.b_reencode_mb = 0;
+    if( h->filter_thread )
+        x264_filter_thread_start( h );
     while( h->sh.i_first_mb + SLICE_MBAFF*h->mb.i_mb_stride <= last_thread_mb )
     {
         h->sh.i_last_mb = last_thread_mb;
@@ -2467,13 +2743,20 @@ static void *x264_slices_write( x264_t *h )
         }
         h->sh.i_last_mb = X264_MIN( h->sh.i_last_mb, last_thread_mb );
         if( x264_stack_align( x264_slice_write, h ) )
+        {
+            if( h->filter_thread )
+                x264_filter_thread_finish( h );
             return (void *)-1;
+        }
         h->sh.i_first_mb = h->sh.i_last_mb + 1;
         // if i_first_mb is not the last mb in a row then go to the next mb in MBAFF order
         if( SLICE_MBAFF && h->sh.i_first_mb % h->mb.i_mb_width )
             h->sh.i_first_mb -= h->mb.i_mb_stride;
     }
 
+    if( h->filter_thread )
+        x264_filter_thread_finish( h );
+
 #if HAVE_VISUALIZE
     if( h->param.b_visualize )
     {
@@ -2482,57 +2765,88 @@ static void *x264_slices_write( x264_t *h )
     }
 #endif
 
+    if( h->trace )
+        x264_trace_complete( h->trace, h->param.b_sliced_threads ? "slice" : "frame",
+                             trace_start, x264_ndate(), "frame", h->fenc->i_frame );
     return (void *)0;
 }
 
-static int x264_threaded_slices_write( x264_t *h )
+/* Encodes h's frame split between its slice threads.  With frame threads as
+ * well this runs as the frame thread's job, encoding the first slice itself. */
+static void *x264_threaded_slices_write( x264_t *h )
 {
+    int64_t trace_start = h->trace ? x264_ndate() : 0;
+    if( h->numa && h->i_thread_frames > 1 )
+        x264_numa_pin_thread( h->numa, h->i_numa_node );
+
     /* set first/last mb and sync contexts */
-    for( int i = 0; i < h->param.i_threads; i++ )
+    for( int i = 0; i < h->i_thread_slices; i++ )
     {
-        x264_t *t = h->thread[i];
+        x264_t *t = h->slice_thread[i];
         if( i )
         {
             t->param = h->param;
             memcpy( &t->i_frame, &h->i_frame, offsetof(x264_t, rc) - offsetof(x264_t, i_frame) );
         }
         int height = h->mb.i_mb_height >> PARAM_INTERLACED;
-        t->i_threadslice_start = ((height *  i    + h->param.i_slice_count/2) / h->param.i_threads) << PARAM_INTERLACED;
-        t->i_threadslice_end   = ((height * (i+1) + h->param.i_slice_count/2) / h->param.i_threads) << PARAM_INTERLACED;
+        t->i_threadslice_start = ((height *  i    + h->param.i_slice_count/2) / h->i_thread_slices) << PARAM_INTERLACED;
+        t->i_threadslice_end   = ((height * (i+1) + h->param.i_slice_count/2) / h->i_thread_slices) << PARAM_INTERLACED;
         t->sh.i_first_mb = t->i_threadslice_start * h->mb.i_mb_width;
         t->sh.i_last_mb  =   t->i_threadslice_end * h->mb.i_mb_width - 1;
     }
 
+    /* Every slice reads the weighted references, so they're needed in full. */
+    if( h->i_thread_frames > 1 )
+        for( int j = 0; j < h->i_ref[0]; j++ )
+            if( h->sh.weight[j][0].weightfn )
+            {
+                int64_t wait = x264_frame_cond_wait( h->fref[0][j]->orig, h->mb.i_mb_height*16 + 16 );
+                h->i_ref_wait_time += wait;
+                h->i_stage_time[X264_STAGE_WAIT] += wait * 1000;
+                if( h->trace && wait )
+                {
+                    int64_t end = x264_ndate();
+                    x264_trace_complete( h->trace, "wait ref", end - wait*1000, end, "frame", h->fref[0][j]->i_frame );
+                }
+            }
     x264_stack_align( x264_analyse_weight_frame, h, h->mb.i_mb_height*16 + 16 );
 
     x264_threads_distribute_ratecontrol( h );
 
     /* dispatch */
-    for( int i = 0; i < h->param.i_threads; i++ )
+    for( int i = 1; i < h->i_thread_slices; i++ )
     {
-        x264_threadpool_run( h->threadpool, (void*)x264_slices_write, h->thread[i] );
-        h->thread[i]->b_thread_active = 1;
+        x264_threadpool_run( h->threadpool, (void*)x264_slices_write, h->slice_thread[i] );
+        h->slice_thread[i]->b_thread_active = 1;
     }
-    for( int i = 0; i < h->param.i_threads; i++ )
+    void *ret = x264_slices_write( h );
+    for( int i = 1; i < h->i_thread_slices; i++ )
     {
-        h->thread[i]->b_thread_active = 0;
-        if( (intptr_t)x264_threadpool_wait( h->threadpool, h->thread[i] ) )
-            return -1;
+        x264_t *t = h->slice_thread[i];
+        t->b_thread_active = 0;
+        if( (intptr_t)x264_threadpool_wait( h->threadpool, t ) )
+            ret = (void *)-1;
+        h->i_ref_wait_time += t->i_ref_wait_time;
+        t->i_ref_wait_time = 0;
     }
+    if( ret )
+        return ret;
 
     /* Go back and fix up the hpel on the borders between slices. */
-    for( int i = 1; i < h->param.i_threads; i++ )
+    for( int i = 1; i < h->i_thread_slices; i++ )
     {
-        x264_fdec_filter_row( h->thread[i], h->thread[i]->i_threadslice_start + 1, 0 );
+        x264_fdec_filter_row( h->slice_thread[i], h->slice_thread[i]->i_threadslice_start + 1, 0 );
         if( SLICE_MBAFF )
-            x264_fdec_filter_row( h->thread[i], h->thread[i]->i_threadslice_start + 2, 0 );
+            x264_fdec_filter_row( h->slice_thread[i], h->slice_thread[i]->i_threadslice_start + 2, 0 );
     }
+    if( h->i_thread_frames > 1 && h->fdec->b_kept_as_ref )
+        x264_frame_cond_broadcast( h->fdec, h->mb.i_mb_height*16 + 10000 );
 
     x264_threads_merge_ratecontrol( h );
 
-    for( int i = 1; i < h->param.i_threads; i++ )
+    for( int i = 1; i < h->i_thread_slices; i++ )
     {
-        x264_t *t = h->thread[i];
+        x264_t *t = h->slice_thread[i];
         for( int j = 0; j < t->out.i_nal; j++ )
         {
             h->out.nal[h->out.i_nal] = t->out.nal[j];
@@ -2548,7 +2862,9 @@ static int x264_threaded_slices_write( x264_t *h )
         h->stat.frame.i_ssim_cnt += t->stat.frame.i_ssim_cnt;
     }
 
-    return 0;
+    if( h->trace )
+        x264_trace_complete( h->trace, "frame", trace_start, x264_ndate(), "frame", h->fenc->i_frame );
+    return (void *)0;
 }
 
 void x264_encoder_intra_refresh( x264_t *h )
@@ -2706,10 +3022,8 @@ int     x264_encoder_encode( x264_t *h,
     else
     {
         /* signal kills for lookahead thread */
-        x264_pthread_mutex_lock( &h->lookahead->ifbuf.mutex );
         h->lookahead->b_exit_thread = 1;
-        x264_pthread_cond_broadcast( &h->lookahead->ifbuf.cv_fill );
-        x264_pthread_mutex_unlock( &h->lookahead->ifbuf.mutex );
+        x264_sync_frame_ring_close( &h->lookahead->ifbuf );
     }
 
     h->i_frame++;
@@ -2831,10 +3145,11 @@ int     x264_encoder_encode( x264_t *h,
     /* Init bitstream context */
     if( h->param.b_sliced_threads )
     {
-        for( int i = 0; i < h->param.i_threads; i++ )
+        for( int i = 0; i < h->i_thread_slices; i++ )
         {
-            bs_init( &h->thread[i]->out.bs, h->thread[i]->out.p_bitstream, h->thread[i]->out.i_bitstream );
-            h->thread[i]->out.i_nal = 0;
+            x264_t *t = h->slice_thread[i];
+            bs_init( &t->out.bs, t->out.p_bitstream, t->out.i_bitstream );
+            t->out.i_nal = 0;
         }
     }
     else
@@ -3007,8 +3322,10 @@ int     x264_encoder_encode( x264_t *h,
 
     /* Init the rate control */
     /* FIXME: Include slice header bit cost. */
+    int64_t stage_start = x264_stage_start( h );
     x264_ratecontrol_start( h, h->fenc->i_qpplus1, overhead*8 );
     i_global_qp = x264_ratecontrol_qp( h );
+    x264_stage_end( h, X264_STAGE_RATECONTROL, stage_start );
 
     pic_out->i_qpplus1 =
     h->fdec->i_qpplus1 = i_global_qp + 1;
@@ -3039,12 +3356,12 @@ int     x264_encoder_encode( x264_t *h,
     h->i_threadslice_end = h->mb.i_mb_height;
     if( h->i_thread_frames > 1 )
     {
-        x264_threadpool_run( h->threadpool, (void*)x264_slices_write, h );
+        x264_threadpool_run( h->threadpool, (void*)(h->param.b_sliced_threads ? x264_threaded_slices_write : x264_slices_write), h );
         h->b_thread_active = 1;
     }
     else if( h->param.b_sliced_threads )
     {
-        if( x264_threaded_slices_write( h ) )
+        if( (intptr_t)x264_threaded_slices_write( h ) )
             return -1;
     }
     else
@@ -3062,9 +3379,12 @@ static int x264_encoder_frame_end( x264_t *h, x264_t *thread_current,
 
     if( h->b_thread_active )
     {
+        int64_t trace_start = h->trace_api ? x264_ndate() : 0;
         h->b_thread_active = 0;
         if( (intptr_t)x264_threadpool_wait( h->threadpool, h ) )
             return -1;
+        if( h->trace_api )
+            x264_trace_complete( h->trace_api, "wait frame", trace_start, x264_ndate(), "frame", h->fenc->i_frame );
     }
     if( !h->out.i_nal )
     {
@@ -3119,14 +3439,20 @@ static int x264_encoder_frame_end( x264_t *h, x264_t *thread_current,
         pic_out->img.plane[i] = (uint8_t*)h->fdec->plane[i];
     }
 
+    /* The lookahead's time on this frame travels with it. */
+    for( int i = 0; i < X264_STAGE_MAX; i++ )
+        h->i_stage_time[i] += h->fenc->i_stage_time[i];
+
     x264_frame_push_unused( thread_current, h->fenc );
 
     /* ---------------------- Update encoder state ------------------------- */
 
     /* update rc */
     int filler = 0;
+    int64_t stage_start = x264_stage_start( h );
     if( x264_ratecontrol_end( h, frame_size * 8, &filler ) < 0 )
         return -1;
+    x264_stage_end( h, X264_STAGE_RATECONTROL, stage_start );
 
     pic_out->hrd_timing = h->fenc->hrd_timing;
 
@@ -3169,6 +3495,14 @@ static int x264_encoder_frame_end( x264_t *h, x264_t *thread_current,
     h->stat.i_frame_count[h->sh.i_type]++;
     h->stat.i_frame_size[h->sh.i_type] += frame_size;
     h->stat.f_frame_qp[h->sh.i_type] += h->fdec->f_qp_avg_aq;
+    h->stat.f_last_qp = h->fdec->f_qp_avg_aq;
+    if( h->param.b_stage_timing )
+        for( int i = 0; i < h->i_thread_slices; i++ )
+            for( int j = 0; j < X264_STAGE_MAX; j++ )
+            {
+                h->stat.i_stage_time[h->sh.i_type][j] += h->slice_thread[i]->i_stage_time[j];
+                h->slice_thread[i]->i_stage_time[j] = 0;
+            }
 
     for( int i = 0; i < X264_MBTYPE_MAX; i++ )
         h->stat.i_mb_count[h->sh.i_type][i] += h->stat.frame.i_mb_count[i];
@@ -3322,6 +3656,13 @@ void    x264_encoder_close  ( x264_t *h )
 
     if( h->param.i_threads > 1 )
         x264_threadpool_delete( h->threadpool );
+    x264_filter_threads_delete( h );
+    if( h->tracer )
+    {
+        if( x264_trace_write( h->tracer, h->param.psz_trace ) < 0 )
+            x264_log( h, X264_LOG_ERROR, "trace: can't write to %s\n", h->param.psz_trace );
+        x264_trace_delete( h->tracer );
+    }
     if( h->i_thread_frames > 1 )
     {
         for( int i = 0; i < h->i_thread_frames; i++ )
@@ -3601,6 +3942,53 @@ void    x264_encoder_close  ( x264_t *h )
             x264_log( h, X264_LOG_INFO, "kb/s:%.2f\n", f_bitrate );
     }
 
+    if( h->i_thread_frames > 1 )
+    {
+        char *p = buf;
+        for( int i = 0; i < h->i_thread_frames && p < buf + sizeof(buf) - 16; i++ )
+            p += sprintf( p, " %.2fs", h->thread[i]->i_ref_wait_time / 1000000.0 );
+        x264_log( h, X264_LOG_INFO, "time waiting for reference rows per thread:%s\n", buf );
+    }
+
+    if( h->param.b_stage_timing )
+    {
+        int64_t stage_total[X264_STAGE_MAX] = {0};
+        int64_t total = 0;
+        for( int i = 0; i < 3; i++ )
+        {
+            static const uint8_t slice_order[] = { SLICE_TYPE_I, SLICE_TYPE_P, SLICE_TYPE_B };
+            int i_slice = slice_order[i];
+            int i_count = h->stat.i_frame_count[i_slice];
+            if( !i_count )
+                continue;
+            char *p = buf;
+            for( int j = 0; j < X264_STAGE_MAX; j++ )
+            {
+                p += sprintf( p, " %s:%.2f", x264_stage_names[j], h->stat.i_stage_time[i_slice][j] / 1000000.0 / i_count );
+                stage_total[j] += h->stat.i_stage_time[i_slice][j];
+                total += h->stat.i_stage_time[i_slice][j];
+            }
+            x264_log( h, X264_LOG_INFO, "stage ms per frame %c:%s\n", slice_type_to_char[i_slice], buf );
+        }
+        if( total )
+        {
+            char *p = buf;
+            for( int j = 0; j < X264_STAGE_MAX; j++ )
+                p += sprintf( p, " %s:%.1f%%", x264_stage_names[j], stage_total[j] * 100.0 / total );
+            x264_log( h, X264_LOG_INFO, "stage time %.2fs:%s\n", total / 1000000000.0, buf );
+        }
+    }
+
+    if( h->numa )
+        for( int node = 0; node < x264_numa_nodes( h->numa ); node++ )
+        {
+            int threads = 0;
+            for( int i = 0; i < h->param.i_threads; i++ )
+                threads += h->thread[i]->i_numa_node == node;
+            x264_log( h, X264_LOG_INFO, "numa node %d: %d threads, %.1f MB of frames\n", node, threads,
+                      x264_numa_memory( h->numa, node ) / 1048576.0 );
+        }
+
     /* rc */
     x264_ratecontrol_delete( h );
 
@@ -3624,6 +4012,7 @@ void    x264_encoder_close  ( x264_t *h )
     x264_frame_delete_list( h->frames.blank_unused );
 
     h = h->thread[0];
+    x264_numa_delete( h->numa );
 
     for( int i = 0; i < h->i_thread_frames; i++ )
         if( h->thread[i]->b_thread_active )
@@ -3635,7 +4024,7 @@ void    x264_encoder_close  ( x264_t *h )
     {
         x264_frame_t **frame;
 
-        if( !h->param.b_sliced_threads || i == 0 )
+        if( i < h->i_thread_frames )
         {
             for( frame = h->thread[i]->frames.reference; *frame; frame++ )
             {
@@ -3672,13 +4061,7 @@ int x264_encoder_delayed_frames( x264_t *h )
     }
     for( int i = 0; h->frames.current[i]; i++ )
         delayed_frames++;
-    x264_pthread_mutex_lock( &h->lookahead->ofbuf.mutex );
-    x264_pthread_mutex_lock( &h->lookahead->ifbuf.mutex );
-    x264_pthread_mutex_lock( &h->lookahead->next.mutex );
-    delayed_frames += h->lookahead->ifbuf.i_size + h->lookahead->next.i_size + h->lookahead->ofbuf.i_size;
-    x264_pthread_mutex_unlock( &h->lookahead->next.mutex );
-    x264_pthread_mutex_unlock( &h->lookahead->ifbuf.mutex );
-    x264_pthread_mutex_unlock( &h->lookahead->ofbuf.mutex );
+    delayed_frames += h->lookahead->i_frames;
     return delayed_frames;
 }
 
@@ -3686,3 +4069,33 @@ int x264_encoder_maximum_delayed_frames( x264_t *h )
 {
     return h->frames.i_delay;
 }
+
+/****************************************************************************
+ * x264_encoder_stats:
+ ****************************************************************************/
+void x264_encoder_stats( x264_t *h, x264_stats_t *stats )
+{
+    for( int i = 0; i < 3; i++ )
+    {
+        stats->i_frames[i] = h->stat.i_frame_count[i];
+        stats->i_bytes[i] = h->stat.i_frame_size[i];
+        for( int j = 0; j < X264_STAGE_MAX; j++ )
+            stats->i_stage_time[i][j] = h->stat.i_stage_time[i][j];
+    }
+    stats->f_qp = h->stat.f_last_qp;
+    stats->f_vbv_fullness = x264_ratecontrol_vbv_fullness( h );
+    stats->i_lookahead_frames = h->lookahead->i_frames;
+}
+
+/****************************************************************************
+ * x264_encoder_trace:
+ ****************************************************************************/
+void x264_encoder_trace( x264_t *h, const char *name, int b_end )
+{
+    if( !h->trace_api )
+        return;
+    if( !b_end )
+        h->i_trace_api_start = x264_ndate();
+    else
+        x264_trace_complete( h->trace_api, name, h->i_trace_api_start, x264_ndate(), NULL, 0 );
+}
@@ -39,23 +39,6 @@
 #include "common/common.h"
 #include "analyse.h"
 
-static void x264_lookahead_shift( x264_sync_frame_list_t *dst, x264_sync_frame_list_t *src, int count )
-{
-    int i = count;
-    while( i-- )
-    {
-        assert( dst->i_size < dst->i_max_size );
-        assert( src->i_size );
-        dst->list[ dst->i_size++ ] = x264_frame_shift( src->list );
-        src->i_size--;
-    }
-    if( count )
-    {
-        x264_pthread_cond_broadcast( &dst->cv_fill );
-        x264_pthread_cond_broadcast( &src->cv_empty );
-    }
-}
-
 static void x264_lookahead_update_last_nonb( x264_t *h, x264_frame_t *new_nonb )
 {
     if( h->lookahead->last_nonb )
@@ -64,68 +47,151 @@ static void x264_lookahead_update_last_nonb( x264_t *h, x264_frame_t *new_nonb )
     new_nonb->i_reference_count++;
 }
 
-#if HAVE_THREAD
-static void x264_lookahead_slicetype_decide( x264_t *h )
+/* Takes the next decided minigop off the decision queue and hands it to the encoder. */
+static void x264_lookahead_output( x264_t *h )
 {
-    x264_stack_align( x264_slicetype_decide, h );
+    x264_lookahead_t *look = h->lookahead;
+    x264_frame_t *frames[X264_BFRAME_MAX+1];
+    int count = look->next.list[0]->i_bframes + 1;
 
-    x264_lookahead_update_last_nonb( h, h->lookahead->next.list[0] );
+    x264_lookahead_update_last_nonb( h, look->next.list[0] );
+    for( int i = 0; i < count; i++ )
+        frames[i] = x264_frame_shift( look->next.list );
+    look->next.i_size -= count;
 
-    x264_pthread_mutex_lock( &h->lookahead->ofbuf.mutex );
-    while( h->lookahead->ofbuf.i_size == h->lookahead->ofbuf.i_max_size )
-        x264_pthread_cond_wait( &h->lookahead->ofbuf.cv_empty, &h->lookahead->ofbuf.mutex );
+    /* For MB-tree and VBV lookahead, we have to perform propagation analysis on I-frames too.
+     * Do it before the frames are visible to the encoder. */
+    if( look->b_analyse_keyframe && IS_X264_TYPE_I( look->last_nonb->i_type ) )
+    {
+        int64_t stage_start = x264_stage_start( h );
+        int64_t mbtree_start = h->i_stage_time[X264_STAGE_MBTREE];
+        x264_stack_align( x264_slicetype_analyse, h, 1 );
+        x264_slicetype_stage_time( h, &look->last_nonb, 1, stage_start, mbtree_start );
+    }
 
-    x264_pthread_mutex_lock( &h->lookahead->next.mutex );
-    x264_lookahead_shift( &h->lookahead->ofbuf, &h->lookahead->next, h->lookahead->next.list[0]->i_bframes + 1 );
-    x264_pthread_mutex_unlock( &h->lookahead->next.mutex );
+    x264_sync_frame_ring_push( &look->ofbuf, frames, count );
+}
 
-    /* For MB-tree and VBV lookahead, we have to perform propagation analysis on I-frames too. */
-    if( h->lookahead->b_analyse_keyframe && IS_X264_TYPE_I( h->lookahead->last_nonb->i_type ) )
-        x264_stack_align( x264_slicetype_analyse, h, 1 );
+/* Decides the next minigop and hands it on, recording the batch on trace. */
+static void x264_lookahead_slicetype_decide( x264_t *h, x264_trace_track_t *trace )
+{
+    int64_t trace_start = trace ? x264_ndate() : 0;
+    int frames = h->lookahead->next.i_size;
+    x264_stack_align( x264_slicetype_decide, h );
+    x264_lookahead_output( h );
+    if( trace )
+    {
+        x264_trace_complete( trace, "lookahead", trace_start, x264_ndate(), "frames", frames - h->lookahead->next.i_size );
+        x264_trace_counter( trace, "lookahead depth", "frames", h->lookahead->next.i_size );
+    }
+}
+
+#if HAVE_THREAD
 
-    x264_pthread_mutex_unlock( &h->lookahead->ofbuf.mutex );
+/* Moves as many input frames to the decision queue as fit. */
+static void x264_lookahead_input( x264_lookahead_t *look )
+{
+    look->next.i_size += x264_sync_frame_ring_pop( &look->ifbuf, look->next.list + look->next.i_size,
+                                                   look->next.i_max_size - look->next.i_size );
 }
 
-static void x264_lookahead_thread( x264_t *h )
+static void x264_lookahead_thread_init( x264_t *h )
 {
-    int shift;
 #if HAVE_MMX
+    /* Misalign mask has to be set separately for each thread. */
     if( h->param.cpu&X264_CPU_SSE_MISALIGN )
         x264_cpu_mask_misalign_sse();
 #endif
-    while( !h->lookahead->b_exit_thread )
+    if( h->numa )
+        x264_numa_pin_thread( h->numa, h->i_numa_node );
+}
+
+static void x264_lookahead_thread( x264_t *h )
+{
+    x264_lookahead_t *look = h->lookahead;
+    x264_lookahead_thread_init( h );
+    while( !look->b_exit_thread )
     {
-        x264_pthread_mutex_lock( &h->lookahead->ifbuf.mutex );
-        x264_pthread_mutex_lock( &h->lookahead->next.mutex );
-        shift = X264_MIN( h->lookahead->next.i_max_size - h->lookahead->next.i_size, h->lookahead->ifbuf.i_size );
-        x264_lookahead_shift( &h->lookahead->next, &h->lookahead->ifbuf, shift );
-        x264_pthread_mutex_unlock( &h->lookahead->next.mutex );
-        if( h->lookahead->next.i_size <= h->lookahead->i_slicetype_length + h->param.b_vfr_input )
-        {
-            while( !h->lookahead->ifbuf.i_size && !h->lookahead->b_exit_thread )
-                x264_pthread_cond_wait( &h->lookahead->ifbuf.cv_fill, &h->lookahead->ifbuf.mutex );
-            x264_pthread_mutex_unlock( &h->lookahead->ifbuf.mutex );
-        }
+        x264_lookahead_input( look );
+        if( look->next.i_size <= look->i_slicetype_length + h->param.b_vfr_input )
+            x264_sync_frame_ring_wait( &look->ifbuf );
         else
-        {
-            x264_pthread_mutex_unlock( &h->lookahead->ifbuf.mutex );
-            x264_lookahead_slicetype_decide( h );
-        }
+            x264_lookahead_slicetype_decide( h, h->trace );
     }   /* end of input frames */
-    x264_pthread_mutex_lock( &h->lookahead->ifbuf.mutex );
-    x264_pthread_mutex_lock( &h->lookahead->next.mutex );
-    x264_lookahead_shift( &h->lookahead->next, &h->lookahead->ifbuf, h->lookahead->ifbuf.i_size );
-    x264_pthread_mutex_unlock( &h->lookahead->next.mutex );
-    x264_pthread_mutex_unlock( &h->lookahead->ifbuf.mutex );
-    while( h->lookahead->next.i_size )
-        x264_lookahead_slicetype_decide( h );
-    x264_pthread_mutex_lock( &h->lookahead->ofbuf.mutex );
-    h->lookahead->b_thread_active = 0;
-    x264_pthread_cond_broadcast( &h->lookahead->ofbuf.cv_fill );
-    x264_pthread_mutex_unlock( &h->lookahead->ofbuf.mutex );
+    x264_lookahead_input( look );
+    while( look->next.i_size )
+    {
+        x264_lookahead_slicetype_decide( h, h->trace );
+        x264_lookahead_input( look );
+    }
+    look->b_thread_active = 0;
+    x264_sync_frame_ring_close( &look->ofbuf );
 }
 #endif
 
+/* Give the context that runs slicetype analysis its own copies for the lowres
+ * cost threads. The first thread's rows are done by that context itself. */
+static int x264_lookahead_threads_init( x264_t *h )
+{
+#if HAVE_THREAD
+    x264_lookahead_t *look = h->lookahead;
+    if( h->param.i_lookahead_threads <= 1 )
+        return 0;
+
+    CHECKED_MALLOC( look->row_progress, h->mb.i_mb_height * sizeof(int) );
+    if( x264_pthread_mutex_init( &look->row_mutex, NULL ) ||
+        x264_pthread_cond_init( &look->row_cv, NULL ) )
+        goto fail;
+    for( int i = 1; i < h->param.i_lookahead_threads; i++ )
+    {
+        x264_t *t;
+        CHECKED_MALLOC( t, sizeof(x264_t) );
+        *t = *h;
+        t->trace = NULL;
+        h->lookahead_thread[i] = t;
+        /* Lookahead weightp scales a lowres reference plane into the first weight buffer. */
+        memset( t->mb.p_weight_buf, 0, sizeof(t->mb.p_weight_buf) );
+        if( h->param.analyse.i_weighted_pred )
+        {
+            int i_padv = PADV << PARAM_INTERLACED;
+            CHECKED_MALLOC( t->mb.p_weight_buf[0], h->fdec->i_stride_lowres * (h->mb.i_mb_height*8+2*i_padv) * sizeof(pixel) );
+        }
+        /* MB-tree propagation writes a row of costs into the scratch buffer. */
+        t->scratch_buffer = NULL;
+        if( h->param.rc.b_mb_tree )
+            CHECKED_MALLOC( t->scratch_buffer, ((h->mb.i_mb_width+7)&~7) * sizeof(int) );
+    }
+    /* Each thread but the first sums what it propagates into both references separately. */
+    if( h->param.rc.b_mb_tree )
+        CHECKED_MALLOC( look->propagate_sums, (h->param.i_lookahead_threads - 1) * 2 * h->mb.i_mb_count * sizeof(uint16_t) );
+    if( x264_threadpool_init( &h->lookaheadpool, h->param.i_lookahead_threads - 1,
+                              (void*)x264_lookahead_thread_init, h ) )
+        goto fail;
+    return 0;
+fail:
+    return -1;
+#else
+    return 0;
+#endif
+}
+
+static void x264_lookahead_threads_delete( x264_t *h )
+{
+    if( !h->lookaheadpool )
+        return;
+    x264_threadpool_delete( h->lookaheadpool );
+    for( int i = 1; i < h->param.i_lookahead_threads; i++ )
+    {
+        x264_free( h->lookahead_thread[i]->mb.p_weight_buf[0] );
+        x264_free( h->lookahead_thread[i]->scratch_buffer );
+        x264_free( h->lookahead_thread[i] );
+    }
+    x264_pthread_mutex_destroy( &h->lookahead->row_mutex );
+    x264_pthread_cond_destroy( &h->lookahead->row_cv );
+    x264_free( h->lookahead->row_progress );
+    x264_free( h->lookahead->propagate_sums );
+}
+
 int x264_lookahead_init( x264_t *h, int i_slicetype_length )
 {
     x264_lookahead_t *look;
@@ -139,22 +205,27 @@ int x264_lookahead_init( x264_t *h, int i_slicetype_length )
     look->i_slicetype_length = i_slicetype_length;
 
     /* init frame lists */
-    if( x264_sync_frame_list_init( &look->ifbuf, h->param.i_sync_lookahead+3 ) ||
+    if( x264_sync_frame_ring_init( &look->ifbuf, h->param.i_sync_lookahead+3 ) ||
         x264_sync_frame_list_init( &look->next, h->frames.i_delay+3 ) ||
-        x264_sync_frame_list_init( &look->ofbuf, h->frames.i_delay+3 ) )
+        x264_sync_frame_ring_init( &look->ofbuf, h->frames.i_delay+3 ) )
         goto fail;
 
     if( !h->param.i_sync_lookahead )
-        return 0;
+        return x264_lookahead_threads_init( h );
 
     x264_t *look_h = h->thread[h->param.i_threads];
     *look_h = *h;
+    if( h->tracer && !(look_h->trace = x264_trace_track( h->tracer, "lookahead" )) )
+        goto fail;
     if( x264_macroblock_cache_allocate( look_h ) )
         goto fail;
 
     if( x264_macroblock_thread_allocate( look_h, 1 ) < 0 )
         goto fail;
 
+    if( x264_lookahead_threads_init( look_h ) )
+        goto fail;
+
     if( x264_pthread_create( &look->thread_handle, NULL, (void*)x264_lookahead_thread, look_h ) )
         goto fail;
     look->b_thread_active = 1;
@@ -169,63 +240,59 @@ void x264_lookahead_delete( x264_t *h )
 {
     if( h->param.i_sync_lookahead )
     {
-        x264_pthread_mutex_lock( &h->lookahead->ifbuf.mutex );
         h->lookahead->b_exit_thread = 1;
-        x264_pthread_cond_broadcast( &h->lookahead->ifbuf.cv_fill );
-        x264_pthread_mutex_unlock( &h->lookahead->ifbuf.mutex );
+        x264_sync_frame_ring_close( &h->lookahead->ifbuf );
         x264_pthread_join( h->lookahead->thread_handle, NULL );
+        x264_lookahead_threads_delete( h->thread[h->param.i_threads] );
         x264_macroblock_cache_free( h->thread[h->param.i_threads] );
         x264_macroblock_thread_free( h->thread[h->param.i_threads], 1 );
         x264_free( h->thread[h->param.i_threads] );
     }
-    x264_sync_frame_list_delete( &h->lookahead->ifbuf );
+    else
+        x264_lookahead_threads_delete( h );
+    x264_sync_frame_ring_delete( &h->lookahead->ifbuf );
     x264_sync_frame_list_delete( &h->lookahead->next );
     if( h->lookahead->last_nonb )
         x264_frame_push_unused( h, h->lookahead->last_nonb );
-    x264_sync_frame_list_delete( &h->lookahead->ofbuf );
+    x264_sync_frame_ring_delete( &h->lookahead->ofbuf );
     x264_free( h->lookahead );
 }
 
 void x264_lookahead_put_frame( x264_t *h, x264_frame_t *frame )
 {
+    h->lookahead->i_frames++;
     if( h->param.i_sync_lookahead )
-        x264_sync_frame_list_push( &h->lookahead->ifbuf, frame );
+        x264_sync_frame_ring_push( &h->lookahead->ifbuf, &frame, 1 );
     else
         x264_sync_frame_list_push( &h->lookahead->next, frame );
 }
 
 int x264_lookahead_is_empty( x264_t *h )
 {
-    x264_pthread_mutex_lock( &h->lookahead->ofbuf.mutex );
-    x264_pthread_mutex_lock( &h->lookahead->next.mutex );
-    int b_empty = !h->lookahead->next.i_size && !h->lookahead->ofbuf.i_size;
-    x264_pthread_mutex_unlock( &h->lookahead->next.mutex );
-    x264_pthread_mutex_unlock( &h->lookahead->ofbuf.mutex );
-    return b_empty;
+    return !h->lookahead->i_frames;
 }
 
 static void x264_lookahead_encoder_shift( x264_t *h )
 {
-    if( !h->lookahead->ofbuf.i_size )
+    x264_frame_t *frames[X264_BFRAME_MAX+1];
+    x264_frame_t *frame = x264_sync_frame_ring_peek( &h->lookahead->ofbuf );
+    if( !frame )
         return;
-    int i_frames = h->lookahead->ofbuf.list[0]->i_bframes + 1;
-    while( i_frames-- )
-    {
-        x264_frame_push( h->frames.current, x264_frame_shift( h->lookahead->ofbuf.list ) );
-        h->lookahead->ofbuf.i_size--;
-    }
-    x264_pthread_cond_broadcast( &h->lookahead->ofbuf.cv_empty );
+    int i_frames = x264_sync_frame_ring_pop( &h->lookahead->ofbuf, frames, frame->i_bframes + 1 );
+    for( int i = 0; i < i_frames; i++ )
+        x264_frame_push( h->frames.current, frames[i] );
+    h->lookahead->i_frames -= i_frames;
 }
 
 void x264_lookahead_get_frames( x264_t *h )
 {
     if( h->param.i_sync_lookahead )
     {   /* We have a lookahead thread, so get frames from there */
-        x264_pthread_mutex_lock( &h->lookahead->ofbuf.mutex );
-        while( !h->lookahead->ofbuf.i_size && h->lookahead->b_thread_active )
-            x264_pthread_cond_wait( &h->lookahead->ofbuf.cv_fill, &h->lookahead->ofbuf.mutex );
+        int64_t trace_start = h->trace_api ? x264_ndate() : 0;
+        x264_sync_frame_ring_wait( &h->lookahead->ofbuf );
+        if( h->trace_api )
+            x264_trace_complete( h->trace_api, "wait lookahead", trace_start, x264_ndate(), NULL, 0 );
         x264_lookahead_encoder_shift( h );
-        x264_pthread_mutex_unlock( &h->lookahead->ofbuf.mutex );
     }
     else
     {   /* We are not running a lookahead thread, so perform all the slicetype decide on the fly */
@@ -233,14 +300,7 @@ void x264_lookahead_get_frames( x264_t *h )
         if( h->frames.current[0] || !h->lookahead->next.i_size )
             return;
 
-        x264_stack_align( x264_slicetype_decide, h );
-        x264_lookahead_update_last_nonb( h, h->lookahead->next.list[0] );
-        x264_lookahead_shift( &h->lookahead->ofbuf, &h->lookahead->next, h->lookahead->next.list[0]->i_bframes + 1 );
-
-        /* For MB-tree and VBV lookahead, we have to perform propagation analysis on I-frames too. */
-        if( h->lookahead->b_analyse_keyframe && IS_X264_TYPE_I( h->lookahead->last_nonb->i_type ) )
-            x264_stack_align( x264_slicetype_analyse, h, 1 );
-
+        x264_lookahead_slicetype_decide( h, h->trace_api );
         x264_lookahead_encoder_shift( h );
     }
 }
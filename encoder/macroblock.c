@@ -812,15 +812,16 @@ static ALWAYS_INLINE void x264_macroblock_encode_internal( x264_t *h, int plane_
                     int i_decimate_8x8 = 0;
                     int cbp = 0;
 
+                    nz = x264_quant_4x4x4( h, &dct4x4[i8x8*4], i_qp, ctx_cat_plane[DCT_LUMA_4x4][p], 0, p, i8x8*4 );
+
                     /* encode one 4x4 block */
                     for( int i4x4 = 0; i4x4 < 4; i4x4++ )
                     {
                         int idx = i8x8 * 4 + i4x4;
 
-                        nz = x264_quant_4x4( h, dct4x4[idx], i_qp, ctx_cat_plane[DCT_LUMA_4x4][p], 0, p, idx );
-                        h->mb.cache.non_zero_count[x264_scan8[p*16+idx]] = nz;
+                        h->mb.cache.non_zero_count[x264_scan8[p*16+idx]] = (nz>>i4x4)&1;
 
-                        if( nz )
+                        if( nz&(1<<i4x4) )
                         {
                             h->zigzagf.scan_4x4( h->dct.luma4x4[p*16+idx], dct4x4[idx] );
                             h->quantf.dequant_4x4( dct4x4[idx], h->dequant4_mf[p?CQM_4PC:CQM_4PY], i_qp );
@@ -1216,11 +1217,11 @@ static ALWAYS_INLINE void x264_macroblock_encode_p8x8_internal( x264_t *h, int i
                 int i_decimate_8x8 = 0, nnz8x8 = 0;
                 ALIGNED_ARRAY_16( dctcoef, dct4x4,[4],[16] );
                 h->dctf.sub8x8_dct( dct4x4, p_fenc, p_fdec );
+                nz = x264_quant_4x4x4( h, dct4x4, i_qp, ctx_cat_plane[DCT_LUMA_4x4][p], 0, p, i8*4 );
                 for( int i4 = 0; i4 < 4; i4++ )
                 {
-                    nz = x264_quant_4x4( h, dct4x4[i4], i_qp, ctx_cat_plane[DCT_LUMA_4x4][p], 0, p, i8*4+i4 );
-                    h->mb.cache.non_zero_count[x264_scan8[p*16+i8*4+i4]] = nz;
-                    if( nz )
+                    h->mb.cache.non_zero_count[x264_scan8[p*16+i8*4+i4]] = (nz>>i4)&1;
+                    if( nz&(1<<i4) )
                     {
                         h->zigzagf.scan_4x4( h->dct.luma4x4[p*16+i8*4+i4], dct4x4[i4] );
                         h->quantf.dequant_4x4( dct4x4[i4], h->dequant4_mf[quant_cat], i_qp );
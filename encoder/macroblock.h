@@ -63,6 +63,14 @@ int x264_quant_4x4_trellis( x264_t *h, dctcoef *dct, int i_quant_cat,
                              int i_qp, int ctx_block_cat, int b_intra, int b_chroma, int idx );
 int x264_quant_8x8_trellis( x264_t *h, dctcoef *dct, int i_quant_cat,
                              int i_qp, int ctx_block_cat, int b_intra, int b_chroma, int idx );
+/* CABAC-only scalar reference versions, for checkasm */
+int x264_quant_luma_dc_trellis_ref( x264_t *h, dctcoef *dct, int i_quant_cat, int i_qp,
+                                    int ctx_block_cat, int b_intra, int idx );
+int x264_quant_chroma_dc_trellis_ref( x264_t *h, dctcoef *dct, int i_qp, int b_intra, int idx );
+int x264_quant_4x4_trellis_ref( x264_t *h, dctcoef *dct, int i_quant_cat,
+                                int i_qp, int ctx_block_cat, int b_intra, int b_chroma, int idx );
+int x264_quant_8x8_trellis_ref( x264_t *h, dctcoef *dct, int i_quant_cat,
+                                int i_qp, int ctx_block_cat, int b_intra, int b_chroma, int idx );
 
 void x264_noise_reduction_update( x264_t *h );
 
@@ -77,6 +85,27 @@ static ALWAYS_INLINE int x264_quant_4x4( x264_t *h, dctcoef dct[16], int i_qp, i
         return h->quantf.quant_4x4( dct, h->quant4_mf[i_quant_cat][i_qp], h->quant4_bias[i_quant_cat][i_qp] );
 }
 
+/* Quantizes the four 4x4 blocks of one 8x8, returns a mask of nonzero blocks. */
+static ALWAYS_INLINE int x264_quant_4x4x4( x264_t *h, dctcoef dct[4][16], int i_qp, int ctx_block_cat, int b_intra, int p, int idx )
+{
+    int i_quant_cat = b_intra ? (p?CQM_4IC:CQM_4IY) : (p?CQM_4PC:CQM_4PY);
+    int nz = 0;
+    if( h->mb.b_noise_reduction )
+        for( int i = 0; i < 4; i++ )
+            h->quantf.denoise_dct( dct[i], h->nr_residual_sum[0+!!p*2], h->nr_offset[0+!!p*2], 16 );
+    if( h->mb.b_trellis )
+        for( int i = 0; i < 4; i++ )
+        {
+            /* CAVLC trellis predicts from the nnz of the previous blocks */
+            int nzi = x264_quant_4x4_trellis( h, dct[i], i_quant_cat, i_qp, ctx_block_cat, b_intra, !!p, idx+i+p*16 );
+            h->mb.cache.non_zero_count[x264_scan8[p*16+idx+i]] = nzi;
+            nz |= nzi << i;
+        }
+    else
+        nz = h->quantf.quant_4x4x4( dct, h->quant4_mf[i_quant_cat][i_qp], h->quant4_bias[i_quant_cat][i_qp] );
+    return nz;
+}
+
 static ALWAYS_INLINE int x264_quant_8x8( x264_t *h, dctcoef dct[64], int i_qp, int ctx_block_cat, int b_intra, int p, int idx )
 {
     int i_quant_cat = b_intra ? (p?CQM_8IC:CQM_8IY) : (p?CQM_8PC:CQM_8PY);
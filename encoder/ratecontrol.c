@@ -1454,11 +1454,11 @@ void x264_ratecontrol_mb( x264_t *h, int bits )
         if( h->param.b_sliced_threads )
         {
             float size_of_other_slices_planned = 0;
-            for( int i = 0; i < h->param.i_threads; i++ )
-                if( h != h->thread[i] )
+            for( int i = 0; i < h->i_thread_slices; i++ )
+                if( h != h->slice_thread[i] )
                 {
-                    size_of_other_slices += h->thread[i]->rc->frame_size_estimated;
-                    size_of_other_slices_planned += h->thread[i]->rc->slice_size_planned;
+                    size_of_other_slices += h->slice_thread[i]->rc->frame_size_estimated;
+                    size_of_other_slices_planned += h->slice_thread[i]->rc->slice_size_planned;
                 }
             float weight = rc->slice_size_planned / rc->frame_size_planned;
             size_of_other_slices = (size_of_other_slices - size_of_other_slices_planned) * weight + size_of_other_slices_planned;
@@ -1956,6 +1956,26 @@ void x264_hrd_fullness( x264_t *h )
     h->initial_cpb_removal_delay_offset = (multiply_factor * cpb_size + denom) / (2*denom) - h->initial_cpb_removal_delay;
 }
 
+/* Fraction of the VBV buffer filled after the last frame output. */
+float x264_ratecontrol_vbv_fullness( x264_t *h )
+{
+    x264_ratecontrol_t *rct = h->thread[0]->rc;
+    if( !rct->b_vbv )
+        return 0;
+    uint64_t cpb_size = (uint64_t)h->sps->vui.hrd.i_cpb_size_unscaled * h->sps->vui.i_time_scale;
+    return (double)rct->buffer_fill_final / cpb_size;
+}
+
+/* Size estimate of the frame another frame thread is encoding; with sliced
+ * threads each of its slice threads estimates its own slice. */
+static double thread_frame_size_estimated( x264_t *t )
+{
+    double bits = 0;
+    for( int i = 0; i < t->i_thread_slices; i++ )
+        bits += t->slice_thread[i]->rc->frame_size_estimated;
+    return bits;
+}
+
 // provisionally update VBV according to the planned size of all frames currently in progress
 static void update_vbv_plan( x264_t *h, int overhead )
 {
@@ -1970,7 +1990,7 @@ static void update_vbv_plan( x264_t *h, int overhead )
             double bits = t->rc->frame_size_planned;
             if( !t->b_thread_active )
                 continue;
-            bits = X264_MAX(bits, t->rc->frame_size_estimated);
+            bits = X264_MAX(bits, thread_frame_size_estimated( t ));
             rcc->buffer_fill -= bits;
             rcc->buffer_fill = X264_MAX( rcc->buffer_fill, 0 );
             rcc->buffer_fill += t->rc->buffer_rate;
@@ -2216,7 +2236,7 @@ static float rate_estimate_qscale( x264_t *h )
                         double bits = t->rc->frame_size_planned;
                         if( !t->b_thread_active )
                             continue;
-                        bits = X264_MAX(bits, t->rc->frame_size_estimated);
+                        bits = X264_MAX(bits, thread_frame_size_estimated( t ));
                         predicted_bits += (int64_t)bits;
                     }
                 }
@@ -2385,14 +2405,21 @@ static float rate_estimate_qscale( x264_t *h )
     }
 }
 
+/* Each frame thread has its own set of slice size predictors, after the frame predictors. */
+static predictor_t *slice_predictor( x264_t *h, int slice )
+{
+    int frame = h->rc - h->thread[0]->rc;
+    return &h->rc->pred[h->sh.i_type + (frame * h->i_thread_slices + slice + 1) * 5];
+}
+
 void x264_threads_normalize_predictors( x264_t *h )
 {
     double totalsize = 0;
-    for( int i = 0; i < h->param.i_threads; i++ )
-        totalsize += h->thread[i]->rc->slice_size_planned;
+    for( int i = 0; i < h->i_thread_slices; i++ )
+        totalsize += h->slice_thread[i]->rc->slice_size_planned;
     double factor = h->rc->frame_size_planned / totalsize;
-    for( int i = 0; i < h->param.i_threads; i++ )
-        h->thread[i]->rc->slice_size_planned *= factor;
+    for( int i = 0; i < h->i_thread_slices; i++ )
+        h->slice_thread[i]->rc->slice_size_planned *= factor;
 }
 
 void x264_threads_distribute_ratecontrol( x264_t *h )
@@ -2402,15 +2429,15 @@ void x264_threads_distribute_ratecontrol( x264_t *h )
 
     /* Initialize row predictors */
     if( h->i_frame == 0 )
-        for( int i = 0; i < h->param.i_threads; i++ )
+        for( int i = 0; i < h->i_thread_slices; i++ )
         {
-            x264_ratecontrol_t *t = h->thread[i]->rc;
+            x264_ratecontrol_t *t = h->slice_thread[i]->rc;
             memcpy( t->row_preds, rc->row_preds, sizeof(rc->row_preds) );
         }
 
-    for( int i = 0; i < h->param.i_threads; i++ )
+    for( int i = 0; i < h->i_thread_slices; i++ )
     {
-        x264_t *t = h->thread[i];
+        x264_t *t = h->slice_thread[i];
         memcpy( t->rc, rc, offsetof(x264_ratecontrol_t, row_pred) );
         t->rc->row_pred = &t->rc->row_preds[h->sh.i_type];
         /* Calculate the planned slice size. */
@@ -2419,7 +2446,7 @@ void x264_threads_distribute_ratecontrol( x264_t *h )
             int size = 0;
             for( row = t->i_threadslice_start; row < t->i_threadslice_end; row++ )
                 size += h->fdec->i_row_satd[row];
-            t->rc->slice_size_planned = predict_size( &rc->pred[h->sh.i_type + (i+1)*5], rc->qpm, size );
+            t->rc->slice_size_planned = predict_size( slice_predictor( h, i ), rc->qpm, size );
         }
         else
             t->rc->slice_size_planned = 0;
@@ -2431,17 +2458,17 @@ void x264_threads_distribute_ratecontrol( x264_t *h )
         if( rc->single_frame_vbv )
         {
             /* Compensate for our max frame error threshold: give more bits (proportionally) to smaller slices. */
-            for( int i = 0; i < h->param.i_threads; i++ )
+            for( int i = 0; i < h->i_thread_slices; i++ )
             {
-                x264_t *t = h->thread[i];
+                x264_t *t = h->slice_thread[i];
                 float max_frame_error = X264_MAX( 0.05, 1.0 / (t->i_threadslice_end - t->i_threadslice_start) );
                 t->rc->slice_size_planned += 2 * max_frame_error * rc->frame_size_planned;
             }
             x264_threads_normalize_predictors( h );
         }
 
-        for( int i = 0; i < h->param.i_threads; i++ )
-            h->thread[i]->rc->frame_size_estimated = h->thread[i]->rc->slice_size_planned;
+        for( int i = 0; i < h->i_thread_slices; i++ )
+            h->slice_thread[i]->rc->frame_size_estimated = h->slice_thread[i]->rc->slice_size_planned;
     }
 }
 
@@ -2450,10 +2477,10 @@ void x264_threads_merge_ratecontrol( x264_t *h )
     x264_ratecontrol_t *rc = h->rc;
     x264_emms();
 
-    for( int i = 0; i < h->param.i_threads; i++ )
+    for( int i = 0; i < h->i_thread_slices; i++ )
     {
-        x264_t *t = h->thread[i];
-        x264_ratecontrol_t *rct = h->thread[i]->rc;
+        x264_t *t = h->slice_thread[i];
+        x264_ratecontrol_t *rct = h->slice_thread[i]->rc;
         if( h->param.rc.i_vbv_buffer_size )
         {
             int size = 0;
@@ -2461,7 +2488,7 @@ void x264_threads_merge_ratecontrol( x264_t *h )
                 size += h->fdec->i_row_satd[row];
             int bits = t->stat.frame.i_mv_bits + t->stat.frame.i_tex_bits + t->stat.frame.i_misc_bits;
             int mb_count = (t->i_threadslice_end - t->i_threadslice_start) * h->mb.i_mb_width;
-            update_predictor( &rc->pred[h->sh.i_type+(i+1)*5], qp2qscale( rct->qpa_rc/mb_count ), size, bits );
+            update_predictor( slice_predictor( h, i ), qp2qscale( rct->qpa_rc/mb_count ), size, bits );
         }
         if( !i )
             continue;
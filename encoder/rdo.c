@@ -432,7 +432,7 @@ typedef struct
 // and uses the dct scaling factors, not the idct ones.
 
 static ALWAYS_INLINE
-int quant_trellis_cabac( x264_t *h, dctcoef *dct,
+int quant_trellis_cabac_ref( x264_t *h, dctcoef *dct,
                          const udctcoef *quant_mf, const int *unquant_mf,
                          const uint16_t *coef_weight, const uint8_t *zigzag,
                          int ctx_block_cat, int i_lambda2, int b_ac,
@@ -659,6 +659,241 @@ int quant_trellis_cabac( x264_t *h, dctcoef *dct,
     return 1;
 }
 
+/* Same trellis as quant_trellis_cabac_ref, with the 8 nodes laid out as parallel
+ * arrays so that each coefficient's node expansion is a fixed 8-lane operation.
+ *
+ * Each node only keeps the two contexts it will code next: levels are coded in
+ * a fixed order of contexts (level1: 1,2,3,4,0; levelgt1: 5,6,7,8,9), so a
+ * context a node moves on to has never been touched on its path, and only the
+ * one it stays on needs to be carried. That replaces the 10-byte per-node copy
+ * of the abs_level_m1 contexts with 2 bytes per lane. */
+typedef struct
+{
+    int64_t score[8];
+    int level_idx[8];
+    uint8_t ctx_l1[8];  // state of the level1 context this node codes next
+    uint8_t ctx_gt1[8]; // state of the levelgt1 context this node codes next
+} trellis_nodes_t;
+
+static ALWAYS_INLINE
+int quant_trellis_cabac( x264_t *h, dctcoef *dct,
+                         const udctcoef *quant_mf, const int *unquant_mf,
+                         const uint16_t *coef_weight, const uint8_t *zigzag,
+                         int ctx_block_cat, int i_lambda2, int b_ac,
+                         int b_chroma, int dc, int i_coefs, int idx )
+{
+    udctcoef abs_coefs[64];
+    int8_t signs[64];
+    trellis_nodes_t nodes[2];
+    trellis_nodes_t *nodes_cur = &nodes[0];
+    trellis_nodes_t *nodes_prev = &nodes[1];
+    const int b_interlaced = MB_INTERLACED;
+    uint8_t *cabac_state_sig = &h->cabac.state[ significant_coeff_flag_offset[b_interlaced][ctx_block_cat] ];
+    uint8_t *cabac_state_last = &h->cabac.state[ last_coeff_flag_offset[b_interlaced][ctx_block_cat] ];
+    const uint8_t *level_state = &h->cabac.state[ coeff_abs_level_m1_offset[ctx_block_cat] ];
+    const uint8_t *levelgt1_ctx = b_chroma && dc ? coeff_abs_levelgt1_ctx_chroma_dc : coeff_abs_levelgt1_ctx;
+    const int f = 1 << 15; // no deadzone
+    int i_last_nnz;
+    int i;
+
+    struct
+    {
+        uint16_t abs_level;
+        uint16_t next;
+    } level_tree[64*8*2];
+    int i_levels_used = 1;
+
+    /* init coefs */
+    for( i = i_coefs-1; i >= b_ac; i-- )
+        if( (unsigned)(dct[zigzag[i]] * (dc?quant_mf[0]>>1:quant_mf[zigzag[i]]) + f-1) >= 2*f )
+            break;
+
+    if( i < b_ac )
+    {
+        if( i_coefs == 16 && !dc )
+            memset( dct, 0, 16 * sizeof(dctcoef) );
+        return 0;
+    }
+
+    i_last_nnz = i;
+    idx &= i_coefs == 64 ? 3 : 15;
+
+    for( ; i >= b_ac; i-- )
+    {
+        int coef = dct[zigzag[i]];
+        abs_coefs[i] = abs(coef);
+        signs[i] = coef>>31 | 1;
+    }
+
+    /* init trellis */
+    for( int j = 1; j < 8; j++ )
+        nodes_cur->score[j] = TRELLIS_SCORE_MAX;
+    nodes_cur->score[0] = 0;
+    nodes_cur->level_idx[0] = 0;
+    nodes_cur->ctx_l1[0] = level_state[coeff_abs_level1_ctx[0]];
+    nodes_cur->ctx_gt1[0] = level_state[levelgt1_ctx[0]];
+    level_tree[0].abs_level = 0;
+    level_tree[0].next = 0;
+
+    for( i = i_last_nnz; i >= b_ac; i-- )
+    {
+        int i_coef = abs_coefs[i];
+        int q = ( f + i_coef * (dc?quant_mf[0]>>1:quant_mf[zigzag[i]]) ) >> 16;
+        unsigned cost_sig[2], cost_last[2];
+
+        if( q == 0 )
+        {
+            int sigindex = !dc && i_coefs == 64 ? significant_coeff_flag_offset_8x8[b_interlaced][i] :
+                           b_chroma && dc && i_coefs == 8 ? coeff_flag_offset_chroma_422_dc[i] : i;
+            const uint32_t cost_sig0 = x264_cabac_size_decision_noup2( &cabac_state_sig[sigindex], 0 )
+                                     * (uint64_t)i_lambda2 >> ( CABAC_SIZE_BITS - LAMBDA_BITS );
+            for( int j = 1; j < 8; j++ )
+                if( nodes_cur->score[j] != TRELLIS_SCORE_MAX )
+                {
+                    level_tree[i_levels_used].abs_level = 0;
+                    level_tree[i_levels_used].next = nodes_cur->level_idx[j];
+                    nodes_cur->level_idx[j] = i_levels_used++;
+                    nodes_cur->score[j] += cost_sig0;
+                }
+            continue;
+        }
+
+        XCHG( trellis_nodes_t*, nodes_cur, nodes_prev );
+
+        if( i < i_coefs-1 )
+        {
+            int sigindex  = !dc && i_coefs == 64 ? significant_coeff_flag_offset_8x8[b_interlaced][i] :
+                            b_chroma && dc && i_coefs == 8 ? coeff_flag_offset_chroma_422_dc[i] : i;
+            int lastindex = !dc && i_coefs == 64 ? last_coeff_flag_offset_8x8[i] :
+                            b_chroma && dc && i_coefs == 8 ? coeff_flag_offset_chroma_422_dc[i] : i;
+            cost_sig[0] = x264_cabac_size_decision_noup2( &cabac_state_sig[sigindex], 0 );
+            cost_sig[1] = x264_cabac_size_decision_noup2( &cabac_state_sig[sigindex], 1 );
+            cost_last[0] = x264_cabac_size_decision_noup2( &cabac_state_last[lastindex], 0 );
+            cost_last[1] = x264_cabac_size_decision_noup2( &cabac_state_last[lastindex], 1 );
+        }
+        else
+        {
+            cost_sig[0] = cost_sig[1] = 0;
+            cost_last[0] = cost_last[1] = 0;
+        }
+
+        for( int j = 0; j < 8; j++ )
+            nodes_cur->score[j] = TRELLIS_SCORE_MAX;
+
+        for( int abs_level = q; abs_level >= q-1; abs_level-- )
+        {
+            int unquant_abs_level = (((dc?unquant_mf[0]<<1:unquant_mf[zigzag[i]]) * abs_level + 128) >> 8);
+            int d = i_coef - unquant_abs_level;
+            int64_t ssd, ssd0;
+            /* Psy trellis: bias in favor of higher AC coefficients in the reconstructed frame. */
+            if( h->mb.i_psy_trellis && i && !dc && !b_chroma )
+            {
+                int orig_coef = (i_coefs == 64) ? h->mb.pic.fenc_dct8[idx][zigzag[i]] : h->mb.pic.fenc_dct4[idx][zigzag[i]];
+                int predicted_coef = orig_coef - i_coef * signs[i];
+                int psy_value = h->mb.i_psy_trellis * abs(predicted_coef + unquant_abs_level * signs[i]);
+                int psy_weight = (i_coefs == 64) ? x264_dct8_weight_tab[zigzag[i]] : x264_dct4_weight_tab[zigzag[i]];
+                ssd = (int64_t)d*d * coef_weight[i] - psy_weight * psy_value;
+            }
+            else
+                ssd = (int64_t)d*d * (dc?256:coef_weight[i]);
+            ssd0 = ssd;
+            /* Optimize rounding for DC coefficients in DC-only luma 4x4/8x8 blocks. */
+            if( !i && !dc )
+            {
+                d = i_coef * signs[0] - ((unquant_abs_level * signs[0] + 8)&~15);
+                ssd0 = (int64_t)d*d * coef_weight[i];
+            }
+
+            if( !abs_level )
+            {
+                /* zero: every node stays in its context */
+                const uint64_t cost0 = (uint64_t)cost_sig[0] * i_lambda2 >> ( CABAC_SIZE_BITS - LAMBDA_BITS );
+                for( int j = 0; j < 8; j++ )
+                {
+                    if( nodes_prev->score[j] == TRELLIS_SCORE_MAX )
+                        continue;
+                    int64_t score = nodes_prev->score[j] + (j ? cost0 + ssd : ssd0);
+                    if( score < nodes_cur->score[j] )
+                    {
+                        nodes_cur->score[j] = score;
+                        nodes_cur->ctx_l1[j] = nodes_prev->ctx_l1[j];
+                        nodes_cur->ctx_gt1[j] = nodes_prev->ctx_gt1[j];
+                        level_tree[i_levels_used].abs_level = 0;
+                        level_tree[i_levels_used].next = nodes_prev->level_idx[j];
+                        nodes_cur->level_idx[j] = i_levels_used++;
+                    }
+                }
+                continue;
+            }
+
+            /* The cost of the level only depends on the node through its two
+             * context states; everything else is shared by all nodes. */
+            const int b_gt1 = abs_level > 1;
+            const int i_prefix = X264_MIN( abs_level - 1, 14 );
+            const uint16_t *size_unary = cabac_size_unary[i_prefix];
+            const uint8_t *transition_unary = cabac_transition_unary[i_prefix];
+            const uint8_t *transition = coeff_abs_level_transition[b_gt1];
+            unsigned f8_base = cost_sig[1];
+            if( !b_gt1 )
+                f8_base += 1 << CABAC_SIZE_BITS;
+            else if( abs_level >= 15 )
+                f8_base += bs_size_ue_big( abs_level - 15 ) << CABAC_SIZE_BITS;
+
+            for( int j = 0; j < 8; j++ )
+            {
+                if( nodes_prev->score[j] == TRELLIS_SCORE_MAX )
+                    continue;
+                int ctx_l1 = nodes_prev->ctx_l1[j];
+                int ctx_gt1 = nodes_prev->ctx_gt1[j];
+                unsigned f8_bits = f8_base + cost_last[j == 0] + x264_cabac_entropy[ctx_l1 ^ b_gt1];
+                if( b_gt1 )
+                    f8_bits += size_unary[ctx_gt1];
+                int64_t score = nodes_prev->score[j] + (j ? ssd : ssd0)
+                              + ((uint64_t)f8_bits * i_lambda2 >> ( CABAC_SIZE_BITS - LAMBDA_BITS ));
+
+                /* save the node if it's better than any existing node with the same cabac ctx */
+                int t = transition[j];
+                if( score < nodes_cur->score[t] )
+                {
+                    nodes_cur->score[t] = score;
+                    nodes_cur->ctx_l1[t] = coeff_abs_level1_ctx[t] == coeff_abs_level1_ctx[j]
+                                         ? x264_cabac_transition[ctx_l1][b_gt1]
+                                         : level_state[coeff_abs_level1_ctx[t]];
+                    nodes_cur->ctx_gt1[t] = levelgt1_ctx[t] != levelgt1_ctx[j] ? level_state[levelgt1_ctx[t]]
+                                          : b_gt1 ? transition_unary[ctx_gt1] : ctx_gt1;
+                    level_tree[i_levels_used].abs_level = abs_level;
+                    level_tree[i_levels_used].next = nodes_prev->level_idx[j];
+                    nodes_cur->level_idx[t] = i_levels_used++;
+                }
+            }
+        }
+    }
+
+    /* output levels from the best path through the trellis */
+    int bnode = 0;
+    for( int j = 1; j < 8; j++ )
+        if( nodes_cur->score[j] < nodes_cur->score[bnode] )
+            bnode = j;
+
+    if( bnode == 0 )
+    {
+        if( i_coefs == 16 && !dc )
+            memset( dct, 0, 16 * sizeof(dctcoef) );
+        return 0;
+    }
+
+    int level = nodes_cur->level_idx[bnode];
+    for( i = b_ac; level; i++ )
+    {
+        dct[zigzag[i]] = level_tree[level].abs_level * signs[i];
+        level = level_tree[level].next;
+    }
+    for( ; i < i_coefs; i++ )
+        dct[zigzag[i]] = 0;
+
+    return 1;
+}
+
 /* FIXME: This is a gigantic hack.  See below.
  *
  * CAVLC is much more difficult to trellis than CABAC.
@@ -946,3 +1181,42 @@ int x264_quant_8x8_trellis( x264_t *h, dctcoef *dct, int i_quant_cat,
     }
     return nzaccum;
 }
+
+/* The scalar CABAC trellis, kept as a reference for checkasm. */
+int x264_quant_luma_dc_trellis_ref( x264_t *h, dctcoef *dct, int i_quant_cat, int i_qp, int ctx_block_cat, int b_intra, int idx )
+{
+    return quant_trellis_cabac_ref( h, dct,
+        h->quant4_mf[i_quant_cat][i_qp], h->unquant4_mf[i_quant_cat][i_qp], NULL, x264_zigzag_scan4[MB_INTERLACED],
+        ctx_block_cat, h->mb.i_trellis_lambda2[0][b_intra], 0, 0, 1, 16, idx );
+}
+
+int x264_quant_chroma_dc_trellis_ref( x264_t *h, dctcoef *dct, int i_qp, int b_intra, int idx )
+{
+    int quant_cat = CQM_4IC+1 - b_intra;
+    int b_422 = CHROMA_FORMAT == CHROMA_422;
+    return quant_trellis_cabac_ref( h, dct,
+        h->quant4_mf[quant_cat][i_qp], h->unquant4_mf[quant_cat][i_qp], NULL,
+        b_422 ? x264_zigzag_scan2x4 : x264_zigzag_scan2x2,
+        DCT_CHROMA_DC, h->mb.i_trellis_lambda2[1][b_intra], 0, 1, 1, b_422 ? 8 : 4, idx );
+}
+
+int x264_quant_4x4_trellis_ref( x264_t *h, dctcoef *dct, int i_quant_cat,
+                                int i_qp, int ctx_block_cat, int b_intra, int b_chroma, int idx )
+{
+    static const uint8_t ctx_ac[14] = {0,1,0,0,1,0,0,1,0,0,0,1,0,0};
+    return quant_trellis_cabac_ref( h, dct,
+        h->quant4_mf[i_quant_cat][i_qp], h->unquant4_mf[i_quant_cat][i_qp],
+        x264_dct4_weight2_zigzag[MB_INTERLACED],
+        x264_zigzag_scan4[MB_INTERLACED],
+        ctx_block_cat, h->mb.i_trellis_lambda2[b_chroma][b_intra], ctx_ac[ctx_block_cat], b_chroma, 0, 16, idx );
+}
+
+int x264_quant_8x8_trellis_ref( x264_t *h, dctcoef *dct, int i_quant_cat,
+                                int i_qp, int ctx_block_cat, int b_intra, int b_chroma, int idx )
+{
+    return quant_trellis_cabac_ref( h, dct,
+        h->quant8_mf[i_quant_cat][i_qp], h->unquant8_mf[i_quant_cat][i_qp],
+        x264_dct8_weight2_zigzag[MB_INTERLACED],
+        x264_zigzag_scan8[MB_INTERLACED],
+        ctx_block_cat, h->mb.i_trellis_lambda2[b_chroma][b_intra], 0, b_chroma, 0, 64, idx );
+}
@@ -431,9 +431,20 @@ void x264_weights_analyse( x264_t *h, x264_frame_t *fenc, x264_frame_t *ref, int
     }
 }
 
+/* Frame cost totals, accumulated separately by each lookahead thread. */
+typedef struct
+{
+    int i_cost_est;
+    int i_cost_est_aq;
+    int i_intra_cost_est;
+    int i_intra_cost_est_aq;
+    int i_intra_mbs;
+} x264_lowres_cost_sum_t;
+
 static void x264_slicetype_mb_cost( x264_t *h, x264_mb_analysis_t *a,
                                     x264_frame_t **frames, int p0, int p1, int b,
-                                    int dist_scale_factor, int do_search[2], const x264_weight_t *w )
+                                    int dist_scale_factor, int do_search[2], const x264_weight_t *w,
+                                    x264_lowres_cost_sum_t *sum )
 {
     x264_frame_t *fref0 = frames[p0];
     x264_frame_t *fref1 = frames[p1];
@@ -661,8 +672,8 @@ lowres_intra_mb:
         fenc->i_row_satds[0][0][h->mb.i_mb_y] += i_icost_aq;
         if( b_frame_score_mb )
         {
-            fenc->i_cost_est[0][0] += i_icost;
-            fenc->i_cost_est_aq[0][0] += i_icost_aq;
+            sum->i_intra_cost_est += i_icost;
+            sum->i_intra_cost_est_aq += i_icost_aq;
         }
     }
 
@@ -678,7 +689,7 @@ lowres_intra_mb:
             list_used = 0;
         }
         if( b_frame_score_mb )
-            fenc->i_intra_mbs[b-p0] += b_intra;
+            sum->i_intra_mbs += b_intra;
     }
 
     /* In an I-frame, we've already added the results above in the intra section. */
@@ -691,8 +702,8 @@ lowres_intra_mb:
         if( b_frame_score_mb )
         {
             /* Don't use AQ-weighted costs for slicetype decision, only for ratecontrol. */
-            fenc->i_cost_est[b-p0][p1-b] += i_bcost;
-            fenc->i_cost_est_aq[b-p0][p1-b] += i_bcost_aq;
+            sum->i_cost_est += i_bcost;
+            sum->i_cost_est_aq += i_bcost_aq;
         }
     }
 
@@ -705,24 +716,113 @@ lowres_intra_mb:
    (h->mb.i_mb_width - 2) * (h->mb.i_mb_height - 2) :\
     h->mb.i_mb_width * h->mb.i_mb_height)
 
-static int x264_slicetype_frame_cost( x264_t *h, x264_mb_analysis_t *a,
-                                      x264_frame_t **frames, int p0, int p1, int b,
-                                      int b_intra_penalty )
+typedef struct
+{
+    x264_t *h;
+    x264_mb_analysis_t *a;
+    x264_frame_t **frames;
+    int p0;
+    int p1;
+    int b;
+    int dist_scale_factor;
+    int *do_search;
+    const x264_weight_t *w;
+    int b_edges;
+    int i_start_y;   /* rows i_start_y, i_start_y - i_row_step, ... down to i_end_y */
+    int i_end_y;
+    int i_row_step;
+    int b_sync;      /* publish progress in look->row_progress */
+    x264_lowres_cost_sum_t sum;
+} x264_slicetype_slice_t;
+
+/* Wait until mb column x of the given row has been analysed.
+ * *seen caches the last progress read, as rows only ever move left. */
+static void x264_slicetype_row_wait( x264_lookahead_t *look, int *seen, int row, int x )
+{
+    if( *seen <= x )
+        return;
+    x264_pthread_mutex_lock( &look->row_mutex );
+    while( look->row_progress[row] > x )
+        x264_pthread_cond_wait( &look->row_cv, &look->row_mutex );
+    *seen = look->row_progress[row];
+    x264_pthread_mutex_unlock( &look->row_mutex );
+}
+
+static void x264_slicetype_row_signal( x264_lookahead_t *look, int row, int x )
+{
+    x264_pthread_mutex_lock( &look->row_mutex );
+    look->row_progress[row] = x;
+    x264_pthread_cond_broadcast( &look->row_cv );
+    x264_pthread_mutex_unlock( &look->row_mutex );
+}
+
+static void x264_slicetype_slice_cost( x264_slicetype_slice_t *s )
+{
+    x264_t *h = s->h;
+    x264_frame_t *fenc = s->frames[s->b];
+    int *row_satd = fenc->i_row_satds[s->b-s->p0][s->p1-s->b];
+    int *row_satd_intra = fenc->i_row_satds[0][0];
+    int start_x = h->mb.i_mb_width - 2 + s->b_edges;
+    int end_x = 1 - s->b_edges;
+    /* Lowres MV prediction reads the row below up to column x-1, so with
+     * rows spread over threads each row trails the one below it by an mb. */
+    int b_wait = s->b_sync && (s->do_search[0] || s->do_search[1]);
+
+    for( h->mb.i_mb_y = s->i_start_y; h->mb.i_mb_y >= s->i_end_y; h->mb.i_mb_y -= s->i_row_step )
+    {
+        int below = h->mb.i_mb_y + 1;
+        int seen = h->mb.i_mb_width;
+        if( s->b_edges )
+        {
+            row_satd[h->mb.i_mb_y] = 0;
+            if( !fenc->b_intra_calculated )
+                row_satd_intra[h->mb.i_mb_y] = 0;
+        }
+        for( h->mb.i_mb_x = start_x; h->mb.i_mb_x >= end_x; h->mb.i_mb_x-- )
+        {
+            if( b_wait && below < h->mb.i_mb_height )
+                x264_slicetype_row_wait( h->lookahead, &seen, below, h->mb.i_mb_x - 1 );
+            x264_slicetype_mb_cost( h, s->a, s->frames, s->p0, s->p1, s->b, s->dist_scale_factor,
+                                    s->do_search, s->w, &s->sum );
+            if( s->b_sync )
+                x264_slicetype_row_signal( h->lookahead, h->mb.i_mb_y, h->mb.i_mb_x > end_x ? h->mb.i_mb_x : -1 );
+        }
+    }
+    x264_emms();
+}
+
+/* Copy the lowres analysis settings of h into lookahead thread t. */
+static void x264_lookahead_thread_sync( x264_t *t, x264_t *h )
+{
+    t->param = h->param;
+    t->mb.i_me_method = h->mb.i_me_method;
+    t->mb.i_subpel_refine = h->mb.i_subpel_refine;
+    t->mb.b_chroma_me = h->mb.b_chroma_me;
+}
+
+/* Check whether we already evaluated this frame
+ * If we have tried this frame as P, then we have also tried
+ * the preceding frames as B. (is this still true?) */
+/* Also check that we already calculated the row SATDs for the current frame. */
+static int x264_slicetype_frame_cost_cached( x264_t *h, x264_frame_t **frames, int p0, int p1, int b )
+{
+    return frames[b]->i_cost_est[b-p0][p1-b] >= 0 &&
+           (!h->param.rc.i_vbv_buffer_size || frames[b]->i_row_satds[b-p0][p1-b][0] != -1);
+}
+
+/* threads is the maximum number of lookahead threads to spread the rows over. */
+static int x264_slicetype_frame_cost_threads( x264_t *h, x264_mb_analysis_t *a,
+                                              x264_frame_t **frames, int p0, int p1, int b,
+                                              int b_intra_penalty, int threads )
 {
     int i_score = 0;
     int do_search[2];
     const x264_weight_t *w = x264_weight_none;
-    /* Check whether we already evaluated this frame
-     * If we have tried this frame as P, then we have also tried
-     * the preceding frames as B. (is this still true?) */
-    /* Also check that we already calculated the row SATDs for the current frame. */
-    if( frames[b]->i_cost_est[b-p0][p1-b] >= 0 && (!h->param.rc.i_vbv_buffer_size || frames[b]->i_row_satds[b-p0][p1-b][0] != -1) )
+    if( x264_slicetype_frame_cost_cached( h, frames, p0, p1, b ) )
         i_score = frames[b]->i_cost_est[b-p0][p1-b];
     else
     {
         int dist_scale_factor = 128;
-        int *row_satd = frames[b]->i_row_satds[b-p0][p1-b];
-        int *row_satd_intra = frames[b]->i_row_satds[0][0];
 
         /* For each list, check to see whether we have lowres motion-searched this reference frame before. */
         do_search[0] = b != p0 && frames[b]->lowres_mvs[0][b-p0-1][0][0] == 0x7FFF;
@@ -757,23 +857,41 @@ static int x264_slicetype_frame_cost( x264_t *h, x264_mb_analysis_t *a,
 
         /* The edge mbs seem to reduce the predictive quality of the
          * whole frame's score, but are needed for a spatial distribution. */
-        if( h->param.rc.b_mb_tree || h->param.rc.i_vbv_buffer_size ||
-            h->mb.i_mb_width <= 2 || h->mb.i_mb_height <= 2 )
+        int b_edges = h->param.rc.b_mb_tree || h->param.rc.i_vbv_buffer_size ||
+                      h->mb.i_mb_width <= 2 || h->mb.i_mb_height <= 2;
+        int start_y = h->mb.i_mb_height - 2 + b_edges;
+        int end_y = 1 - b_edges;
+
+        /* Rows are dealt out to the lookahead threads in turn, and each thread
+         * sums its own costs; the sums are merged in thread order afterwards,
+         * so the result is the same as analysing the rows serially. */
+        threads = x264_clip3( threads, 1, start_y - end_y + 1 );
+        x264_slicetype_slice_t s[X264_LOOKAHEAD_THREAD_MAX];
+        for( int i = 0; i < threads; i++ )
+            s[i] = (x264_slicetype_slice_t){ i ? h->lookahead_thread[i] : h, a, frames, p0, p1, b, dist_scale_factor,
+                                             do_search, w, b_edges, start_y - i, end_y, threads, threads > 1 };
+        if( threads > 1 )
         {
-            for( h->mb.i_mb_y = h->mb.i_mb_height - 1; h->mb.i_mb_y >= 0; h->mb.i_mb_y-- )
+            x264_lookahead_t *look = h->lookahead;
+            for( int y = 0; y < h->mb.i_mb_height; y++ )
+                look->row_progress[y] = y >= end_y && y <= start_y ? h->mb.i_mb_width : -1;
+            for( int i = 1; i < threads; i++ )
             {
-                row_satd[h->mb.i_mb_y] = 0;
-                if( !frames[b]->b_intra_calculated )
-                    row_satd_intra[h->mb.i_mb_y] = 0;
-                for( h->mb.i_mb_x = h->mb.i_mb_width - 1; h->mb.i_mb_x >= 0; h->mb.i_mb_x-- )
-                    x264_slicetype_mb_cost( h, a, frames, p0, p1, b, dist_scale_factor, do_search, w );
+                x264_lookahead_thread_sync( s[i].h, h );
+                x264_threadpool_run( h->lookaheadpool, (void*)x264_slicetype_slice_cost, &s[i] );
             }
         }
-        else
+        x264_slicetype_slice_cost( &s[0] );
+        for( int i = 1; i < threads; i++ )
+            x264_threadpool_wait( h->lookaheadpool, &s[i] );
+
+        for( int i = 0; i < threads; i++ )
         {
-            for( h->mb.i_mb_y = h->mb.i_mb_height - 2; h->mb.i_mb_y >= 1; h->mb.i_mb_y-- )
-                for( h->mb.i_mb_x = h->mb.i_mb_width - 2; h->mb.i_mb_x >= 1; h->mb.i_mb_x-- )
-                    x264_slicetype_mb_cost( h, a, frames, p0, p1, b, dist_scale_factor, do_search, w );
+            frames[b]->i_cost_est[0][0] += s[i].sum.i_intra_cost_est;
+            frames[b]->i_cost_est_aq[0][0] += s[i].sum.i_intra_cost_est_aq;
+            frames[b]->i_cost_est[b-p0][p1-b] += s[i].sum.i_cost_est;
+            frames[b]->i_cost_est_aq[b-p0][p1-b] += s[i].sum.i_cost_est_aq;
+            frames[b]->i_intra_mbs[b-p0] += s[i].sum.i_intra_mbs;
         }
 
         i_score = frames[b]->i_cost_est[b-p0][p1-b];
@@ -795,6 +913,14 @@ static int x264_slicetype_frame_cost( x264_t *h, x264_mb_analysis_t *a,
     return i_score;
 }
 
+static int x264_slicetype_frame_cost( x264_t *h, x264_mb_analysis_t *a,
+                                      x264_frame_t **frames, int p0, int p1, int b,
+                                      int b_intra_penalty )
+{
+    int threads = h->lookaheadpool ? h->param.i_lookahead_threads : 1;
+    return x264_slicetype_frame_cost_threads( h, a, frames, p0, p1, b, b_intra_penalty, threads );
+}
+
 /* If MB-tree changes the quantizers, we need to recalculate the frame cost without
  * re-running lookahead. */
 static int x264_slicetype_frame_cost_recalculate( x264_t *h, x264_frame_t **frames, int p0, int p1, int b )
@@ -846,30 +972,42 @@ static void x264_macroblock_tree_finish( x264_t *h, x264_frame_t *frame, float a
     }
 }
 
-static void x264_macroblock_tree_propagate( x264_t *h, x264_frame_t **frames, float average_duration, int p0, int p1, int b, int referenced )
+typedef struct
+{
+    x264_t *h;
+    x264_frame_t **frames;
+    int p0;
+    int p1;
+    int b;
+    int referenced;
+    float fps_factor;
+    int i_start_y;
+    int i_end_y;
+    uint16_t *ref_costs[2]; /* the references' costs, or this thread's own sums of what it adds to them */
+} x264_mbtree_slice_t;
+
+static void x264_macroblock_tree_propagate_rows( x264_mbtree_slice_t *s )
 {
-    uint16_t *ref_costs[2] = {frames[p0]->i_propagate_cost,frames[p1]->i_propagate_cost};
+    x264_t *h = s->h;
+    x264_frame_t **frames = s->frames;
+    int p0 = s->p0, p1 = s->p1, b = s->b;
+    uint16_t **ref_costs = s->ref_costs;
     int dist_scale_factor = ( ((b-p0) << 8) + ((p1-p0) >> 1) ) / (p1-p0);
     int i_bipred_weight = h->param.analyse.b_weighted_bipred ? 64 - (dist_scale_factor>>2) : 32;
     int16_t (*mvs[2])[2] = { frames[b]->lowres_mvs[0][b-p0-1], frames[b]->lowres_mvs[1][p1-b-1] };
     int bipred_weights[2] = {i_bipred_weight, 64 - i_bipred_weight};
     int *buf = h->scratch_buffer;
     uint16_t *propagate_cost = frames[b]->i_propagate_cost;
+    if( s->referenced )
+        propagate_cost += s->i_start_y * h->mb.i_mb_width;
 
-    x264_emms();
-    float fps_factor = CLIP_DURATION(frames[b]->f_duration) / CLIP_DURATION(average_duration);
-
-    /* For non-reffed frames the source costs are always zero, so just memset one row and re-use it. */
-    if( !referenced )
-        memset( frames[b]->i_propagate_cost, 0, h->mb.i_mb_width * sizeof(uint16_t) );
-
-    for( h->mb.i_mb_y = 0; h->mb.i_mb_y < h->mb.i_mb_height; h->mb.i_mb_y++ )
+    for( h->mb.i_mb_y = s->i_start_y; h->mb.i_mb_y < s->i_end_y; h->mb.i_mb_y++ )
     {
         int mb_index = h->mb.i_mb_y*h->mb.i_mb_stride;
         h->mc.mbtree_propagate_cost( buf, propagate_cost,
             frames[b]->i_intra_cost+mb_index, frames[b]->lowres_costs[b-p0][p1-b]+mb_index,
-            frames[b]->i_inv_qscale_factor+mb_index, &fps_factor, h->mb.i_mb_width );
-        if( referenced )
+            frames[b]->i_inv_qscale_factor+mb_index, &s->fps_factor, h->mb.i_mb_width );
+        if( s->referenced )
             propagate_cost += h->mb.i_mb_width;
         for( h->mb.i_mb_x = 0; h->mb.i_mb_x < h->mb.i_mb_width; h->mb.i_mb_x++, mb_index++ )
         {
@@ -935,6 +1073,82 @@ static void x264_macroblock_tree_propagate( x264_t *h, x264_frame_t **frames, fl
             }
         }
     }
+    x264_emms();
+}
+
+typedef struct
+{
+    x264_mbtree_slice_t *slices;
+    int i_threads;
+    int i_lists;
+    int i_start;   /* mb range to reduce */
+    int i_end;
+} x264_mbtree_reduce_t;
+
+/* All propagated amounts are positive, so saturating adds can be regrouped freely:
+ * adding each thread's saturated sums gives exactly the serial result. */
+static void x264_macroblock_tree_reduce( x264_mbtree_reduce_t *r )
+{
+    for( int list = 0; list < r->i_lists; list++ )
+    {
+        uint16_t *dst = r->slices[0].ref_costs[list];
+        for( int t = 1; t < r->i_threads; t++ )
+        {
+            uint16_t *src = r->slices[t].ref_costs[list];
+            for( int i = r->i_start; i < r->i_end; i++ )
+                CLIP_ADD( dst[i], src[i] );
+        }
+    }
+}
+
+static void x264_macroblock_tree_propagate( x264_t *h, x264_frame_t **frames, float average_duration, int p0, int p1, int b, int referenced )
+{
+    x264_emms();
+    float fps_factor = CLIP_DURATION(frames[b]->f_duration) / CLIP_DURATION(average_duration);
+
+    /* For non-reffed frames the source costs are always zero, so just memset one row and re-use it. */
+    if( !referenced )
+        memset( frames[b]->i_propagate_cost, 0, h->mb.i_mb_width * sizeof(uint16_t) );
+
+    /* Split the rows into bands; the first band adds straight into the references,
+     * the others into their own buffers, which are then summed into the references. */
+    int threads = h->lookaheadpool ? X264_MIN( h->param.i_lookahead_threads, h->mb.i_mb_height ) : 1;
+    int lists = 1 + (b < p1);
+    x264_mbtree_slice_t s[X264_LOOKAHEAD_THREAD_MAX];
+    for( int i = 0; i < threads; i++ )
+    {
+        s[i] = (x264_mbtree_slice_t){ i ? h->lookahead_thread[i] : h, frames, p0, p1, b, referenced, fps_factor,
+                                      h->mb.i_mb_height *  i    / threads,
+                                      h->mb.i_mb_height * (i+1) / threads,
+                                      { frames[p0]->i_propagate_cost, frames[p1]->i_propagate_cost } };
+        if( i )
+        {
+            for( int list = 0; list < lists; list++ )
+            {
+                s[i].ref_costs[list] = h->lookahead->propagate_sums + ((i-1)*2 + list) * h->mb.i_mb_count;
+                memset( s[i].ref_costs[list], 0, h->mb.i_mb_count * sizeof(uint16_t) );
+            }
+            x264_lookahead_thread_sync( s[i].h, h );
+            x264_threadpool_run( h->lookaheadpool, (void*)x264_macroblock_tree_propagate_rows, &s[i] );
+        }
+    }
+    x264_macroblock_tree_propagate_rows( &s[0] );
+    for( int i = 1; i < threads; i++ )
+        x264_threadpool_wait( h->lookaheadpool, &s[i] );
+
+    if( threads > 1 )
+    {
+        x264_mbtree_reduce_t r[X264_LOOKAHEAD_THREAD_MAX];
+        for( int i = 0; i < threads; i++ )
+        {
+            r[i] = (x264_mbtree_reduce_t){ s, threads, lists, h->mb.i_mb_count * i / threads, h->mb.i_mb_count * (i+1) / threads };
+            if( i )
+                x264_threadpool_run( h->lookaheadpool, (void*)x264_macroblock_tree_reduce, &r[i] );
+        }
+        x264_macroblock_tree_reduce( &r[0] );
+        for( int i = 1; i < threads; i++ )
+            x264_threadpool_wait( h->lookaheadpool, &r[i] );
+    }
 
     if( h->param.rc.i_vbv_buffer_size && h->param.rc.i_lookahead && referenced )
         x264_macroblock_tree_finish( h, frames[b], average_duration, b == p1 ? b - p0 : 0 );
@@ -1173,37 +1387,277 @@ static int x264_slicetype_path_cost( x264_t *h, x264_mb_analysis_t *a, x264_fram
     return cost;
 }
 
+/* Packs (p0,p1,b) so that sorting groups the costs by frame. */
+#define NEED_PACK( p0, p1, b ) (((b) << 16) + (((b)-(p0)) << 8) + ((p1)-(b)))
+#define NEED_B( key )  ((key) >> 16)
+#define NEED_P0( key ) (NEED_B(key) - (((key) >> 8) & 0xff))
+#define NEED_P1( key ) (NEED_B(key) + ((key) & 0xff))
+
+/* Adds a cached frame cost to *cost.  An uncached one is appended to list if there
+ * is one, else returned packed. */
+static int x264_slicetype_probe_cost( x264_t *h, x264_frame_t **frames, int p0, int p1, int b,
+                                      int *cost, int *list, int *size )
+{
+    if( x264_slicetype_frame_cost_cached( h, frames, p0, p1, b ) )
+        *cost += frames[b]->i_cost_est[b-p0][p1-b];
+    else if( list )
+        list[(*size)++] = NEED_PACK( p0, p1, b );
+    else
+        return NEED_PACK( p0, p1, b );
+    return 0;
+}
+
+#define PROBE( p0, p1, b )\
+{\
+    int key = x264_slicetype_probe_cost( h, frames, p0, p1, b, cost, list, size );\
+    if( key )\
+        return key;\
+}
+
+/* The B-frame loops' cost < threshold test. */
+#define PROBE_BELOW_THRESHOLD\
+    if( *cost >= hi )\
+        break;\
+    if( *cost >= lo )\
+        return -1;
+
+/* Follows x264_slicetype_path_cost through the cached frame costs, knowing only that
+ * its threshold lies in [lo,hi].  Returns the first uncached cost it is certain to
+ * evaluate, 0 once the path's cost is known (in *cost), or -1 if that depends on
+ * costs not known yet.  With list set, every uncached cost the path could evaluate
+ * is appended to it instead. */
+static int x264_slicetype_path_probe( x264_t *h, x264_frame_t **frames, char *path, int lo, int hi,
+                                      int *cost, int *list, int *size )
+{
+    int loc = 1;
+    int cur_p = 0;
+    *cost = 0;
+    if( list )
+        lo = hi = COST_MAX;
+    path--;
+    while( path[loc] )
+    {
+        int next_p = loc;
+        while( path[next_p] != 'P' )
+            next_p++;
+
+        PROBE( cur_p, next_p, next_p );
+        if( *cost > hi )
+            break;
+        if( *cost > lo )
+            return -1;
+
+        if( h->param.i_bframe_pyramid && next_p - cur_p > 2 )
+        {
+            int middle = cur_p + (next_p - cur_p)/2;
+            PROBE( cur_p, next_p, middle );
+            for( int next_b = loc; next_b < middle; next_b++ )
+            {
+                PROBE_BELOW_THRESHOLD
+                PROBE( cur_p, middle, next_b );
+            }
+            for( int next_b = middle+1; next_b < next_p; next_b++ )
+            {
+                PROBE_BELOW_THRESHOLD
+                PROBE( middle, next_p, next_b );
+            }
+        }
+        else
+            for( int next_b = loc; next_b < next_p; next_b++ )
+            {
+                PROBE_BELOW_THRESHOLD
+                PROBE( cur_p, next_p, next_b );
+            }
+
+        loc = next_p + 1;
+        cur_p = next_p;
+    }
+    return 0;
+}
+#undef PROBE
+#undef PROBE_BELOW_THRESHOLD
+
+/* Whether the cost packed in key can be evaluated now and get the value it would get
+ * in the serial search, given the costs that the paths searched before it could still
+ * evaluate (reach).  Motion searches are shared between costs of the same frame and
+ * distance: weightp only applies to a P cost's search, and a B cost predicts from its
+ * future reference's search if that was done. */
+static int x264_slicetype_path_ready( x264_t *h, x264_frame_t **frames, int key, int *reach, int reach_size )
+{
+    int p0 = NEED_P0(key), p1 = NEED_P1(key), b = NEED_B(key);
+    int search = frames[b]->lowres_mvs[0][b-p0-1][0][0] == 0x7FFF;
+    int mvr = b != p1 && frames[p1]->lowres_mvs[0][p1-p0-1][0][0] == 0x7FFF;
+    for( int i = 0; i < reach_size; i++ )
+    {
+        int q0 = NEED_P0(reach[i]), q1 = NEED_P1(reach[i]), c = NEED_B(reach[i]);
+        if( q0 != p0 )
+            continue;
+        /* An earlier cost could do our search with different weights, or predict from it. */
+        if( search && c == b && (c == q1) != (b == p1) && h->param.analyse.i_weighted_pred )
+            return 0;
+        if( search && q1 == b && c != q1 )
+            return 0;
+        /* An earlier cost could do the search we predict from. */
+        if( mvr && c == p1 )
+            return 0;
+    }
+    return 1;
+}
+
+typedef struct
+{
+    x264_t *h;
+    x264_mb_analysis_t *a;
+    x264_frame_t **frames;
+    int *list;
+    int *group;      /* list[group[g]] .. list[group[g+1]-1] are the costs of one frame */
+    int i_groups;
+    int i_first;     /* groups i_first, i_first + i_step, ... */
+    int i_step;
+} x264_slicetype_batch_t;
+
+static void x264_slicetype_batch_cost( x264_slicetype_batch_t *s )
+{
+    for( int g = s->i_first; g < s->i_groups; g += s->i_step )
+        for( int i = s->group[g]; i < s->group[g+1]; i++ )
+        {
+            int key = s->list[i];
+            x264_slicetype_frame_cost_threads( s->h, s->a, s->frames, NEED_P0(key), NEED_P1(key), NEED_B(key), 0, 1 );
+        }
+}
+
+static int x264_slicetype_need_cmp( const void *a, const void *b )
+{
+    return *(const int*)a - *(const int*)b;
+}
+
+/* Evaluate the frame costs x264_slicetype_path's search will ask for on the lookahead
+ * threads, so that the search itself only reads the cache.
+ * This runs in rounds.  Each round replays the search as far as the cached costs
+ * decide it; every path still undecided offers the next cost it is certain to need,
+ * and the round evaluates the ones that x264_slicetype_path_ready allows, each
+ * frame's costs on one thread.  The first undecided path's cost is always allowed,
+ * so every round makes progress, and each cost is evaluated in the same state as in
+ * the serial search, so the result is the same for any number of threads. */
+static void x264_slicetype_path_prepare( x264_t *h, x264_mb_analysis_t *a, x264_frame_t **frames,
+                                         char (*paths)[X264_LOOKAHEAD_MAX+1], int num_paths, int length )
+{
+    int *reach = x264_malloc( (num_paths * length + 2 * num_paths + 1) * sizeof(int) );
+    if( !reach )
+        return;
+    int *list = reach + num_paths * length;
+    int *group = list + num_paths;
+
+    for( ;; )
+    {
+        /* The threshold of the path being replayed lies in [lo,hi]. */
+        int lo = COST_MAX, hi = COST_MAX;
+        int reach_size = 0;
+        int ready = 0;
+        for( int path = 0; path < num_paths; path++ )
+        {
+            int cost, reach_cost;
+            int key = x264_slicetype_path_probe( h, frames, paths[path], lo, hi, &cost, NULL, NULL );
+            if( !key )
+            {
+                lo = X264_MIN( lo, cost );
+                hi = X264_MIN( hi, cost );
+                continue;
+            }
+            if( key > 0 && x264_slicetype_path_ready( h, frames, key, reach, reach_size ) )
+                list[ready++] = key;
+            x264_slicetype_path_probe( h, frames, paths[path], 0, 0, &reach_cost, reach, &reach_size );
+            lo = X264_MIN( lo, cost );
+        }
+        if( !ready )
+            break;
+
+        qsort( list, ready, sizeof(int), x264_slicetype_need_cmp );
+        int groups = 0;
+        int size = 0;
+        for( int i = 0; i < ready; i++ )
+        {
+            if( size && list[i] == list[size-1] )
+                continue;
+            if( !size || NEED_B(list[i]) != NEED_B(list[size-1]) )
+                group[groups++] = size;
+            list[size++] = list[i];
+        }
+        group[groups] = size;
+
+        if( groups == 1 )
+        {
+            /* A single frame: spread the rows of each cost over the threads instead. */
+            for( int i = 0; i < size; i++ )
+                x264_slicetype_frame_cost( h, a, frames, NEED_P0(list[i]), NEED_P1(list[i]), NEED_B(list[i]), 0 );
+            continue;
+        }
+
+        /* Weightp analysis of a P cost needs the frame's intra cost, which would otherwise
+         * be spread over the threads from inside the batch. */
+        if( h->param.analyse.i_weighted_pred )
+            for( int i = 0; i < size; i++ )
+            {
+                int b = NEED_B(list[i]);
+                if( b == NEED_P1(list[i]) && !frames[b]->b_intra_calculated )
+                    x264_slicetype_frame_cost( h, a, frames, b, b, b, 0 );
+            }
+
+        int threads = X264_MIN( h->param.i_lookahead_threads, groups );
+        x264_slicetype_batch_t s[X264_LOOKAHEAD_THREAD_MAX];
+        for( int i = 0; i < threads; i++ )
+        {
+            s[i] = (x264_slicetype_batch_t){ i ? h->lookahead_thread[i] : h, a, frames, list, group, groups, i, threads };
+            if( i )
+            {
+                x264_lookahead_thread_sync( s[i].h, h );
+                x264_threadpool_run( h->lookaheadpool, (void*)x264_slicetype_batch_cost, &s[i] );
+            }
+        }
+        x264_slicetype_batch_cost( &s[0] );
+        for( int i = 1; i < threads; i++ )
+            x264_threadpool_wait( h->lookaheadpool, &s[i] );
+    }
+    x264_free( reach );
+}
+
 /* Viterbi/trellis slicetype decision algorithm. */
 /* Uses strings due to the fact that the speed of the control functions is
    negligible compared to the cost of running slicetype_frame_cost, and because
    it makes debugging easier. */
 static void x264_slicetype_path( x264_t *h, x264_mb_analysis_t *a, x264_frame_t **frames, int length, char (*best_paths)[X264_LOOKAHEAD_MAX+1] )
 {
-    char paths[2][X264_LOOKAHEAD_MAX+1];
+    char paths[X264_BFRAME_MAX+1][X264_LOOKAHEAD_MAX+1];
     int num_paths = X264_MIN( h->param.i_bframe+1, length );
     int best_cost = COST_MAX;
-    int idx = 0;
+    int best_path = 0;
 
     /* Iterate over all currently possible paths */
     for( int path = 0; path < num_paths; path++ )
     {
         /* Add suffixes to the current path */
         int len = length - (path + 1);
-        memcpy( paths[idx], best_paths[len % (X264_BFRAME_MAX+1)], len );
-        memset( paths[idx]+len, 'B', path );
-        strcpy( paths[idx]+len+path, "P" );
+        memcpy( paths[path], best_paths[len % (X264_BFRAME_MAX+1)], len );
+        memset( paths[path]+len, 'B', path );
+        strcpy( paths[path]+len+path, "P" );
+    }
+
+    if( h->lookaheadpool )
+        x264_slicetype_path_prepare( h, a, frames, paths, num_paths, length );
 
+    for( int path = 0; path < num_paths; path++ )
+    {
         /* Calculate the actual cost of the current path */
-        int cost = x264_slicetype_path_cost( h, a, frames, paths[idx], best_cost );
+        int cost = x264_slicetype_path_cost( h, a, frames, paths[path], best_cost );
         if( cost < best_cost )
         {
             best_cost = cost;
-            idx ^= 1;
+            best_path = path;
         }
     }
 
     /* Store the best path. */
-    memcpy( best_paths[length % (X264_BFRAME_MAX+1)], paths[idx^1], length );
+    memcpy( best_paths[length % (X264_BFRAME_MAX+1)], paths[best_path], length );
 }
 
 static int scenecut_internal( x264_t *h, x264_mb_analysis_t *a, x264_frame_t **frames, int p0, int p1, int real_scenecut )
@@ -1317,7 +1771,11 @@ void x264_slicetype_analyse( x264_t *h, int keyframe )
     if( !framecnt )
     {
         if( h->param.rc.b_mb_tree )
+        {
+            int64_t stage_start = x264_stage_start( h );
             x264_macroblock_tree( h, &a, frames, 0, keyframe );
+            x264_stage_end( h, X264_STAGE_MBTREE, stage_start );
+        }
         return;
     }
 
@@ -1443,7 +1901,11 @@ void x264_slicetype_analyse( x264_t *h, int keyframe )
     /* Perform the actual macroblock tree analysis.
      * Don't go farther than the maximum keyframe interval; this helps in short GOPs. */
     if( h->param.rc.b_mb_tree )
+    {
+        int64_t stage_start = x264_stage_start( h );
         x264_macroblock_tree( h, &a, frames, X264_MIN(num_frames, h->param.i_keyint_max), keyframe );
+        x264_stage_end( h, X264_STAGE_MBTREE, stage_start );
+    }
 
     /* Enforce keyframe limit. */
     if( !h->param.b_intra_refresh )
@@ -1464,6 +1926,22 @@ void x264_slicetype_analyse( x264_t *h, int keyframe )
         frames[j]->i_type = X264_TYPE_AUTO;
 }
 
+/* Shares the lookahead's time since start out between the frames it was spent
+ * deciding; the part of it in mbtree is what h's total grew by since mbtree_start. */
+void x264_slicetype_stage_time( x264_t *h, x264_frame_t **frames, int count, int64_t start, int64_t mbtree_start )
+{
+    if( !h->param.b_stage_timing )
+        return;
+    int64_t mbtree = h->i_stage_time[X264_STAGE_MBTREE] - mbtree_start;
+    int64_t slicetype = x264_ndate() - start - mbtree;
+    for( int i = 0; i < count; i++ )
+    {
+        frames[i]->i_stage_time[X264_STAGE_SLICETYPE] += slicetype / count;
+        frames[i]->i_stage_time[X264_STAGE_MBTREE] += mbtree / count;
+    }
+    h->i_stage_time[X264_STAGE_MBTREE] = mbtree_start;
+}
+
 void x264_slicetype_decide( x264_t *h )
 {
     x264_frame_t *frames[X264_BFRAME_MAX+2];
@@ -1474,6 +1952,8 @@ void x264_slicetype_decide( x264_t *h )
     if( !h->lookahead->next.i_size )
         return;
 
+    int64_t stage_start = x264_stage_start( h );
+    int64_t mbtree_start = h->i_stage_time[X264_STAGE_MBTREE];
     int lookahead_size = h->lookahead->next.i_size;
 
     for( int i = 0; i < h->lookahead->next.i_size; i++ )
@@ -1685,6 +2165,8 @@ void x264_slicetype_decide( x264_t *h )
         h->lookahead->next.list[0]->f_planned_cpb_duration[i] = (double)h->lookahead->next.list[i]->i_cpb_duration *
                                                                 h->sps->vui.i_num_units_in_tick / h->sps->vui.i_time_scale;
     }
+
+    x264_slicetype_stage_time( h, h->lookahead->next.list, bframes+1, stage_start, mbtree_start );
 }
 
 int x264_rc_analyse_slice( x264_t *h )
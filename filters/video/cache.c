@@ -35,7 +35,8 @@ typedef struct
 
     int max_size;
     int first_frame; /* first cached frame */
-    cli_pic_t **cache;
+    cli_pic_t **cache; /* each cached frame holds a reference to its image */
+    cli_pic_pool_t *pool; /* storage for frames that arrive without a reference */
     int cur_size;
     int eof;         /* frame beyond end of the file */
 } cache_hnd_t;
@@ -59,11 +60,14 @@ static int init( hnd_t *handle, cli_vid_filter_t *filter, video_info_t *info, x2
 
     for( int i = 0; i < h->max_size; i++ )
     {
-        h->cache[i] = malloc( sizeof(cli_pic_t) );
-        if( !h->cache[i] || x264_cli_pic_alloc( h->cache[i], info->csp, info->width, info->height ) )
+        h->cache[i] = calloc( 1, sizeof(cli_pic_t) );
+        if( !h->cache[i] )
             return -1;
     }
     h->cache[h->max_size] = NULL; /* require null terminator for list methods */
+    h->pool = x264_cli_pic_pool_new( info->csp, info->width, info->height );
+    if( !h->pool )
+        return -1;
 
     h->prev_filter = *filter;
     h->prev_hnd = *handle;
@@ -93,12 +97,23 @@ static void fill_cache( cache_hnd_t *h, int frame )
     while( h->cur_size < h->max_size )
     {
         cli_pic_t temp;
-        /* the old front frame is going to shift off, overwrite it with the new frame */
+        /* the old front frame is going to shift off, replace it with the new frame */
         cli_pic_t *cache = h->cache[0];
-        if( h->prev_filter.get_frame( h->prev_hnd, &temp, cur_frame ) ||
-            x264_cli_pic_copy( cache, &temp ) ||
-            h->prev_filter.release_frame( h->prev_hnd, &temp, cur_frame ) )
+        if( h->prev_filter.get_frame( h->prev_hnd, &temp, cur_frame ) )
+        {
+            h->eof = cur_frame;
+            return;
+        }
+        x264_cli_pic_unref( cache );
+        /* keep a reference to shared images, only copy the ones that are reused upstream */
+        int ret = 0;
+        if( temp.buf )
+            x264_cli_pic_ref( cache, &temp );
+        else
+            ret = x264_cli_pic_pool_get( h->pool, cache ) || x264_cli_pic_copy( cache, &temp );
+        if( ret || h->prev_filter.release_frame( h->prev_hnd, &temp, cur_frame ) )
         {
+            x264_cli_pic_unref( cache );
             h->eof = cur_frame;
             return;
         }
@@ -117,13 +132,14 @@ static int get_frame( hnd_t handle, cli_pic_t *output, int frame )
     if( frame > LAST_FRAME ) /* eof */
         return -1;
     int idx = frame - (h->eof ? h->eof - h->max_size : h->first_frame);
-    *output = *h->cache[idx];
+    x264_cli_pic_ref( output, h->cache[idx] );
     return 0;
 }
 
 static int release_frame( hnd_t handle, cli_pic_t *pic, int frame )
 {
-    /* the parent filter's frame has already been released so do nothing here */
+    /* the parent filter's frame has already been released, only drop our reference */
+    x264_cli_pic_unref( pic );
     return 0;
 }
 
@@ -133,10 +149,11 @@ static void free_filter( hnd_t handle )
     h->prev_filter.free( h->prev_hnd );
     for( int i = 0; i < h->max_size; i++ )
     {
-        x264_cli_pic_clean( h->cache[i] );
+        x264_cli_pic_unref( h->cache[i] );
         free( h->cache[i] );
     }
     free( h->cache );
+    x264_cli_pic_pool_delete( h->pool );
     free( h );
 }
 
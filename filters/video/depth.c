@@ -24,6 +24,7 @@
  *****************************************************************************/
 
 #include "video.h"
+#include "internal.h"
 #define NAME "depth"
 #define FAIL_IF_ERROR( cond, ... ) FAIL_IF_ERR( cond, NAME, __VA_ARGS__ )
 
@@ -36,7 +37,7 @@ typedef struct
 
     int bit_depth;
     int dst_csp;
-    cli_pic_t buffer;
+    cli_pic_pool_t *pool; /* storage for output frames */
     int16_t *error_buf;
 } depth_hnd_t;
 
@@ -142,26 +143,36 @@ static void scale_image( cli_image_t *output, cli_image_t *img )
 static int get_frame( hnd_t handle, cli_pic_t *output, int frame )
 {
     depth_hnd_t *h = handle;
+    cli_pic_t in;
 
-    if( h->prev_filter.get_frame( h->prev_hnd, output, frame ) )
+    if( h->prev_filter.get_frame( h->prev_hnd, &in, frame ) )
         return -1;
 
-    if( h->bit_depth < 16 && output->img.csp & X264_CSP_HIGH_DEPTH )
+    int dither = h->bit_depth < 16 && in.img.csp & X264_CSP_HIGH_DEPTH;
+    int scale  = h->bit_depth > 8 && !(in.img.csp & X264_CSP_HIGH_DEPTH);
+    if( !dither && !scale )
     {
-        dither_image( &h->buffer.img, &output->img, h->error_buf );
-        output->img = h->buffer.img;
+        *output = in;
+        return 0;
     }
-    else if( h->bit_depth > 8 && !(output->img.csp & X264_CSP_HIGH_DEPTH) )
-    {
-        scale_image( &h->buffer.img, &output->img );
-        output->img = h->buffer.img;
-    }
-    return 0;
+    if( x264_cli_pic_pool_get( h->pool, output ) )
+        return -1;
+    if( dither )
+        dither_image( &output->img, &in.img, h->error_buf );
+    else
+        scale_image( &output->img, &in.img );
+    return x264_cli_pic_release_input( output, &in, h->prev_hnd, &h->prev_filter, frame );
 }
 
 static int release_frame( hnd_t handle, cli_pic_t *pic, int frame )
 {
     depth_hnd_t *h = handle;
+    /* frames in our own storage have already released their source frame */
+    if( x264_cli_pic_pool_owns( h->pool, pic ) )
+    {
+        x264_cli_pic_unref( pic );
+        return 0;
+    }
     return h->prev_filter.release_frame( h->prev_hnd, pic, frame );
 }
 
@@ -169,7 +180,7 @@ static void free_filter( hnd_t handle )
 {
     depth_hnd_t *h = handle;
     h->prev_filter.free( h->prev_hnd );
-    x264_cli_pic_clean( &h->buffer );
+    x264_cli_pic_pool_delete( h->pool );
     x264_free( h );
 }
 
@@ -218,7 +229,8 @@ static int init( hnd_t *handle, cli_vid_filter_t *filter, video_info_t *info,
         h->prev_hnd = *handle;
         h->prev_filter = *filter;
 
-        if( x264_cli_pic_alloc( &h->buffer, h->dst_csp, info->width, info->height ) )
+        h->pool = x264_cli_pic_pool_new( h->dst_csp, info->width, info->height );
+        if( !h->pool )
         {
             x264_free( h );
             return -1;
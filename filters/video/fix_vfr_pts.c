@@ -39,7 +39,7 @@ typedef struct
     /* we need 1 buffer picture and 1 place holder */
     cli_pic_t buffer;
     cli_pic_t holder;
-    int buffer_allocated;
+    cli_pic_pool_t *pool; /* storage for buffered frames that arrive without a reference */
     int holder_frame;
     int holder_ret;
     int64_t pts;
@@ -88,16 +88,20 @@ static int get_frame( hnd_t handle, cli_pic_t *output, int frame )
     /* if the frame's duration is not set already, read the next frame to set it. */
     if( !h->holder.duration )
     {
-        /* allocate a buffer picture if we didn't already */
-        if( !h->buffer_allocated )
+        h->holder_frame = frame+1;
+        /* keep a reference to the current frame, copying it only if its image is reused upstream,
+         * then release it and read in the next frame to the placeholder */
+        if( h->holder.buf )
+            x264_cli_pic_ref( &h->buffer, &h->holder );
+        else
         {
-            if( x264_cli_pic_alloc( &h->buffer, h->holder.img.csp, h->holder.img.width, h->holder.img.height ) )
+            /* allocate a buffer pool if we didn't already */
+            if( !h->pool && !(h->pool = x264_cli_pic_pool_new( h->holder.img.csp, h->holder.img.width, h->holder.img.height )) )
+                return -1;
+            if( x264_cli_pic_pool_get( h->pool, &h->buffer ) || x264_cli_pic_copy( &h->buffer, &h->holder ) )
                 return -1;
-            h->buffer_allocated = 1;
         }
-        h->holder_frame = frame+1;
-        /* copy the current frame to the buffer, release it, and then read in the next frame to the placeholder */
-        if( x264_cli_pic_copy( &h->buffer, &h->holder ) || h->prev_filter.release_frame( h->prev_hnd, &h->holder, frame ) )
+        if( h->prev_filter.release_frame( h->prev_hnd, &h->holder, frame ) )
             return -1;
         h->holder_ret = h->prev_filter.get_frame( h->prev_hnd, &h->holder, h->holder_frame );
         /* suppress non-monotonic pts warnings by setting the duration to be at least 1 */
@@ -118,9 +122,12 @@ static int get_frame( hnd_t handle, cli_pic_t *output, int frame )
 static int release_frame( hnd_t handle, cli_pic_t *pic, int frame )
 {
     fix_vfr_pts_hnd_t *h = handle;
-    /* if the frame is the buffered one, it's already been released */
+    /* if the frame is the buffered one, it's already been released upstream */
     if( frame == (h->holder_frame - 1) )
+    {
+        x264_cli_pic_unref( pic );
         return 0;
+    }
     return h->prev_filter.release_frame( h->prev_hnd, pic, frame );
 }
 
@@ -128,8 +135,7 @@ static void free_filter( hnd_t handle )
 {
     fix_vfr_pts_hnd_t *h = handle;
     h->prev_filter.free( h->prev_hnd );
-    if( h->buffer_allocated )
-        x264_cli_pic_clean( &h->buffer );
+    x264_cli_pic_pool_delete( h->pool );
     free( h );
 }
 
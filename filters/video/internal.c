@@ -57,3 +57,152 @@ int x264_cli_pic_copy( cli_pic_t *out, cli_pic_t *in )
     }
     return 0;
 }
+
+struct cli_pic_pool_t
+{
+    int csp;
+    int width;
+    int height;
+    int outstanding;      /* buffers currently referenced */
+    int closed;           /* owner is gone, free buffers once they are unreferenced */
+    cli_pic_buf_t *free_list;
+    x264_pthread_mutex_t mutex;
+};
+
+cli_pic_pool_t *x264_cli_pic_pool_new( int csp, int width, int height )
+{
+    cli_pic_pool_t *pool = calloc( 1, sizeof(cli_pic_pool_t) );
+    if( !pool )
+        return NULL;
+    pool->csp    = csp;
+    pool->width  = width;
+    pool->height = height;
+    if( x264_pthread_mutex_init( &pool->mutex, NULL ) )
+    {
+        free( pool );
+        return NULL;
+    }
+    return pool;
+}
+
+static void pic_buf_free( cli_pic_buf_t *buf )
+{
+    cli_pic_t pic = { buf->img };
+    x264_cli_pic_clean( &pic );
+    free( buf );
+}
+
+static void pic_pool_free( cli_pic_pool_t *pool )
+{
+    x264_pthread_mutex_destroy( &pool->mutex );
+    free( pool );
+}
+
+void x264_cli_pic_pool_delete( cli_pic_pool_t *pool )
+{
+    if( !pool )
+        return;
+    x264_pthread_mutex_lock( &pool->mutex );
+    while( pool->free_list )
+    {
+        cli_pic_buf_t *buf = pool->free_list;
+        pool->free_list = buf->next;
+        pic_buf_free( buf );
+    }
+    pool->closed = 1;
+    int outstanding = pool->outstanding;
+    x264_pthread_mutex_unlock( &pool->mutex );
+    if( !outstanding )
+        pic_pool_free( pool );
+}
+
+int x264_cli_pic_pool_get( cli_pic_pool_t *pool, cli_pic_t *pic )
+{
+    x264_pthread_mutex_lock( &pool->mutex );
+    cli_pic_buf_t *buf = pool->free_list;
+    if( buf )
+        pool->free_list = buf->next;
+    pool->outstanding++;
+    x264_pthread_mutex_unlock( &pool->mutex );
+
+    if( !buf )
+    {
+        cli_pic_t tmp;
+        buf = calloc( 1, sizeof(cli_pic_buf_t) );
+        if( !buf || x264_cli_pic_alloc( &tmp, pool->csp, pool->width, pool->height ) )
+        {
+            free( buf );
+            x264_pthread_mutex_lock( &pool->mutex );
+            pool->outstanding--;
+            x264_pthread_mutex_unlock( &pool->mutex );
+            return -1;
+        }
+        buf->pool = pool;
+        buf->img  = tmp.img;
+    }
+    buf->refs = 1;
+    buf->next = NULL;
+    memset( pic, 0, sizeof(cli_pic_t) );
+    pic->img = buf->img;
+    pic->buf = buf;
+    return 0;
+}
+
+void x264_cli_pic_ref( cli_pic_t *dst, cli_pic_t *src )
+{
+    if( src->buf )
+    {
+        x264_pthread_mutex_lock( &src->buf->pool->mutex );
+        src->buf->refs++;
+        x264_pthread_mutex_unlock( &src->buf->pool->mutex );
+    }
+    *dst = *src;
+}
+
+void x264_cli_pic_unref( cli_pic_t *pic )
+{
+    cli_pic_buf_t *buf = pic->buf;
+    if( !buf )
+        return;
+    pic->buf = NULL;
+    cli_pic_pool_t *pool = buf->pool;
+    x264_pthread_mutex_lock( &pool->mutex );
+    if( --buf->refs )
+    {
+        x264_pthread_mutex_unlock( &pool->mutex );
+        return;
+    }
+    int release_pool = 0;
+    pool->outstanding--;
+    if( pool->closed )
+    {
+        pic_buf_free( buf );
+        release_pool = !pool->outstanding;
+    }
+    else
+    {
+        buf->next = pool->free_list;
+        pool->free_list = buf;
+    }
+    x264_pthread_mutex_unlock( &pool->mutex );
+    if( release_pool )
+        pic_pool_free( pool );
+}
+
+int x264_cli_pic_pool_owns( cli_pic_pool_t *pool, cli_pic_t *pic )
+{
+    return pool && pic->buf && pic->buf->pool == pool;
+}
+
+int x264_cli_pic_release_input( cli_pic_t *out, cli_pic_t *in, hnd_t prev_hnd, cli_vid_filter_t *prev_filter, int frame )
+{
+    out->pts      = in->pts;
+    out->duration = in->duration;
+    out->opaque   = in->opaque;
+    if( prev_filter->release_frame( prev_hnd, in, frame ) )
+    {
+        x264_cli_pic_unref( out );
+        return -1;
+    }
+    return 0;
+}
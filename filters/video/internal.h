@@ -27,7 +27,34 @@
 #define X264_FILTER_VIDEO_INTERNAL_H
 #include "video.h"
 
+typedef struct cli_pic_pool_t cli_pic_pool_t;
+
+/* image storage shared between filters. a filter that receives a picture with a buf
+ * from get_frame owns one reference to it, which it gives back through release_frame.
+ * filters that need the image for longer take a reference of their own instead of copying. */
+struct cli_pic_buf_t
+{
+    int refs;
+    cli_pic_pool_t *pool;
+    cli_image_t img;
+    cli_pic_buf_t *next;
+};
+
 void x264_cli_plane_copy( uint8_t *dst, int i_dst, uint8_t *src, int i_src, int w, int h );
 int  x264_cli_pic_copy( cli_pic_t *out, cli_pic_t *in );
 
+cli_pic_pool_t *x264_cli_pic_pool_new( int csp, int width, int height );
+void x264_cli_pic_pool_delete( cli_pic_pool_t *pool );
+int  x264_cli_pic_pool_get( cli_pic_pool_t *pool, cli_pic_t *pic );
+void x264_cli_pic_ref( cli_pic_t *dst, cli_pic_t *src );
+void x264_cli_pic_unref( cli_pic_t *pic );
+int  x264_cli_pic_pool_owns( cli_pic_pool_t *pool, cli_pic_t *pic );
+/* for filters that produced out in storage of their own from in:
+ * copies the frame properties over and releases in from the previous filter */
+int  x264_cli_pic_release_input( cli_pic_t *out, cli_pic_t *in, hnd_t prev_hnd, cli_vid_filter_t *prev_filter, int frame );
+
+/* appends a stage to pipeline that runs the chain so far on a thread of its own,
+ * queueing up to pipeline->queue_size of its frames */
+int  x264_pipe_filter_init( hnd_t *handle, cli_vid_filter_t *filter, video_info_t *info, cli_vid_pipeline_t *pipeline );
+
 #endif
@@ -0,0 +1,252 @@
+/*****************************************************************************
+ * pipe.c: threaded pipeline stage video filter
+ *****************************************************************************
+ * Copyright (C) 2011 x264 project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at licensing@x264.com.
+ *****************************************************************************/
+
+#include "video.h"
+#include "internal.h"
+#define NAME "pipe"
+#define FAIL_IF_ERROR( cond, ... ) FAIL_IF_ERR( cond, NAME, __VA_ARGS__ )
+
+/* This filter runs the previous filters on a thread of its own, reading frames ahead
+ * in order into a bounded queue. The previous filters are only ever called from that
+ * thread: frames are queued as references and released upstream right away, so the
+ * next stage only drops its references when it is done with them. */
+
+typedef struct
+{
+    cli_pic_t pic;
+    int frame;
+} pipe_entry_t;
+
+typedef struct
+{
+    hnd_t prev_hnd;
+    cli_vid_filter_t prev_filter;
+
+    cli_pic_pool_t *pool; /* storage for frames that arrive without a reference */
+    x264_pthread_t thread;
+    int thread_running;
+    x264_pthread_mutex_t mutex;
+    x264_pthread_cond_t cv_fill;  /* frames were added to the queue */
+    x264_pthread_cond_t cv_empty; /* frames were removed from the queue */
+    pipe_entry_t *queue;
+    int size;
+    int head;
+    int count;
+    int next_frame;               /* next frame to be read by the thread */
+    int eof;                      /* the thread has stopped reading */
+    int exit;
+    cli_vid_stage_stats_t stats;
+    cli_vid_pipeline_t *pipeline; /* the chain's pipeline, which lists this stage */
+} pipe_hnd_t;
+
+static cli_vid_filter_t pipe_filter;
+
+int x264_pipe_filter_init( hnd_t *handle, cli_vid_filter_t *filter, video_info_t *info, cli_vid_pipeline_t *pipeline )
+{
+    int slot = 0;
+    while( slot < MAX_PIPELINE_STAGES && pipeline->stage[slot] )
+        slot++;
+    /* past the limit the chain just isn't decoupled any further */
+    if( slot == MAX_PIPELINE_STAGES )
+        return 0;
+
+    pipe_hnd_t *h = calloc( 1, sizeof(pipe_hnd_t) );
+    if( !h )
+        goto fail;
+    h->size = pipeline->queue_size;
+    h->queue = calloc( h->size, sizeof(pipe_entry_t) );
+    h->pool = x264_cli_pic_pool_new( info->csp, info->width, info->height );
+    if( !h->queue || !h->pool ||
+        x264_pthread_mutex_init( &h->mutex, NULL ) ||
+        x264_pthread_cond_init( &h->cv_fill, NULL ) ||
+        x264_pthread_cond_init( &h->cv_empty, NULL ) )
+        goto fail;
+    h->stats.name = filter->name;
+    h->pipeline = pipeline;
+    pipeline->stage[slot] = h;
+
+    h->prev_filter = *filter;
+    h->prev_hnd = *handle;
+    *handle = h;
+    *filter = pipe_filter;
+
+    return 0;
+fail:
+    if( h )
+    {
+        if( h->pool )
+            x264_cli_pic_pool_delete( h->pool );
+        free( h->queue );
+        free( h );
+    }
+    x264_cli_log( NAME, X264_LOG_ERROR, "failed to create a pipeline stage\n" );
+    return -1;
+}
+
+static void *pipe_thread( pipe_hnd_t *h )
+{
+    while( 1 )
+    {
+        int64_t wait_start = x264_mdate();
+        x264_pthread_mutex_lock( &h->mutex );
+        while( h->count == h->size && !h->exit )
+            x264_pthread_cond_wait( &h->cv_empty, &h->mutex );
+        int frame = h->next_frame++;
+        int stop = h->exit;
+        x264_pthread_mutex_unlock( &h->mutex );
+        if( stop )
+            break;
+
+        int64_t work_start = x264_mdate();
+        cli_pic_t in, pic = { .buf = NULL };
+        int ret = h->prev_filter.get_frame( h->prev_hnd, &in, frame );
+        if( !ret )
+        {
+            /* keep a reference to shared images, only copy the ones that are reused upstream */
+            if( in.buf )
+                x264_cli_pic_ref( &pic, &in );
+            else if( !(ret = x264_cli_pic_pool_get( h->pool, &pic )) )
+                ret = x264_cli_pic_copy( &pic, &in );
+            ret |= h->prev_filter.release_frame( h->prev_hnd, &in, frame );
+            if( ret )
+                x264_cli_pic_unref( &pic );
+        }
+        int64_t work_end = x264_mdate();
+
+        x264_pthread_mutex_lock( &h->mutex );
+        h->stats.blocked += work_start - wait_start;
+        h->stats.busy += work_end - work_start;
+        if( ret )
+        {
+            h->eof = 1;
+            x264_pthread_cond_broadcast( &h->cv_fill );
+            x264_pthread_mutex_unlock( &h->mutex );
+            break;
+        }
+        pipe_entry_t *entry = &h->queue[(h->head + h->count) % h->size];
+        entry->pic = pic;
+        entry->frame = frame;
+        h->count++;
+        h->stats.frames++;
+        x264_pthread_cond_broadcast( &h->cv_fill );
+        x264_pthread_mutex_unlock( &h->mutex );
+    }
+    return NULL;
+}
+
+static int get_frame( hnd_t handle, cli_pic_t *output, int frame )
+{
+    pipe_hnd_t *h = handle;
+    if( !h->thread_running )
+    {
+        /* start reading at the first requested frame, which is not necessarily the first one */
+        h->next_frame = frame;
+        FAIL_IF_ERROR( x264_pthread_create( &h->thread, NULL, (void*)pipe_thread, h ), "failed to create thread\n" )
+        h->thread_running = 1;
+    }
+
+    int ret = -1;
+    int64_t wait_start = x264_mdate();
+    x264_pthread_mutex_lock( &h->mutex );
+    /* frames that are skipped over do not need to be read at all */
+    if( h->next_frame < frame )
+        h->next_frame = frame;
+    while( 1 )
+    {
+        while( !h->count && !h->eof )
+            x264_pthread_cond_wait( &h->cv_fill, &h->mutex );
+        if( !h->count )
+            break;
+        pipe_entry_t *entry = &h->queue[h->head];
+        h->head = (h->head + 1) % h->size;
+        h->count--;
+        x264_pthread_cond_broadcast( &h->cv_empty );
+        if( entry->frame == frame )
+        {
+            *output = entry->pic;
+            ret = 0;
+            break;
+        }
+        x264_cli_pic_unref( &entry->pic );
+        /* do not allow requesting of frames from before the current position */
+        if( entry->frame > frame )
+            break;
+    }
+    h->stats.starved += x264_mdate() - wait_start;
+    x264_pthread_mutex_unlock( &h->mutex );
+    return ret;
+}
+
+static int release_frame( hnd_t handle, cli_pic_t *pic, int frame )
+{
+    /* the previous filter's frame has already been released, only drop our reference */
+    x264_cli_pic_unref( pic );
+    return 0;
+}
+
+static void free_filter( hnd_t handle )
+{
+    pipe_hnd_t *h = handle;
+    x264_pthread_mutex_lock( &h->mutex );
+    h->exit = 1;
+    x264_pthread_cond_broadcast( &h->cv_empty );
+    x264_pthread_mutex_unlock( &h->mutex );
+    if( h->thread_running )
+        x264_pthread_join( h->thread, NULL );
+    for( ; h->count; h->count--, h->head = (h->head + 1) % h->size )
+        x264_cli_pic_unref( &h->queue[h->head].pic );
+
+    for( int i = 0; i < MAX_PIPELINE_STAGES; i++ )
+        if( h->pipeline->stage[i] == h )
+            h->pipeline->stage[i] = NULL;
+
+    /* free the previous stages first so that the summary lists stages in pipeline order */
+    h->prev_filter.free( h->prev_hnd );
+    x264_cli_log( "pipeline", X264_LOG_INFO, "%-12s %6d frames, busy %.2fs, waiting for room %.2fs, next stage waiting %.2fs\n",
+                  h->stats.name, h->stats.frames, h->stats.busy / 1e6, h->stats.blocked / 1e6, h->stats.starved / 1e6 );
+    x264_pthread_cond_destroy( &h->cv_fill );
+    x264_pthread_cond_destroy( &h->cv_empty );
+    x264_pthread_mutex_destroy( &h->mutex );
+    x264_cli_pic_pool_delete( h->pool );
+    free( h->queue );
+    free( h );
+}
+
+int x264_vid_pipeline_stats( cli_vid_pipeline_t *pipeline, cli_vid_stage_stats_t *stats, int max )
+{
+    int n = 0;
+    for( int i = 0; i < MAX_PIPELINE_STAGES && n < max; i++ )
+        if( pipeline->stage[i] )
+        {
+            pipe_hnd_t *h = pipeline->stage[i];
+            x264_pthread_mutex_lock( &h->mutex );
+            stats[n] = h->stats;
+            stats[n].queued = h->count;
+            x264_pthread_mutex_unlock( &h->mutex );
+            n++;
+        }
+    return n;
+}
+
+/* not registered as a user filter: stages are only added by x264_init_vid_filter_pipelined */
+static cli_vid_filter_t pipe_filter = { NAME, NULL, NULL, get_frame, release_frame, free_filter, NULL };
@@ -24,6 +24,7 @@
  *****************************************************************************/
 
 #include "video.h"
+#include "internal.h"
 #define NAME "resize"
 #define FAIL_IF_ERROR( cond, ... ) FAIL_IF_ERR( cond, NAME, __VA_ARGS__ )
 
@@ -43,6 +44,7 @@ static int full_check( video_info_t *info, x264_param_t *param )
 #include <libswscale/swscale.h>
 #include <libavutil/opt.h>
 #include <libavutil/pixdesc.h>
+#endif
 
 typedef struct
 {
@@ -51,14 +53,43 @@ typedef struct
     int pix_fmt;
 } frame_prop_t;
 
+#if !HAVE_SWSCALE
+enum
+{
+    RESIZE_POINT,
+    RESIZE_BILINEAR,
+    RESIZE_BICUBIC,
+    RESIZE_LANCZOS
+};
+
+typedef struct
+{
+    int taps;        /* number of source samples contributing to each output sample */
+    int *pos;        /* first source sample of each output sample */
+    int16_t *coef;   /* taps coefficients per output sample */
+    int32_t *vcoef;  /* the same, interleaved per group of 4 output samples: [x/4][tap][x%4] */
+} scale_filter_t;
+
+typedef struct
+{
+    int src_plane, src_pitch, src_offset;
+    int dst_plane, dst_pitch, dst_offset;
+    int src_width, src_height;
+    int dst_width, dst_height;
+    int copy;        /* plane can be copied as is */
+    scale_filter_t hfilter;
+    scale_filter_t vfilter;
+} component_t;
+#endif
+
 typedef struct
 {
     hnd_t prev_hnd;
     cli_vid_filter_t prev_filter;
 
-    cli_pic_t buffer;
-    int buffer_allocated;
+    cli_pic_pool_t *pool; /* storage for output frames */
     int dst_csp;
+#if HAVE_SWSCALE
     struct SwsContext *ctx;
     uint32_t ctx_flags;
     /* state of swapping chroma planes pre and post resize */
@@ -66,8 +97,18 @@ typedef struct
     int post_swap_chroma;
     int variable_input; /* input is capable of changing properties */
     int working;        /* we have already started working with frames */
-    frame_prop_t dst;   /* desired output properties */
     frame_prop_t scale; /* properties of the SwsContext input */
+#else
+    int method;
+    int passthrough;    /* only the order of the planes changes */
+    component_t comp[3];
+    int32_t *ring;      /* horizontally scaled lines awaiting the vertical pass */
+    int ring_stride;
+    int32_t **lines;
+    int32_t *acc;
+    frame_prop_t src;   /* expected input properties */
+#endif
+    frame_prop_t dst;   /* desired output properties */
 } resizer_hnd_t;
 
 static void help( int longhelp )
@@ -95,109 +136,12 @@ static void help( int longhelp )
             "               - depth: 8 or 16 bits per pixel [keep current]\n"
             "            note: not all depths are supported by all csps.\n"
             "            - method: use resizer method [\"bicubic\"]\n"
+#if HAVE_SWSCALE
             "               - fastbilinear, bilinear, bicubic, experimental, point,\n"
             "               - area, bicublin, gauss, sinc, lanczos, spline\n" );
-}
-
-static uint32_t convert_method_to_flag( const char *name )
-{
-    uint32_t flag = 0;
-    if( !strcasecmp( name, "fastbilinear" ) )
-        flag = SWS_FAST_BILINEAR;
-    else if( !strcasecmp( name, "bilinear" ) )
-        flag = SWS_BILINEAR;
-    else if( !strcasecmp( name, "bicubic" ) )
-        flag = SWS_BICUBIC;
-    else if( !strcasecmp( name, "experimental" ) )
-        flag = SWS_X;
-    else if( !strcasecmp( name, "point" ) )
-        flag = SWS_POINT;
-    else if( !strcasecmp( name, "area" ) )
-        flag = SWS_AREA;
-    else if( !strcasecmp( name, "bicublin" ) )
-        flag = SWS_BICUBLIN;
-    else if( !strcasecmp( name, "guass" ) )
-        flag = SWS_GAUSS;
-    else if( !strcasecmp( name, "sinc" ) )
-        flag = SWS_SINC;
-    else if( !strcasecmp( name, "lanczos" ) )
-        flag = SWS_LANCZOS;
-    else if( !strcasecmp( name, "spline" ) )
-        flag = SWS_SPLINE;
-    else // default
-        flag = SWS_BICUBIC;
-    return flag;
-}
-
-static int convert_csp_to_pix_fmt( int csp )
-{
-    if( csp&X264_CSP_OTHER )
-        return csp&X264_CSP_MASK;
-    switch( csp&X264_CSP_MASK )
-    {
-        case X264_CSP_YV12: /* specially handled via swapping chroma */
-        case X264_CSP_I420: return csp&X264_CSP_HIGH_DEPTH ? PIX_FMT_YUV420P16 : PIX_FMT_YUV420P;
-        case X264_CSP_YV16: /* specially handled via swapping chroma */
-        case X264_CSP_I422: return csp&X264_CSP_HIGH_DEPTH ? PIX_FMT_YUV422P16 : PIX_FMT_YUV422P;
-        case X264_CSP_YV24: /* specially handled via swapping chroma */
-        case X264_CSP_I444: return csp&X264_CSP_HIGH_DEPTH ? PIX_FMT_YUV444P16 : PIX_FMT_YUV444P;
-        case X264_CSP_RGB:  return csp&X264_CSP_HIGH_DEPTH ? PIX_FMT_RGB48     : PIX_FMT_RGB24;
-        /* the next 3 csps have no equivalent 16bit depth in swscale */
-        case X264_CSP_NV12: return csp&X264_CSP_HIGH_DEPTH ? PIX_FMT_NONE      : PIX_FMT_NV12;
-        case X264_CSP_BGR:  return csp&X264_CSP_HIGH_DEPTH ? PIX_FMT_NONE      : PIX_FMT_BGR24;
-        case X264_CSP_BGRA: return csp&X264_CSP_HIGH_DEPTH ? PIX_FMT_NONE      : PIX_FMT_BGRA;
-        default:            return PIX_FMT_NONE;
-    }
-}
-
-static int pick_closest_supported_csp( int csp )
-{
-    int pix_fmt = convert_csp_to_pix_fmt( csp );
-    switch( pix_fmt )
-    {
-        case PIX_FMT_YUV420P16LE:
-        case PIX_FMT_YUV420P16BE:
-            return X264_CSP_I420 | X264_CSP_HIGH_DEPTH;
-        case PIX_FMT_YUV422P:
-        case PIX_FMT_YUYV422:
-        case PIX_FMT_UYVY422:
-        case PIX_FMT_YUVJ422P:
-            return X264_CSP_I422;
-        case PIX_FMT_YUV422P16LE:
-        case PIX_FMT_YUV422P16BE:
-            return X264_CSP_I422 | X264_CSP_HIGH_DEPTH;
-        case PIX_FMT_YUV444P:
-        case PIX_FMT_YUVJ444P:
-            return X264_CSP_I444;
-        case PIX_FMT_YUV444P16LE:
-        case PIX_FMT_YUV444P16BE:
-            return X264_CSP_I444 | X264_CSP_HIGH_DEPTH;
-        case PIX_FMT_RGB24:
-        case PIX_FMT_RGB565BE:
-        case PIX_FMT_RGB565LE:
-        case PIX_FMT_RGB555BE:
-        case PIX_FMT_RGB555LE:
-            return X264_CSP_RGB;
-        case PIX_FMT_RGB48BE:
-        case PIX_FMT_RGB48LE:
-            return X264_CSP_RGB | X264_CSP_HIGH_DEPTH;
-        case PIX_FMT_BGR24:
-        case PIX_FMT_BGR565BE:
-        case PIX_FMT_BGR565LE:
-        case PIX_FMT_BGR555BE:
-        case PIX_FMT_BGR555LE:
-            return X264_CSP_BGR;
-        case PIX_FMT_ARGB:
-        case PIX_FMT_RGBA:
-        case PIX_FMT_ABGR:
-        case PIX_FMT_BGRA:
-            return X264_CSP_BGRA;
-        case PIX_FMT_NV12:
-        case PIX_FMT_NV21:
-             return X264_CSP_NV12;
-        default:
-            return X264_CSP_I420;
-    }
+#else
+            "               - point, bilinear, bicubic, lanczos\n" );
+#endif
 }
 
 static int handle_opts( const char **optlist, char **opts, video_info_t *info, resizer_hnd_t *h )
@@ -343,6 +287,108 @@ static int handle_opts( const char **optlist, char **opts, video_info_t *info, r
     return 0;
 }
 
+#if HAVE_SWSCALE
+static uint32_t convert_method_to_flag( const char *name )
+{
+    uint32_t flag = 0;
+    if( !strcasecmp( name, "fastbilinear" ) )
+        flag = SWS_FAST_BILINEAR;
+    else if( !strcasecmp( name, "bilinear" ) )
+        flag = SWS_BILINEAR;
+    else if( !strcasecmp( name, "bicubic" ) )
+        flag = SWS_BICUBIC;
+    else if( !strcasecmp( name, "experimental" ) )
+        flag = SWS_X;
+    else if( !strcasecmp( name, "point" ) )
+        flag = SWS_POINT;
+    else if( !strcasecmp( name, "area" ) )
+        flag = SWS_AREA;
+    else if( !strcasecmp( name, "bicublin" ) )
+        flag = SWS_BICUBLIN;
+    else if( !strcasecmp( name, "guass" ) )
+        flag = SWS_GAUSS;
+    else if( !strcasecmp( name, "sinc" ) )
+        flag = SWS_SINC;
+    else if( !strcasecmp( name, "lanczos" ) )
+        flag = SWS_LANCZOS;
+    else if( !strcasecmp( name, "spline" ) )
+        flag = SWS_SPLINE;
+    else // default
+        flag = SWS_BICUBIC;
+    return flag;
+}
+
+static int convert_csp_to_pix_fmt( int csp )
+{
+    if( csp&X264_CSP_OTHER )
+        return csp&X264_CSP_MASK;
+    switch( csp&X264_CSP_MASK )
+    {
+        case X264_CSP_YV12: /* specially handled via swapping chroma */
+        case X264_CSP_I420: return csp&X264_CSP_HIGH_DEPTH ? PIX_FMT_YUV420P16 : PIX_FMT_YUV420P;
+        case X264_CSP_YV16: /* specially handled via swapping chroma */
+        case X264_CSP_I422: return csp&X264_CSP_HIGH_DEPTH ? PIX_FMT_YUV422P16 : PIX_FMT_YUV422P;
+        case X264_CSP_YV24: /* specially handled via swapping chroma */
+        case X264_CSP_I444: return csp&X264_CSP_HIGH_DEPTH ? PIX_FMT_YUV444P16 : PIX_FMT_YUV444P;
+        case X264_CSP_RGB:  return csp&X264_CSP_HIGH_DEPTH ? PIX_FMT_RGB48     : PIX_FMT_RGB24;
+        /* the next 3 csps have no equivalent 16bit depth in swscale */
+        case X264_CSP_NV12: return csp&X264_CSP_HIGH_DEPTH ? PIX_FMT_NONE      : PIX_FMT_NV12;
+        case X264_CSP_BGR:  return csp&X264_CSP_HIGH_DEPTH ? PIX_FMT_NONE      : PIX_FMT_BGR24;
+        case X264_CSP_BGRA: return csp&X264_CSP_HIGH_DEPTH ? PIX_FMT_NONE      : PIX_FMT_BGRA;
+        default:            return PIX_FMT_NONE;
+    }
+}
+
+static int pick_closest_supported_csp( int csp )
+{
+    int pix_fmt = convert_csp_to_pix_fmt( csp );
+    switch( pix_fmt )
+    {
+        case PIX_FMT_YUV420P16LE:
+        case PIX_FMT_YUV420P16BE:
+            return X264_CSP_I420 | X264_CSP_HIGH_DEPTH;
+        case PIX_FMT_YUV422P:
+        case PIX_FMT_YUYV422:
+        case PIX_FMT_UYVY422:
+        case PIX_FMT_YUVJ422P:
+            return X264_CSP_I422;
+        case PIX_FMT_YUV422P16LE:
+        case PIX_FMT_YUV422P16BE:
+            return X264_CSP_I422 | X264_CSP_HIGH_DEPTH;
+        case PIX_FMT_YUV444P:
+        case PIX_FMT_YUVJ444P:
+            return X264_CSP_I444;
+        case PIX_FMT_YUV444P16LE:
+        case PIX_FMT_YUV444P16BE:
+            return X264_CSP_I444 | X264_CSP_HIGH_DEPTH;
+        case PIX_FMT_RGB24:
+        case PIX_FMT_RGB565BE:
+        case PIX_FMT_RGB565LE:
+        case PIX_FMT_RGB555BE:
+        case PIX_FMT_RGB555LE:
+            return X264_CSP_RGB;
+        case PIX_FMT_RGB48BE:
+        case PIX_FMT_RGB48LE:
+            return X264_CSP_RGB | X264_CSP_HIGH_DEPTH;
+        case PIX_FMT_BGR24:
+        case PIX_FMT_BGR565BE:
+        case PIX_FMT_BGR565LE:
+        case PIX_FMT_BGR555BE:
+        case PIX_FMT_BGR555LE:
+            return X264_CSP_BGR;
+        case PIX_FMT_ARGB:
+        case PIX_FMT_RGBA:
+        case PIX_FMT_ABGR:
+        case PIX_FMT_BGRA:
+            return X264_CSP_BGRA;
+        case PIX_FMT_NV12:
+        case PIX_FMT_NV21:
+             return X264_CSP_NV12;
+        default:
+            return X264_CSP_I420;
+    }
+}
+
 static int handle_jpeg( int *format )
 {
     switch( *format )
@@ -408,11 +454,11 @@ static int check_resizer( resizer_hnd_t *h, cli_pic_t *in )
     if( h->ctx || h->working )
         x264_cli_log( NAME, X264_LOG_WARNING, "stream properties changed at pts %"PRId64"\n", in->pts );
     h->scale = input_prop;
-    if( !h->buffer_allocated )
+    if( !h->pool )
     {
-        if( x264_cli_pic_alloc( &h->buffer, h->dst_csp, h->dst.width, h->dst.height ) )
+        h->pool = x264_cli_pic_pool_new( h->dst_csp, h->dst.width, h->dst.height );
+        if( !h->pool )
             return -1;
-        h->buffer_allocated = 1;
     }
     FAIL_IF_ERROR( x264_init_sws_context( h ), "swscale init failed\n" )
     return 0;
@@ -526,70 +572,493 @@ static int init( hnd_t *handle, cli_vid_filter_t *filter, video_info_t *info, x2
 static int get_frame( hnd_t handle, cli_pic_t *output, int frame )
 {
     resizer_hnd_t *h = handle;
-    if( h->prev_filter.get_frame( h->prev_hnd, output, frame ) )
+    cli_pic_t in;
+    if( h->prev_filter.get_frame( h->prev_hnd, &in, frame ) )
         return -1;
-    if( h->variable_input && check_resizer( h, output ) )
+    if( h->variable_input && check_resizer( h, &in ) )
         return -1;
     h->working = 1;
     if( h->pre_swap_chroma )
-        XCHG( uint8_t*, output->img.plane[1], output->img.plane[2] );
+        XCHG( uint8_t*, in.img.plane[1], in.img.plane[2] );
     if( h->ctx )
     {
-        sws_scale( h->ctx, (const uint8_t* const*)output->img.plane, output->img.stride,
-                   0, output->img.height, h->buffer.img.plane, h->buffer.img.stride );
-        output->img = h->buffer.img; /* copy img data */
+        if( x264_cli_pic_pool_get( h->pool, output ) )
+            return -1;
+        sws_scale( h->ctx, (const uint8_t* const*)in.img.plane, in.img.stride,
+                   0, in.img.height, output->img.plane, output->img.stride );
+        /* the scaled frame has its own storage, so the source frame can go */
+        if( x264_cli_pic_release_input( output, &in, h->prev_hnd, &h->prev_filter, frame ) )
+            return -1;
     }
     else
+    {
+        *output = in;
         output->img.csp = h->dst_csp;
+    }
     if( h->post_swap_chroma )
         XCHG( uint8_t*, output->img.plane[1], output->img.plane[2] );
 
     return 0;
 }
 
-static int release_frame( hnd_t handle, cli_pic_t *pic, int frame )
-{
-    resizer_hnd_t *h = handle;
-    return h->prev_filter.release_frame( h->prev_hnd, pic, frame );
-}
-
 static void free_filter( hnd_t handle )
 {
     resizer_hnd_t *h = handle;
     h->prev_filter.free( h->prev_hnd );
     if( h->ctx )
         sws_freeContext( h->ctx );
-    if( h->buffer_allocated )
-        x264_cli_pic_clean( &h->buffer );
+    x264_cli_pic_pool_delete( h->pool );
     free( h );
 }
 
 #else /* no swscale */
+
+/* builtin resizer: separable fixed-point filters over planar and semi-planar yuv.
+ * coefficients are 2.14 fixed point and each output sample is computed in two passes,
+ * a horizontal pass into a small ring of 32-bit lines and a vertical pass out of it. */
+
+#define COEF_SHIFT 14
+
+static uint32_t convert_method_to_flag( const char *name )
+{
+    if( !strcasecmp( name, "point" ) )
+        return RESIZE_POINT;
+    else if( !strcasecmp( name, "fastbilinear" ) || !strcasecmp( name, "bilinear" ) )
+        return RESIZE_BILINEAR;
+    else if( !strcasecmp( name, "lanczos" ) )
+        return RESIZE_LANCZOS;
+    else // default
+        return RESIZE_BICUBIC;
+}
+
+static int native_csp_is_supported( int csp )
+{
+    int csp_mask = csp & X264_CSP_MASK;
+    return !(csp & X264_CSP_OTHER) && csp_mask >= X264_CSP_I420 && csp_mask <= X264_CSP_YV24;
+}
+
+/* locate component c (0=y, 1=u, 2=v) of the given csp */
+static void get_component( int csp, int c, int *plane, int *pitch, int *offset )
+{
+    int csp_mask = csp & X264_CSP_MASK;
+    int swap = csp_mask == X264_CSP_YV12 || csp_mask == X264_CSP_YV16 || csp_mask == X264_CSP_YV24;
+    int interleaved = csp_mask == X264_CSP_NV12 || csp_mask == X264_CSP_NV16;
+    *plane  = c && swap ? 3-c : c;
+    *pitch  = 1;
+    *offset = 0;
+    if( c && interleaved )
+    {
+        *plane  = 1;
+        *pitch  = 2;
+        *offset = c-1;
+    }
+}
+
+static double filter_kernel( int method, double x )
+{
+    x = fabs( x );
+    switch( method )
+    {
+        case RESIZE_BILINEAR:
+            return x < 1 ? 1 - x : 0;
+        case RESIZE_LANCZOS:
+            if( x < 1e-8 )
+                return 1;
+            if( x >= 3 )
+                return 0;
+            return 3 * sin( M_PI * x ) * sin( M_PI * x / 3 ) / (M_PI * M_PI * x * x);
+        default: /* bicubic with B=0, C=0.6, as in swscale */
+        {
+            const double c = 0.6;
+            if( x < 1 )
+                return (2 - c) * x*x*x - (3 - c) * x*x + 1;
+            if( x < 2 )
+                return -c * x*x*x + 5*c * x*x - 8*c * x + 4*c;
+            return 0;
+        }
+    }
+}
+
+static int init_scale_filter( scale_filter_t *f, int method, int src_size, int dst_size )
+{
+    static const double support[] = { [RESIZE_POINT] = 0.5, [RESIZE_BILINEAR] = 1, [RESIZE_BICUBIC] = 2, [RESIZE_LANCZOS] = 3 };
+    double scale = (double)src_size / dst_size;
+    double fscale = X264_MAX( scale, 1.0 );
+    int raw_taps = method == RESIZE_POINT || src_size == dst_size ? 1 : ceil( 2 * support[method] * fscale );
+    f->taps = X264_MIN( raw_taps, src_size );
+    /* padded to a multiple of 4 output samples, the padding reads the last sample with zero weight */
+    int padded_size = ALIGN( dst_size, 4 );
+    f->pos   = malloc( padded_size * sizeof(int) );
+    f->coef  = malloc( dst_size * f->taps * sizeof(int16_t) );
+    f->vcoef = x264_malloc( padded_size * f->taps * sizeof(int32_t) );
+    double *weight = malloc( f->taps * sizeof(double) );
+    if( !f->pos || !f->coef || !f->vcoef || !weight )
+    {
+        free( weight );
+        return -1;
+    }
+
+    for( int i = 0; i < dst_size; i++ )
+    {
+        double center = (i + 0.5) * scale - 0.5;
+        int16_t *coef = f->coef + i * f->taps;
+        if( raw_taps == 1 )
+        {
+            f->pos[i] = x264_clip3( src_size == dst_size ? i : floor( center + 0.5 ), 0, src_size-1 );
+            coef[0] = 1 << COEF_SHIFT;
+            continue;
+        }
+        /* taps that fall outside of the plane are folded onto the edge samples */
+        int first = floor( center - support[method] * fscale ) + 1;
+        int start = x264_clip3( first, 0, src_size - f->taps );
+        double sum = 0;
+        memset( weight, 0, f->taps * sizeof(double) );
+        for( int j = 0; j < raw_taps; j++ )
+        {
+            double w = filter_kernel( method, (first + j - center) / fscale );
+            weight[x264_clip3( first + j, 0, src_size-1 ) - start] += w;
+            sum += w;
+        }
+        /* quantize and push the rounding error onto the largest tap so that the taps sum to unity */
+        int isum = 0, max_tap = 0;
+        for( int j = 0; j < f->taps; j++ )
+        {
+            coef[j] = lrint( weight[j] / sum * (1 << COEF_SHIFT) );
+            isum += coef[j];
+            if( abs( coef[j] ) > abs( coef[max_tap] ) )
+                max_tap = j;
+        }
+        coef[max_tap] += (1 << COEF_SHIFT) - isum;
+        f->pos[i] = start;
+    }
+    free( weight );
+    for( int i = 0; i < padded_size; i++ )
+    {
+        if( i >= dst_size )
+            f->pos[i] = f->pos[dst_size-1];
+        for( int j = 0; j < f->taps; j++ )
+            f->vcoef[(i&~3) * f->taps + j * 4 + (i&3)] = i < dst_size ? f->coef[i * f->taps + j] : 0;
+    }
+    return 0;
+}
+
+static void free_scale_filter( scale_filter_t *f )
+{
+    free( f->pos );
+    free( f->coef );
+    x264_free( f->vcoef );
+}
+
+/* the horizontal pass gathers the taps of 4 output samples into a vector at a time.
+ * dst is padded like the lines of the vertical pass. */
+#if HAVE_VECTOREXT
+#define HSCALE_LINE( name, type )\
+static void name( int32_t *dst, uint8_t *src_, int pitch, scale_filter_t *f, int width, int shift )\
+{\
+    typedef int32_t v4si_t __attribute__((vector_size (16)));\
+    type *src = (type*)src_;\
+    const int32_t *coef = f->vcoef;\
+    v4si_t round = { 1 << (shift-1), 1 << (shift-1), 1 << (shift-1), 1 << (shift-1) };\
+    v4si_t vshift = { shift, shift, shift, shift };\
+    for( int x = 0; x < width; x += 4, coef += 4 * f->taps )\
+    {\
+        type *s0 = src + f->pos[x+0] * pitch;\
+        type *s1 = src + f->pos[x+1] * pitch;\
+        type *s2 = src + f->pos[x+2] * pitch;\
+        type *s3 = src + f->pos[x+3] * pitch;\
+        v4si_t sum = round;\
+        for( int k = 0; k < f->taps; k++ )\
+        {\
+            v4si_t s = { s0[k*pitch], s1[k*pitch], s2[k*pitch], s3[k*pitch] };\
+            sum += s * *(v4si_t*)(coef + 4*k);\
+        }\
+        *(v4si_t*)(dst+x) = sum >> vshift;\
+    }\
+}
+#else
+#define HSCALE_LINE( name, type )\
+static void name( int32_t *dst, uint8_t *src_, int pitch, scale_filter_t *f, int width, int shift )\
+{\
+    type *src = (type*)src_;\
+    const int16_t *coef = f->coef;\
+    for( int x = 0; x < width; x++, coef += f->taps )\
+    {\
+        type *s = src + f->pos[x] * pitch;\
+        int sum = 1 << (shift-1);\
+        for( int k = 0; k < f->taps; k++ )\
+            sum += coef[k] * s[k*pitch];\
+        dst[x] = sum >> shift;\
+    }\
+}
+#endif
+
+HSCALE_LINE( hscale_line_8, uint8_t )
+HSCALE_LINE( hscale_line_16, uint16_t )
+
+/* the vertical pass works on whole lines, so it is done 4 samples at a time.
+ * lines are padded to a multiple of 4 samples and 16-byte aligned. */
+static void vscale_line( int32_t *dst, int32_t **src, const int16_t *coef, int taps, int width )
+{
+#if HAVE_VECTOREXT
+    typedef int32_t v4si_t __attribute__((vector_size (16)));
+    for( int x = 0; x < width; x += 4 )
+    {
+        v4si_t c = { coef[0], coef[0], coef[0], coef[0] };
+        v4si_t sum = *(v4si_t*)(src[0]+x) * c;
+        for( int k = 1; k < taps; k++ )
+        {
+            v4si_t ck = { coef[k], coef[k], coef[k], coef[k] };
+            sum += *(v4si_t*)(src[k]+x) * ck;
+        }
+        *(v4si_t*)(dst+x) = sum;
+    }
+#else
+    for( int x = 0; x < width; x++ )
+    {
+        int sum = 0;
+        for( int k = 0; k < taps; k++ )
+            sum += coef[k] * src[k][x];
+        dst[x] = sum;
+    }
+#endif
+}
+
+#define STORE_LINE( name, type )\
+static void name( uint8_t *dst_, int pitch, int32_t *src, int width, int shift, int depth_change, int max )\
+{\
+    type *dst = (type*)dst_;\
+    for( int x = 0; x < width; x++ )\
+    {\
+        int v = (src[x] + (1 << (shift-1))) >> shift;\
+        if( depth_change > 0 )\
+            v += v >> 8;\
+        else if( depth_change < 0 )\
+            v = (v - (v >> 8) + 128) >> 8;\
+        dst[x*pitch] = x264_clip3( v, 0, max );\
+    }\
+}
+
+STORE_LINE( store_line_8, uint8_t )
+STORE_LINE( store_line_16, uint16_t )
+
+static void scale_component( resizer_hnd_t *h, component_t *c, cli_image_t *in, cli_image_t *out )
+{
+    int in_depth  = in->csp & X264_CSP_HIGH_DEPTH ? 2 : 1;
+    int out_depth = out->csp & X264_CSP_HIGH_DEPTH ? 2 : 1;
+    uint8_t *src = in->plane[c->src_plane] + c->src_offset * in_depth;
+    uint8_t *dst = out->plane[c->dst_plane] + c->dst_offset * out_depth;
+    if( c->copy )
+    {
+        x264_cli_plane_copy( dst, out->stride[c->dst_plane], src, in->stride[c->src_plane],
+                             c->dst_width * out_depth, c->dst_height );
+        return;
+    }
+
+    /* the horizontal pass keeps 6 bits of extra precision for 8-bit input,
+     * the vertical pass then brings the result back to 16 bits, or 8 bits for
+     * 8-bit to 8-bit. depth changes are done on the 16-bit value: 8 to 16 bits
+     * expands by 257, and 16 to 8 bits is its exact inverse. */
+    int hshift = in_depth == 2 ? COEF_SHIFT : COEF_SHIFT - 6;
+    int depth_change = out_depth - in_depth;
+    int vshift = COEF_SHIFT + (in_depth == 2 ? 0 : 6) - 8 * (depth_change > 0);
+    int taps = c->vfilter.taps;
+    int next_line = 0;
+    for( int y = 0; y < c->dst_height; y++ )
+    {
+        int first = c->vfilter.pos[y];
+        if( next_line < first )
+            next_line = first;
+        for( ; next_line < first + taps; next_line++ )
+        {
+            int32_t *line = h->ring + (next_line % taps) * h->ring_stride;
+            uint8_t *s = src + next_line * in->stride[c->src_plane];
+            if( in_depth == 2 )
+                hscale_line_16( line, s, c->src_pitch, &c->hfilter, c->dst_width, hshift );
+            else
+                hscale_line_8( line, s, c->src_pitch, &c->hfilter, c->dst_width, hshift );
+        }
+        for( int k = 0; k < taps; k++ )
+            h->lines[k] = h->ring + ((first + k) % taps) * h->ring_stride;
+        vscale_line( h->acc, h->lines, c->vfilter.coef + y * taps, taps, c->dst_width );
+        uint8_t *d = dst + y * out->stride[c->dst_plane];
+        if( out_depth == 2 )
+            store_line_16( d, c->dst_pitch, h->acc, c->dst_width, vshift, depth_change, 0xffff );
+        else
+            store_line_8( d, c->dst_pitch, h->acc, c->dst_width, vshift, depth_change, 0xff );
+    }
+}
+
+static int init_components( resizer_hnd_t *h, video_info_t *info )
+{
+    int max_taps = 0;
+    int max_width = 0;
+    h->passthrough = 1;
+    for( int i = 0; i < 3; i++ )
+    {
+        component_t *c = &h->comp[i];
+        get_component( info->csp, i, &c->src_plane, &c->src_pitch, &c->src_offset );
+        get_component( h->dst_csp, i, &c->dst_plane, &c->dst_pitch, &c->dst_offset );
+        const x264_cli_csp_t *src_csp = x264_cli_get_csp( info->csp );
+        const x264_cli_csp_t *dst_csp = x264_cli_get_csp( h->dst_csp );
+        c->src_width  = info->width  * src_csp->width[c->src_plane] / c->src_pitch;
+        c->src_height = info->height * src_csp->height[c->src_plane];
+        c->dst_width  = h->dst.width  * dst_csp->width[c->dst_plane] / c->dst_pitch;
+        c->dst_height = h->dst.height * dst_csp->height[c->dst_plane];
+        c->copy = c->src_width == c->dst_width && c->src_height == c->dst_height &&
+                  c->src_pitch == 1 && c->dst_pitch == 1 &&
+                  (info->csp & X264_CSP_HIGH_DEPTH) == (h->dst_csp & X264_CSP_HIGH_DEPTH);
+        h->passthrough &= c->copy;
+        if( c->copy )
+            continue;
+        if( init_scale_filter( &c->hfilter, h->method, c->src_width, c->dst_width ) ||
+            init_scale_filter( &c->vfilter, h->method, c->src_height, c->dst_height ) )
+            return -1;
+        max_taps  = X264_MAX( max_taps, c->vfilter.taps );
+        max_width = X264_MAX( max_width, c->dst_width );
+    }
+    if( h->passthrough )
+        return 0;
+
+    h->ring_stride = ALIGN( max_width, 4 );
+    h->ring  = x264_malloc( (max_taps + 1) * h->ring_stride * sizeof(int32_t) );
+    h->lines = malloc( max_taps * sizeof(int32_t*) );
+    if( !h->ring || !h->lines )
+        return -1;
+    h->acc = h->ring + max_taps * h->ring_stride;
+    h->pool = x264_cli_pic_pool_new( h->dst_csp, h->dst.width, h->dst.height );
+    return !h->pool;
+}
+
 static int init( hnd_t *handle, cli_vid_filter_t *filter, video_info_t *info, x264_param_t *param, char *opt_string )
 {
-    int ret = 0;
+    /* the builtin resizer only handles known csps, so normalization is left to the demuxer */
+    if( opt_string && !strcmp( opt_string, "normcsp" ) )
+    {
+        FAIL_IF_ERROR( info->csp & X264_CSP_OTHER, "not compiled with swscale support\n" )
+        return 0;
+    }
+    /* if called by x264cli and nothing needs to be done, exit */
+    if( !opt_string && !full_check( info, param ) )
+        return 0;
+
+    static const char *optlist[] = { "width", "height", "sar", "fittobox", "csp", "method", NULL };
+    char **opts = x264_split_options( opt_string, optlist );
+    if( !opts && opt_string )
+        return -1;
 
-    if( !opt_string )
-        ret = full_check( info, param );
+    resizer_hnd_t *h = calloc( 1, sizeof(resizer_hnd_t) );
+    if( !h )
+        return -1;
+    if( opts )
+    {
+        h->dst_csp    = info->csp;
+        h->dst.width  = info->width;
+        h->dst.height = info->height;
+        if( handle_opts( optlist, opts, info, h ) )
+            return -1;
+    }
     else
     {
-        if( !strcmp( opt_string, "normcsp" ) )
-            ret = info->csp & X264_CSP_OTHER;
-        else
-            ret = -1;
+        h->dst_csp    = param->i_csp;
+        h->dst.width  = param->i_width;
+        h->dst.height = param->i_height;
     }
+    h->method = convert_method_to_flag( x264_otos( x264_get_option( optlist[5], opts ), "" ) );
+    x264_free_string_array( opts );
+
+    const x264_cli_csp_t *src_csp = x264_cli_get_csp( info->csp );
+    const x264_cli_csp_t *dst_csp = x264_cli_get_csp( h->dst_csp );
+    FAIL_IF_ERROR( !native_csp_is_supported( info->csp ), "input colorspace %s is not supported without swscale\n",
+                   src_csp ? src_csp->name : "unknown" )
+    FAIL_IF_ERROR( !native_csp_is_supported( h->dst_csp ), "output colorspace %s is not supported without swscale\n",
+                   dst_csp ? dst_csp->name : "unknown" )
+    FAIL_IF_ERROR( h->dst.height != info->height && info->interlaced,
+                   "resize is not compatible with interlaced vertical resizing\n" )
+    /* confirm that the desired resolution meets the colorspace requirements */
+    FAIL_IF_ERROR( h->dst.width % dst_csp->mod_width || h->dst.height % dst_csp->mod_height,
+                   "resolution %dx%d is not compliant with colorspace %s\n", h->dst.width, h->dst.height, dst_csp->name )
+
+    if( h->dst.width != info->width || h->dst.height != info->height )
+        x264_cli_log( NAME, X264_LOG_INFO, "resizing to %dx%d\n", h->dst.width, h->dst.height );
+    if( (h->dst_csp & (X264_CSP_MASK | X264_CSP_HIGH_DEPTH)) != (info->csp & (X264_CSP_MASK | X264_CSP_HIGH_DEPTH)) )
+        x264_cli_log( NAME, X264_LOG_WARNING, "converting from %s%s to %s%s\n",
+                      src_csp->name, info->csp & X264_CSP_HIGH_DEPTH ? " (16-bit)" : "",
+                      dst_csp->name, h->dst_csp & X264_CSP_HIGH_DEPTH ? " (16-bit)" : "" );
+    h->dst_csp |= info->csp & X264_CSP_VFLIP; // preserve vflip
+
+    FAIL_IF_ERROR( init_components( h, info ), "malloc failed\n" )
+    h->src.width  = info->width;
+    h->src.height = info->height;
+    h->src.pix_fmt = info->csp;
+
+    /* finished initing, overwrite values */
+    info->csp    = h->dst_csp;
+    info->width  = h->dst.width;
+    info->height = h->dst.height;
+
+    h->prev_filter = *filter;
+    h->prev_hnd = *handle;
+    *handle = h;
+    *filter = resize_filter;
 
-    /* pass if nothing needs to be done, otherwise fail */
-    FAIL_IF_ERROR( ret, "not compiled with swscale support\n" )
     return 0;
 }
 
-#define help NULL
-#define get_frame NULL
-#define release_frame NULL
-#define free_filter NULL
-#define convert_csp_to_pix_fmt(x) (x & X264_CSP_MASK)
+static int get_frame( hnd_t handle, cli_pic_t *output, int frame )
+{
+    resizer_hnd_t *h = handle;
+    cli_pic_t in;
+    if( h->prev_filter.get_frame( h->prev_hnd, &in, frame ) )
+        return -1;
+    FAIL_IF_ERROR( in.img.width != h->src.width || in.img.height != h->src.height ||
+                   in.img.csp != h->src.pix_fmt, "stream properties changed at pts %"PRId64"\n", in.pts )
+    if( h->passthrough )
+    {
+        /* only the plane order differs, so just reorder the plane pointers */
+        *output = in;
+        for( int i = 0; i < 3; i++ )
+        {
+            output->img.plane[h->comp[i].dst_plane]  = in.img.plane[h->comp[i].src_plane];
+            output->img.stride[h->comp[i].dst_plane] = in.img.stride[h->comp[i].src_plane];
+        }
+        output->img.csp = h->dst_csp;
+        return 0;
+    }
+    if( x264_cli_pic_pool_get( h->pool, output ) )
+        return -1;
+    for( int i = 0; i < 3; i++ )
+        scale_component( h, &h->comp[i], &in.img, &output->img );
+    /* the scaled frame has its own storage, so the source frame can go */
+    return x264_cli_pic_release_input( output, &in, h->prev_hnd, &h->prev_filter, frame );
+}
+
+static void free_filter( hnd_t handle )
+{
+    resizer_hnd_t *h = handle;
+    h->prev_filter.free( h->prev_hnd );
+    for( int i = 0; i < 3; i++ )
+    {
+        free_scale_filter( &h->comp[i].hfilter );
+        free_scale_filter( &h->comp[i].vfilter );
+    }
+    x264_free( h->ring );
+    free( h->lines );
+    x264_cli_pic_pool_delete( h->pool );
+    free( h );
+}
 
 #endif
 
+static int release_frame( hnd_t handle, cli_pic_t *pic, int frame )
+{
+    resizer_hnd_t *h = handle;
+    /* frames in our own storage have already released their source frame */
+    if( x264_cli_pic_pool_owns( h->pool, pic ) )
+    {
+        x264_cli_pic_unref( pic );
+        return 0;
+    }
+    return h->prev_filter.release_frame( h->prev_hnd, pic, frame );
+}
+
 cli_vid_filter_t resize_filter = { NAME, help, init, get_frame, release_frame, free_filter, NULL };
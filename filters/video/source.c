@@ -24,6 +24,7 @@
  *****************************************************************************/
 
 #include "video.h"
+#include "internal.h"
 
 /* This filter converts the demuxer API into the filtering API for video frames.
  * Backseeking is prohibited here as not all demuxers are capable of doing so. */
@@ -33,6 +34,7 @@ typedef struct
     cli_pic_t pic;
     hnd_t hin;
     int cur_frame;
+    cli_pic_pool_t *pool; /* shared frame storage, for demuxers that read into cli pictures */
 } source_hnd_t;
 
 cli_vid_filter_t source_filter;
@@ -44,7 +46,15 @@ static int init( hnd_t *handle, cli_vid_filter_t *filter, video_info_t *info, x2
         return -1;
     h->cur_frame = -1;
 
-    if( cli_input.picture_alloc( &h->pic, info->csp, info->width, info->height ) )
+    /* demuxers that only read into pictures they did not allocate themselves
+     * can fill shared buffers directly, avoiding copies further down the chain */
+    if( cli_input.picture_alloc == x264_cli_pic_alloc )
+    {
+        h->pool = x264_cli_pic_pool_new( info->csp, info->width, info->height );
+        if( !h->pool )
+            return -1;
+    }
+    else if( cli_input.picture_alloc( &h->pic, info->csp, info->width, info->height ) )
         return -1;
 
     h->hin = *handle;
@@ -58,25 +68,50 @@ static int get_frame( hnd_t handle, cli_pic_t *output, int frame )
 {
     source_hnd_t *h = handle;
     /* do not allow requesting of frames from before the current position */
-    if( frame <= h->cur_frame || cli_input.read_frame( &h->pic, h->hin, frame ) )
+    if( frame <= h->cur_frame )
         return -1;
+    if( h->pool )
+    {
+        if( x264_cli_pic_pool_get( h->pool, output ) )
+            return -1;
+        cli_pic_buf_t *buf = output->buf;
+        int ret = cli_input.read_frame( output, h->hin, frame );
+        /* a demuxer may hand back a picture of its own in exchange for ours (e.g. thread input),
+         * in which case the buffer takes ownership of the returned planes */
+        output->buf = buf;
+        buf->img = output->img;
+        if( ret )
+        {
+            x264_cli_pic_unref( output );
+            return -1;
+        }
+    }
+    else
+    {
+        if( cli_input.read_frame( &h->pic, h->hin, frame ) )
+            return -1;
+        *output = h->pic;
+    }
     h->cur_frame = frame;
-    *output = h->pic;
     return 0;
 }
 
 static int release_frame( hnd_t handle, cli_pic_t *pic, int frame )
 {
     source_hnd_t *h = handle;
-    if( cli_input.release_frame && cli_input.release_frame( &h->pic, h->hin ) )
+    if( cli_input.release_frame && cli_input.release_frame( h->pool ? pic : &h->pic, h->hin ) )
         return -1;
+    x264_cli_pic_unref( pic );
     return 0;
 }
 
 static void free_filter( hnd_t handle )
 {
     source_hnd_t *h = handle;
-    cli_input.picture_clean( &h->pic );
+    if( h->pool )
+        x264_cli_pic_pool_delete( h->pool );
+    else
+        cli_input.picture_clean( &h->pic );
     cli_input.close_file( h->hin );
     free( h );
 }
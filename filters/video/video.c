@@ -25,8 +25,15 @@
 
 #include "video.h"
 
+#include "internal.h"
+
 static cli_vid_filter_t *first_filter = NULL;
 
+#if HAVE_THREAD
+/* stages worth a thread of their own, the other filters only adjust pointers or references */
+static const char * const pipelined_filters[] = { "source", "resize", "depth", NULL };
+#endif
+
 static void register_vid_filter( cli_vid_filter_t *new_filter )
 {
     cli_vid_filter_t *filter_i = first_filter;
@@ -63,12 +70,36 @@ int x264_init_vid_filter( const char *name, hnd_t *handle, cli_vid_filter_t *fil
     while( filter_i && strcasecmp( name, filter_i->name ) )
         filter_i = filter_i->next;
     FAIL_IF_ERR( !filter_i, "x264", "invalid filter `%s'\n", name );
-    if( filter_i->init( handle, filter, info, param, opt_string ) )
+    return filter_i->init( handle, filter, info, param, opt_string );
+}
+
+int x264_init_vid_filter_pipelined( cli_vid_pipeline_t *pipeline, const char *name, hnd_t *handle, cli_vid_filter_t *filter,
+                                    video_info_t *info, x264_param_t *param, char *opt_string )
+{
+#if HAVE_THREAD
+    hnd_t prev_hnd = *handle;
+#endif
+    if( x264_init_vid_filter( name, handle, filter, info, param, opt_string ) )
         return -1;
 
+#if HAVE_THREAD
+    /* decouple a stage that added itself to the chain from the ones after it */
+    if( pipeline->queue_size > 0 && *handle != prev_hnd )
+        for( int i = 0; pipelined_filters[i]; i++ )
+            if( !strcasecmp( name, pipelined_filters[i] ) )
+                return x264_pipe_filter_init( handle, filter, info, pipeline );
+#endif
+
     return 0;
 }
 
+#if !HAVE_THREAD
+int x264_vid_pipeline_stats( cli_vid_pipeline_t *pipeline, cli_vid_stage_stats_t *stats, int max )
+{
+    return 0;
+}
+#endif
+
 void x264_vid_filter_help( int longhelp )
 {
     for( cli_vid_filter_t *filter_i = first_filter; filter_i; filter_i = filter_i->next )
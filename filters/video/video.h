@@ -55,9 +55,34 @@ struct cli_vid_filter_t
     cli_vid_filter_t *next;
 };
 
+/* time accounting of a pipelined filter stage, times are in microseconds */
+typedef struct
+{
+    const char *name; /* the filter whose output the stage produces */
+    int64_t busy;     /* time spent producing frames */
+    int64_t blocked;  /* time spent waiting for room in the queue to the next stage */
+    int64_t starved;  /* time the next stage spent waiting for frames */
+    int frames;       /* frames produced so far */
+    int queued;       /* frames waiting in the queue */
+} cli_vid_stage_stats_t;
+
+#define MAX_PIPELINE_STAGES 16
+
+/* pipeline mode: run a chain's source and the filters that process pixels on threads of their own,
+ * buffering up to queue_size frames between them. */
+typedef struct
+{
+    int queue_size;                     /* 0 disables pipelining */
+    hnd_t stage[MAX_PIPELINE_STAGES];   /* the chain's stages, in the order they were added */
+} cli_vid_pipeline_t;
+
 void x264_register_vid_filters( void );
 void x264_vid_filter_help( int longhelp );
 int  x264_init_vid_filter( const char *name, hnd_t *handle, cli_vid_filter_t *filter,
                            video_info_t *info, x264_param_t *param, char *opt_string );
+/* as x264_init_vid_filter, then decouples the filter from the ones after it if it is worth a thread */
+int  x264_init_vid_filter_pipelined( cli_vid_pipeline_t *pipeline, const char *name, hnd_t *handle, cli_vid_filter_t *filter,
+                                     video_info_t *info, x264_param_t *param, char *opt_string );
+int  x264_vid_pipeline_stats( cli_vid_pipeline_t *pipeline, cli_vid_stage_stats_t *stats, int max );
 
 #endif
@@ -42,6 +42,7 @@ typedef struct
     int seek;
     int progress;
     int output_csp; /* convert to this csp, if applicable */
+    int demuxer_threads; /* decoding threads, 0 for auto */
 } cli_input_opt_t;
 
 /* properties of the source given by the demuxer */
@@ -74,12 +75,15 @@ typedef struct
     int     stride[4]; /* strides for each plane */
 } cli_image_t;
 
+typedef struct cli_pic_buf_t cli_pic_buf_t;
+
 typedef struct
 {
     cli_image_t img;
     int64_t pts;       /* input pts */
     int64_t duration;  /* frame duration - used for vfr */
     void    *opaque;   /* opaque handle */
+    cli_pic_buf_t *buf; /* reference-counted image storage, NULL if img is only valid until release */
 } cli_pic_t;
 
 typedef struct
@@ -95,6 +99,7 @@ typedef struct
 
 extern const cli_input_t raw_input;
 extern const cli_input_t y4m_input;
+extern const cli_input_t synth_input;
 extern const cli_input_t avs_input;
 extern cli_input_t thread_input;
 extern const cli_input_t lavf_input;
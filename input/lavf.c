@@ -30,23 +30,58 @@
 #include <libavformat/avformat.h>
 #include <libavutil/pixdesc.h>
 #include <libavutil/dict.h>
+#include <libavutil/imgutils.h>
 
 #if HAVE_AUDIO
 #include "audio/audio.h"
 #endif
 
+#ifndef AV_NUM_DATA_POINTERS
+#define AV_NUM_DATA_POINTERS 4
+#endif
+
+/* alignment of the planes and strides of directly rendered frames */
+#define DR_ALIGN 32
+
+typedef struct lavf_hnd_t lavf_hnd_t;
+
+/* image the decoder renders directly into. it stays alive as long as either the decoder
+ * or a picture handed out by read_frame references it, so the decoder can go on with
+ * the next frames (on other threads with frame threading) while the image is being used. */
+typedef struct lavf_buf_t
+{
+    struct lavf_buf_t *next;
+    lavf_hnd_t *h;
+    int refs;
+    int width;
+    int height;
+    enum PixelFormat pix_fmt;
+    uint8_t *base[4];
+    uint8_t *data[4];
+    int linesize[4];
+} lavf_buf_t;
+
+/* what cli_pic_t.opaque points to */
 typedef struct
+{
+    AVPacket pkt;
+    lavf_buf_t *buf;
+} lavf_pic_t;
+
+struct lavf_hnd_t
 {
     AVFormatContext *lavf;
     int stream_id;
     int next_frame;
     int vfr_input;
     cli_pic_t *first_pic;
+    lavf_buf_t *free_bufs;
+    x264_pthread_mutex_t buf_mutex;
 #if HAVE_AUDIO
     char *filename;
     int has_audio;
 #endif
-} lavf_hnd_t;
+};
 
 #define x264_free_packet( pkt )\
 {\
@@ -54,6 +89,131 @@ typedef struct
     av_init_packet( pkt );\
 }
 
+static void buf_free( lavf_buf_t *buf )
+{
+    for( int i = 0; i < 4; i++ )
+        x264_free( buf->base[i] );
+    free( buf );
+}
+
+/* decoded frames in a layout x264 reads natively are tagged with that csp so they
+ * reach the encoder without going through swscale; everything else is left to
+ * the resize filter's normcsp pass. */
+static int pix_fmt_to_csp( enum PixelFormat pix_fmt )
+{
+    switch( pix_fmt )
+    {
+        case PIX_FMT_YUV420P: return X264_CSP_I420;
+        case PIX_FMT_YUV422P: return X264_CSP_I422;
+        case PIX_FMT_YUV444P: return X264_CSP_I444;
+        case PIX_FMT_NV12:    return X264_CSP_NV12;
+        default:              return pix_fmt | X264_CSP_OTHER;
+    }
+}
+
+static int csp_planes( int csp )
+{
+    if( (csp & X264_CSP_OTHER) || x264_cli_csp_is_invalid( csp ) )
+        return 4;
+    return x264_cli_csps[csp&X264_CSP_MASK].planes;
+}
+
+static void buf_unref( lavf_buf_t *buf )
+{
+    lavf_hnd_t *h = buf->h;
+    x264_pthread_mutex_lock( &h->buf_mutex );
+    if( !--buf->refs )
+    {
+        buf->next = h->free_bufs;
+        h->free_bufs = buf;
+    }
+    x264_pthread_mutex_unlock( &h->buf_mutex );
+}
+
+static lavf_buf_t *buf_alloc( AVCodecContext *c )
+{
+    int width = c->width;
+    int height = c->height;
+    int linesize_align[AV_NUM_DATA_POINTERS];
+    avcodec_align_dimensions2( c, &width, &height, linesize_align );
+    int edge = c->flags & CODEC_FLAG_EMU_EDGE ? 0 : avcodec_get_edge_width();
+    const AVPixFmtDescriptor *desc = &av_pix_fmt_descriptors[c->pix_fmt];
+    int edge_bytes[4];
+
+    lavf_buf_t *buf = calloc( 1, sizeof(lavf_buf_t) );
+    if( !buf || av_image_fill_linesizes( buf->linesize, c->pix_fmt, width + 2*edge ) < 0 ||
+        av_image_fill_linesizes( edge_bytes, c->pix_fmt, edge ) < 0 )
+        goto fail;
+    for( int i = 0; i < 4 && buf->linesize[i]; i++ )
+    {
+        int chroma = i == 1 || i == 2;
+        int plane_edge = edge >> (chroma ? desc->log2_chroma_h : 0);
+        int lines = ((height + 2*edge) >> (chroma ? desc->log2_chroma_h : 0)) + 1;
+        buf->linesize[i] = FFALIGN( buf->linesize[i], FFMAX( DR_ALIGN, linesize_align[i] ) );
+        /* the first pixel is aligned too, which needs up to DR_ALIGN bytes more.
+         * 16 more bytes allow for simd reading past the end of the last line */
+        buf->base[i] = x264_malloc( lines * buf->linesize[i] + DR_ALIGN + 16 );
+        if( !buf->base[i] )
+            goto fail;
+        intptr_t offset = plane_edge * buf->linesize[i] + edge_bytes[i];
+        buf->data[i] = (uint8_t*)(((intptr_t)buf->base[i] + offset + DR_ALIGN - 1) & ~(DR_ALIGN - 1));
+    }
+    buf->width   = c->width;
+    buf->height  = c->height;
+    buf->pix_fmt = c->pix_fmt;
+    return buf;
+fail:
+    if( buf )
+        buf_free( buf );
+    return NULL;
+}
+
+static int get_buffer( AVCodecContext *c, AVFrame *frame )
+{
+    lavf_hnd_t *h = c->opaque;
+    const AVPixFmtDescriptor *desc = &av_pix_fmt_descriptors[c->pix_fmt];
+    /* leave the images that are not plain planes of pixels to lavc */
+    if( !(c->codec->capabilities & CODEC_CAP_DR1) || (desc->flags & (PIX_FMT_PAL|PIX_FMT_HWACCEL|PIX_FMT_BITSTREAM)) )
+        return avcodec_default_get_buffer( c, frame );
+
+    x264_pthread_mutex_lock( &h->buf_mutex );
+    lavf_buf_t *buf = h->free_bufs;
+    if( buf )
+        h->free_bufs = buf->next;
+    x264_pthread_mutex_unlock( &h->buf_mutex );
+    /* the dimensions can change midstream */
+    if( buf && (buf->width != c->width || buf->height != c->height || buf->pix_fmt != c->pix_fmt) )
+    {
+        buf_free( buf );
+        buf = NULL;
+    }
+    if( !buf && !(buf = buf_alloc( c )) )
+        return -1;
+    buf->h    = h;
+    buf->refs = 1;
+    buf->next = NULL;
+
+    memcpy( frame->data, buf->data, sizeof(buf->data) );
+    memcpy( frame->linesize, buf->linesize, sizeof(buf->linesize) );
+    frame->type   = FF_BUFFER_TYPE_USER;
+    frame->opaque = buf;
+    frame->age    = INT_MAX;
+    frame->reordered_opaque = c->reordered_opaque;
+    frame->pkt_pts = c->pkt ? c->pkt->pts : AV_NOPTS_VALUE;
+    return 0;
+}
+
+static void release_buffer( AVCodecContext *c, AVFrame *frame )
+{
+    if( frame->type != FF_BUFFER_TYPE_USER )
+    {
+        avcodec_default_release_buffer( c, frame );
+        return;
+    }
+    buf_unref( frame->opaque );
+    memset( frame->data, 0, sizeof(frame->data) );
+}
+
 static int read_frame_internal( cli_pic_t *p_pic, lavf_hnd_t *h, int i_frame, video_info_t *info )
 {
     if( h->first_pic && !info )
@@ -75,7 +235,8 @@ static int read_frame_internal( cli_pic_t *p_pic, lavf_hnd_t *h, int i_frame, vi
     }
 
     AVCodecContext *c = h->lavf->streams[h->stream_id]->codec;
-    AVPacket *pkt = p_pic->opaque;
+    lavf_pic_t *pic = p_pic->opaque;
+    AVPacket *pkt = &pic->pkt;
     AVFrame frame;
     avcodec_get_frame_defaults( &frame );
 
@@ -107,10 +268,20 @@ static int read_frame_internal( cli_pic_t *p_pic, lavf_hnd_t *h, int i_frame, vi
         h->next_frame++;
     }
 
+    /* keep a directly rendered image until the picture is released */
+    if( frame.type == FF_BUFFER_TYPE_USER )
+    {
+        pic->buf = frame.opaque;
+        x264_pthread_mutex_lock( &h->buf_mutex );
+        pic->buf->refs++;
+        x264_pthread_mutex_unlock( &h->buf_mutex );
+    }
+
     memcpy( p_pic->img.stride, frame.linesize, sizeof(p_pic->img.stride) );
     memcpy( p_pic->img.plane, frame.data, sizeof(p_pic->img.plane) );
     p_pic->img.height  = c->height;
-    p_pic->img.csp     = c->pix_fmt | X264_CSP_OTHER;
+    p_pic->img.csp     = pix_fmt_to_csp( c->pix_fmt );
+    p_pic->img.planes  = csp_planes( p_pic->img.csp );
     p_pic->img.width   = c->width;
 
     if( info )
@@ -139,7 +310,7 @@ static int read_frame_internal( cli_pic_t *p_pic, lavf_hnd_t *h, int i_frame, vi
 static int open_file( char *psz_filename, hnd_t *p_handle, video_info_t *info, cli_input_opt_t *opt )
 {
     lavf_hnd_t *h = calloc( 1, sizeof(lavf_hnd_t) );
-    if( !h )
+    if( !h || x264_pthread_mutex_init( &h->buf_mutex, NULL ) )
         return -1;
     av_register_all();
     if( !strcmp( psz_filename, "-" ) )
@@ -185,6 +356,13 @@ static int open_file( char *psz_filename, hnd_t *p_handle, video_info_t *info, c
     /* lavf is thread unsafe as calling av_read_frame invalidates previously read AVPackets */
     info->thread_safe  = 0;
     h->vfr_input       = info->vfr;
+    /* decode with frame and/or slice threads straight into our own images */
+    c->thread_count    = opt->demuxer_threads > 0 ? opt->demuxer_threads : x264_cpu_num_processors();
+    c->thread_type     = FF_THREAD_FRAME | FF_THREAD_SLICE;
+    c->opaque          = h;
+    c->get_buffer      = get_buffer;
+    c->release_buffer  = release_buffer;
+    c->thread_safe_callbacks = 1;
     FAIL_IF_ERROR( avcodec_open2( c, avcodec_find_decoder( c->codec_id ), NULL ),
                    "could not find decoder for video stream\n" )
 
@@ -214,13 +392,17 @@ static int open_file( char *psz_filename, hnd_t *p_handle, video_info_t *info, c
 
 static int picture_alloc( cli_pic_t *pic, int csp, int width, int height )
 {
-    if( x264_cli_pic_alloc( pic, csp, width, height ) )
-        return -1;
-    pic->img.planes = 4;
-    pic->opaque = malloc( sizeof(AVPacket) );
-    if( !pic->opaque )
+    /* the planes always point into the decoder's buffers, never our own */
+    memset( pic, 0, sizeof(cli_pic_t) );
+    pic->img.csp    = csp;
+    pic->img.planes = csp_planes( csp );
+    pic->img.width  = width;
+    pic->img.height = height;
+    lavf_pic_t *opaque = calloc( 1, sizeof(lavf_pic_t) );
+    if( !opaque )
         return -1;
-    av_init_packet( pic->opaque );
+    av_init_packet( &opaque->pkt );
+    pic->opaque = opaque;
     return 0;
 }
 
@@ -231,12 +413,20 @@ static int read_frame( cli_pic_t *pic, hnd_t handle, int i_frame )
 
 static int release_frame( cli_pic_t *pic, hnd_t handle )
 {
-    x264_free_packet( pic->opaque );
+    lavf_pic_t *opaque = pic->opaque;
+    x264_free_packet( &opaque->pkt );
+    if( opaque->buf )
+    {
+        buf_unref( opaque->buf );
+        opaque->buf = NULL;
+    }
     return 0;
 }
 
 static void picture_clean( cli_pic_t *pic )
 {
+    if( pic->opaque )
+        release_frame( pic, NULL );
     free( pic->opaque );
     memset( pic, 0, sizeof(cli_pic_t) );
 }
@@ -244,8 +434,21 @@ static void picture_clean( cli_pic_t *pic )
 static int close_file( hnd_t handle )
 {
     lavf_hnd_t *h = handle;
+    if( h->first_pic )
+    {
+        lavf_input.release_frame( h->first_pic, NULL );
+        lavf_input.picture_clean( h->first_pic );
+        free( h->first_pic );
+    }
     avcodec_close( h->lavf->streams[h->stream_id]->codec );
     av_close_input_file( h->lavf );
+    while( h->free_bufs )
+    {
+        lavf_buf_t *buf = h->free_bufs;
+        h->free_bufs = buf->next;
+        buf_free( buf );
+    }
+    x264_pthread_mutex_destroy( &h->buf_mutex );
 #if HAVE_AUDIO
     free( h->filename );
 #endif
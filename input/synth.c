@@ -0,0 +1,294 @@
+/*****************************************************************************
+ * synth.c: synthetic test pattern input
+ *****************************************************************************
+ * Copyright (C) 2011 x264 project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at licensing@x264.com.
+ *****************************************************************************/
+
+#include "input.h"
+#include "filters/filters.h"
+#define FAIL_IF_ERROR( cond, ... ) FAIL_IF_ERR( cond, "synth", __VA_ARGS__ )
+
+/* Generates moving gradients with noise and a band of scrolling text, changing all of them
+ * at every scene cut. Each frame only depends on the seed and its number, so frames can be
+ * generated in any order and two runs with the same options produce the same video.
+ * The options are given in place of the input file name:
+ *     frames=<int>  number of frames [1000], 0 for no end
+ *     seed=<int>    seed of the pattern [0]
+ *     cut=<int>     frames between scene cuts [150], 0 for none
+ *     noise=<int>   amplitude of the noise, in 8-bit steps [4]
+ *     text=<bool>   draw scrolling text [1]
+ *     ring=<int>    render this many frames at startup and loop over them, so that
+ *                   reading a frame costs no more than a copy [0] */
+
+#define PERIOD 8192 /* gradients are triangle waves with this period, peaking at 4095 */
+#define DEFAULT_WIDTH  1280
+#define DEFAULT_HEIGHT 720
+
+typedef struct
+{
+    int width;
+    int height;
+    int csp;
+    int bit_depth;
+    int rgb;
+    int frames;
+    uint32_t seed;
+    int cut;
+    int noise;
+    int text;
+    int ring_size;
+    cli_pic_t *ring;
+} synth_hnd_t;
+
+/* 5x7 glyphs of ' ', '0'-'9' and 'A'-'Z', one byte per row with the leftmost pixel in bit 4 */
+static const uint8_t font[37][7] =
+{
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0x0e, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0e }, { 0x04, 0x0c, 0x04, 0x04, 0x04, 0x04, 0x0e },
+    { 0x0e, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1f }, { 0x1f, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0e },
+    { 0x02, 0x06, 0x0a, 0x12, 0x1f, 0x02, 0x02 }, { 0x1f, 0x10, 0x1e, 0x01, 0x01, 0x11, 0x0e },
+    { 0x06, 0x08, 0x10, 0x1e, 0x11, 0x11, 0x0e }, { 0x1f, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 },
+    { 0x0e, 0x11, 0x11, 0x0e, 0x11, 0x11, 0x0e }, { 0x0e, 0x11, 0x11, 0x0f, 0x01, 0x02, 0x0c },
+    { 0x0e, 0x11, 0x11, 0x11, 0x1f, 0x11, 0x11 }, { 0x1e, 0x11, 0x11, 0x1e, 0x11, 0x11, 0x1e },
+    { 0x0e, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0e }, { 0x1c, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1c },
+    { 0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x1f }, { 0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x10 },
+    { 0x0e, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0f }, { 0x11, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11 },
+    { 0x0e, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e }, { 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0c },
+    { 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 }, { 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1f },
+    { 0x11, 0x1b, 0x15, 0x15, 0x11, 0x11, 0x11 }, { 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 },
+    { 0x0e, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e }, { 0x1e, 0x11, 0x11, 0x1e, 0x10, 0x10, 0x10 },
+    { 0x0e, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0d }, { 0x1e, 0x11, 0x11, 0x1e, 0x14, 0x12, 0x11 },
+    { 0x0f, 0x10, 0x10, 0x0e, 0x01, 0x01, 0x1e }, { 0x1f, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 },
+    { 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e }, { 0x11, 0x11, 0x11, 0x11, 0x11, 0x0a, 0x04 },
+    { 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0a }, { 0x11, 0x11, 0x0a, 0x04, 0x0a, 0x11, 0x11 },
+    { 0x11, 0x11, 0x11, 0x0a, 0x04, 0x04, 0x04 }, { 0x1f, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1f },
+};
+
+static const uint8_t *get_glyph( char c )
+{
+    if( c >= '0' && c <= '9' )
+        return font[1 + c - '0'];
+    if( c >= 'A' && c <= 'Z' )
+        return font[11 + c - 'A'];
+    return font[0];
+}
+
+static uint32_t hash( uint32_t x )
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+/* writes v, given in the input bit depth, the way the other demuxers deliver pixels */
+static inline void store_pixel( synth_hnd_t *h, uint8_t *dst, int x, int v )
+{
+    if( h->bit_depth == 8 )
+        dst[x] = v;
+    else
+        ((uint16_t*)dst)[x] = (v << (16 - h->bit_depth)) + (v >> (2*h->bit_depth - 16));
+}
+
+static void render_frame( synth_hnd_t *h, cli_image_t *img, int frame )
+{
+    const x264_cli_csp_t *csp = x264_cli_get_csp( h->csp );
+    int scene = h->cut ? frame / h->cut : 0;
+    uint32_t scene_seed = hash( h->seed ^ hash( scene ) );
+    int max_value = (1 << h->bit_depth) - 1;
+    int noise_range = 2 * (h->noise << (h->bit_depth - 8)) + 1;
+
+    /* the text band, in luma coordinates */
+    int scale = X264_MAX( h->height / 120, 1 );
+    int text_top = h->height / 8 + hash( scene_seed ) % X264_MAX( h->height * 5 / 8, 1 );
+    int text_bottom = X264_MIN( text_top + 7 * scale, h->height );
+    int text_x = frame * 2 * scale;
+    char text[64];
+    int text_len = snprintf( text, sizeof(text), "X264 SYNTHETIC SOURCE  SEED %u  SCENE %d      ", h->seed, scene );
+
+    for( int i = 0; i < csp->planes; i++ )
+    {
+        int comps = csp->planes == 1 ? csp->width[0] : csp->planes == 2 && i ? 2 : 1;
+        int width = h->width * csp->width[i] / comps;
+        int lines = h->height * csp->height[i];
+        int chroma = !h->rgb && i;
+        uint32_t r = hash( scene_seed + i + 1 );
+        /* up to one period across the frame in either direction, moving at up to a period every 128 frames */
+        int gx = (int)(r & 31) - 16;
+        int gy = (int)(r >> 5 & 31) - 16;
+        int speed = 4 + (r >> 10 & 63);
+        int offset = r >> 16;
+        int64_t x_step = (int64_t)gx * PERIOD * 65536 / (16 * width);
+        int stride = img->stride[i];
+        uint8_t *dst = img->plane[i];
+
+        for( int y = 0; y < lines; y++, dst += stride )
+        {
+            uint32_t rng = hash( h->seed ^ hash( frame * 4 + i ) ^ (y * 0x9e3779b9) ) | 1;
+            int phase = offset + frame * speed + y * gy * PERIOD / (16 * lines);
+            for( int x = 0; x < width; x++ )
+                for( int c = 0; c < comps; c++ )
+                {
+                    int p = (phase + (int)((x * x_step) >> 16) + c * PERIOD / 3) & (PERIOD - 1);
+                    int t = p < PERIOD/2 ? p : PERIOD - 1 - p;
+                    if( chroma )
+                        t = PERIOD/8 + t/2;
+                    int v = h->bit_depth > 12 ? t << (h->bit_depth - 12) : t >> (12 - h->bit_depth);
+                    rng ^= rng << 13;
+                    rng ^= rng >> 17;
+                    rng ^= rng << 5;
+                    v += (int)(((rng >> 16) * noise_range) >> 16) - (noise_range >> 1);
+                    store_pixel( h, dst, x * comps + c, x264_clip3( v, 0, max_value ) );
+                }
+        }
+
+        if( !h->text )
+            continue;
+        /* white text: full intensity in luma and rgb, neutral chroma */
+        int ink = chroma ? 1 << (h->bit_depth - 1) : max_value;
+        dst = img->plane[i];
+        for( int y = text_top * lines / h->height; y < lines && y * h->height / lines < text_bottom; y++ )
+        {
+            if( y * h->height / lines < text_top )
+                continue;
+            int row = (y * h->height / lines - text_top) / scale;
+            for( int x = 0; x < width; x++ )
+            {
+                int col = (x * h->width / width + text_x) / scale;
+                int glyph_col = col % 6;
+                if( glyph_col < 5 && get_glyph( text[col / 6 % text_len] )[row] & (16 >> glyph_col) )
+                    for( int c = 0; c < comps; c++ )
+                        store_pixel( h, dst + y * stride, x * comps + c, ink );
+            }
+        }
+    }
+}
+
+static int open_file( char *psz_filename, hnd_t *p_handle, video_info_t *info, cli_input_opt_t *opt )
+{
+    synth_hnd_t *h = calloc( 1, sizeof(synth_hnd_t) );
+    if( !h )
+        return -1;
+
+    char **opts = NULL;
+    if( strcmp( psz_filename, "-" ) )
+    {
+        static const char *optlist[] = { "frames", "seed", "cut", "noise", "text", "ring", NULL };
+        opts = x264_split_options( psz_filename, optlist );
+        FAIL_IF_ERROR( !opts, "invalid options `%s'\n", psz_filename )
+    }
+    h->frames    = x264_otoi( x264_get_option( "frames", opts ), 1000 );
+    h->seed      = x264_otoi( x264_get_option( "seed", opts ), 0 );
+    h->cut       = x264_otoi( x264_get_option( "cut", opts ), 150 );
+    h->noise     = x264_otoi( x264_get_option( "noise", opts ), 4 );
+    h->text      = x264_otob( x264_get_option( "text", opts ), 1 );
+    h->ring_size = x264_otoi( x264_get_option( "ring", opts ), 0 );
+    x264_free_string_array( opts );
+    FAIL_IF_ERROR( h->frames < 0 || h->cut < 0 || h->noise < 0 || h->noise > 127 || h->ring_size < 0,
+                   "invalid options `%s'\n", psz_filename )
+
+    info->width  = DEFAULT_WIDTH;
+    info->height = DEFAULT_HEIGHT;
+    if( opt->resolution )
+        FAIL_IF_ERROR( sscanf( opt->resolution, "%dx%d", &info->width, &info->height ) != 2 ||
+                       info->width <= 0 || info->height <= 0, "invalid resolution `%s'\n", opt->resolution )
+    if( opt->colorspace )
+    {
+        for( info->csp = X264_CSP_CLI_MAX-1; x264_cli_csps[info->csp].name && strcasecmp( x264_cli_csps[info->csp].name, opt->colorspace ); )
+            info->csp--;
+        FAIL_IF_ERROR( info->csp == X264_CSP_NONE, "unsupported colorspace `%s'\n", opt->colorspace );
+    }
+    else /* default */
+        info->csp = X264_CSP_I420;
+    const x264_cli_csp_t *csp = x264_cli_get_csp( info->csp );
+    FAIL_IF_ERROR( info->width % csp->mod_width || info->height % csp->mod_height,
+                   "resolution %dx%d is not a multiple of %dx%d for %s\n", info->width, info->height,
+                   csp->mod_width, csp->mod_height, csp->name )
+
+    h->bit_depth = opt->bit_depth;
+    FAIL_IF_ERROR( h->bit_depth < 8 || h->bit_depth > 16, "unsupported bit depth `%d'\n", h->bit_depth );
+    if( h->bit_depth > 8 )
+        info->csp |= X264_CSP_HIGH_DEPTH;
+
+    h->width  = info->width;
+    h->height = info->height;
+    h->csp    = info->csp;
+    h->rgb    = (info->csp & X264_CSP_MASK) >= X264_CSP_BGR;
+
+    info->thread_safe = 1;
+    info->num_frames  = h->frames;
+    info->vfr         = 0;
+
+    if( h->ring_size )
+    {
+        h->ring = calloc( h->ring_size, sizeof(cli_pic_t) );
+        FAIL_IF_ERROR( !h->ring, "malloc failed\n" )
+        for( int i = 0; i < h->ring_size; i++ )
+        {
+            FAIL_IF_ERROR( x264_cli_pic_alloc( &h->ring[i], h->csp, h->width, h->height ), "malloc failed\n" )
+            render_frame( h, &h->ring[i].img, i );
+        }
+    }
+
+    *p_handle = h;
+    return 0;
+}
+
+static int read_frame( cli_pic_t *pic, hnd_t handle, int i_frame )
+{
+    synth_hnd_t *h = handle;
+    if( h->frames && i_frame >= h->frames )
+        return -1;
+
+    if( !h->ring_size )
+    {
+        render_frame( h, &pic->img, i_frame );
+        return 0;
+    }
+
+    cli_image_t *src = &h->ring[i_frame % h->ring_size].img;
+    for( int i = 0; i < src->planes; i++ )
+    {
+        uint64_t size = x264_cli_pic_plane_size( h->csp, h->width, h->height, i );
+        if( pic->img.stride[i] == src->stride[i] )
+            memcpy( pic->img.plane[i], src->plane[i], size );
+        else
+        {
+            int lines = size / src->stride[i];
+            for( int y = 0; y < lines; y++ )
+                memcpy( pic->img.plane[i] + y * pic->img.stride[i], src->plane[i] + y * src->stride[i], src->stride[i] );
+        }
+    }
+    return 0;
+}
+
+static int close_file( hnd_t handle )
+{
+    synth_hnd_t *h = handle;
+    for( int i = 0; i < h->ring_size && h->ring; i++ )
+        x264_cli_pic_clean( &h->ring[i] );
+    free( h->ring );
+    free( h );
+    return 0;
+}
+
+const cli_input_t synth_input = { open_file, x264_cli_pic_alloc, read_frame, NULL, x264_cli_pic_clean, close_file };
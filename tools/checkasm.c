@@ -28,6 +28,7 @@
 #include <ctype.h>
 #include "common/common.h"
 #include "common/cpu.h"
+#include "encoder/macroblock.h"
 
 // GCC doesn't align stack variables on ARM, so use .bss
 #if ARCH_ARM
@@ -189,7 +190,7 @@ static void print_bench(void)
         }
 }
 
-#if ARCH_X86 || ARCH_X86_64
+#if HAVE_MMX
 int x264_stack_pagealign( int (*func)(), int align );
 #else
 #define x264_stack_pagealign( func, align ) func()
@@ -197,7 +198,7 @@ int x264_stack_pagealign( int (*func)(), int align );
 
 #define call_c1(func,...) func(__VA_ARGS__)
 
-#if ARCH_X86 || defined(_WIN64)
+#if HAVE_MMX && (ARCH_X86 || defined(_WIN64))
 /* detect when callee-saved regs aren't saved.
  * needs an explicit asm check because it only sometimes crashes in normal use. */
 intptr_t x264_checkasm_call( intptr_t (*func)(), int *ok, ... );
@@ -1736,6 +1737,36 @@ static int check_quant( int cpu_ref, int cpu_new )
         TEST_QUANT( quant_8x8, CQM_8PY, 8 );
         TEST_QUANT( quant_4x4, CQM_4IY, 4 );
         TEST_QUANT( quant_4x4, CQM_4PY, 4 );
+
+#define TEST_QUANT4x4x4( block ) \
+        if( qf_a.quant_4x4x4 != qf_ref.quant_4x4x4 ) \
+        { \
+            set_func_name( "quant_4x4x4" ); \
+            used_asms[0] = 1; \
+            for( int qp = h->param.rc.i_qp_max; qp >= h->param.rc.i_qp_min; qp-- ) \
+            { \
+                static const int scale1d[4] = {4,6,4,6}; \
+                int mask = rand()&15; \
+                for( int i = 0; i < 64; i++ ) \
+                { \
+                    unsigned int scale = 255*scale1d[(i>>2)&3]*scale1d[i&3]; \
+                    dct1[i] = dct2[i] = (mask>>(i>>4))&1 ? (rand()%(2*scale+1))-scale : 0; \
+                } \
+                int result_c = call_c1( qf_c.quant_4x4x4, (void*)dct1, h->quant4_mf[block][qp], h->quant4_bias[block][qp] ); \
+                int result_a = call_a1( qf_a.quant_4x4x4, (void*)dct2, h->quant4_mf[block][qp], h->quant4_bias[block][qp] ); \
+                if( memcmp( dct1, dct2, 64*sizeof(dctcoef) ) || result_c != result_a ) \
+                { \
+                    oks[0] = 0; \
+                    fprintf( stderr, "quant_4x4x4(qp=%d, cqm=%d, block="#block"): [FAILED]\n", qp, i_cqm ); \
+                    break; \
+                } \
+                call_c2( qf_c.quant_4x4x4, (void*)dct1, h->quant4_mf[block][qp], h->quant4_bias[block][qp] ); \
+                call_a2( qf_a.quant_4x4x4, (void*)dct2, h->quant4_mf[block][qp], h->quant4_bias[block][qp] ); \
+            } \
+        }
+
+        TEST_QUANT4x4x4( CQM_4IY );
+        TEST_QUANT4x4x4( CQM_4PY );
         TEST_QUANT_DC( quant_4x4_dc, **h->quant4_mf[CQM_4IY] );
         TEST_QUANT_DC( quant_2x2_dc, **h->quant4_mf[CQM_4IC] );
 
@@ -2227,6 +2258,95 @@ static int check_cabac( int cpu_ref, int cpu_new )
     return ret;
 }
 
+static int check_trellis( void )
+{
+    ALIGNED_16( dctcoef dct1[64] );
+    ALIGNED_16( dctcoef dct2[64] );
+    int ret = 0, ok = 1, used_asm = 1;
+    x264_t h_buf;
+    x264_t *h = &h_buf;
+
+    /* The trellis has no asm: check the node-parallel C version against the
+     * scalar reference once, whether or not there are cpu flags to test. */
+    memset( h, 0, sizeof(*h) );
+    x264_param_default( &h->param );
+    h->param.b_cabac = 1;
+    h->param.analyse.b_transform_8x8 = 1;
+    h->chroma_qp_table = i_chroma_qp_table + 12;
+    for( int i = 0; i < 6; i++ )
+        h->pps->scaling_list[i] = x264_cqm_jvt[i];
+    h->param.i_cqm_preset = h->pps->i_cqm_preset = X264_CQM_JVT;
+    h->param.rc.i_qp_min = 0;
+    h->param.rc.i_qp_max = QP_MAX;
+    x264_cqm_init( h );
+    x264_cabac_init( h );
+    x264_rdo_init();
+
+    for( int i = 0; i < 2000 && ok; i++ )
+    {
+        int qp = rand() % (QP_MAX_SPEC+1);
+        int type = i&3;
+        int b_intra = rand()&1;
+        h->sps->i_chroma_format_idc = 1 + (rand()&1);
+        h->mb.b_interlaced = rand()&1;
+        h->mb.i_psy_trellis = rand()&1 ? rand()&511 : 0;
+        for( int j = 0; j < 4; j++ )
+            h->mb.i_trellis_lambda2[j>>1][j&1] = 1 + (rand() % 100000);
+        x264_cabac_context_init( h, &h->cabac, b_intra ? SLICE_TYPE_I : SLICE_TYPE_P, qp, rand()%3 );
+        if( i&4 )
+            for( int j = 0; j < 1024; j++ )
+                h->cabac.state[j] = rand()&127;
+
+        int size = type == 3 ? 64 : 16;
+        int scale = (rand()&1) ? 256 : 4096;
+        for( int j = 0; j < size; j++ )
+        {
+            dct1[j] = dct2[j] = rand()%4 ? (rand() % (2*scale+1)) - scale : 0;
+            if( size == 64 )
+                h->mb.pic.fenc_dct8[0][j] = dct1[j] + (rand()&63) - 32;
+            else
+                h->mb.pic.fenc_dct4[0][j] = dct1[j] + (rand()&63) - 32;
+        }
+
+        int nz_c, nz_a;
+        if( type == 0 )
+        {
+            int cat = rand()%3 ? DCT_LUMA_4x4 : DCT_LUMA_AC;
+            int b_chroma = cat == DCT_LUMA_AC && (rand()&1);
+            int quant_cat = b_chroma ? (b_intra ? CQM_4IC : CQM_4PC) : (b_intra ? CQM_4IY : CQM_4PY);
+            set_func_name( "quant_4x4_trellis" );
+            nz_c = call_c1( x264_quant_4x4_trellis_ref, h, dct1, quant_cat, qp, cat, b_intra, b_chroma, 0 );
+            nz_a = call_c1( x264_quant_4x4_trellis, h, dct2, quant_cat, qp, cat, b_intra, b_chroma, 0 );
+        }
+        else if( type == 1 )
+        {
+            set_func_name( "quant_luma_dc_trellis" );
+            nz_c = call_c1( x264_quant_luma_dc_trellis_ref, h, dct1, b_intra ? CQM_4IY : CQM_4PY, qp, DCT_LUMA_DC, b_intra, 0 );
+            nz_a = call_c1( x264_quant_luma_dc_trellis, h, dct2, b_intra ? CQM_4IY : CQM_4PY, qp, DCT_LUMA_DC, b_intra, 0 );
+        }
+        else if( type == 2 )
+        {
+            set_func_name( "quant_chroma_dc_trellis" );
+            nz_c = call_c1( x264_quant_chroma_dc_trellis_ref, h, dct1, qp, b_intra, 0 );
+            nz_a = call_c1( x264_quant_chroma_dc_trellis, h, dct2, qp, b_intra, 0 );
+        }
+        else
+        {
+            set_func_name( "quant_8x8_trellis" );
+            nz_c = call_c1( x264_quant_8x8_trellis_ref, h, dct1, b_intra ? CQM_8IY : CQM_8PY, qp, DCT_LUMA_8x8, b_intra, 0, 0 );
+            nz_a = call_c1( x264_quant_8x8_trellis, h, dct2, b_intra ? CQM_8IY : CQM_8PY, qp, DCT_LUMA_8x8, b_intra, 0, 0 );
+        }
+        if( nz_c != nz_a || memcmp( dct1, dct2, size*sizeof(dctcoef) ) )
+        {
+            ok = 0;
+            fprintf( stderr, "%s (qp=%d, test %d): [FAILED]\n", func_name, qp, i );
+        }
+    }
+    report( "trellis cabac :" );
+
+    return ret;
+}
+
 static int check_bitstream( int cpu_ref, int cpu_new )
 {
     x264_bitstream_function_t bs_c;
@@ -2371,6 +2491,16 @@ static int check_all_flags( void )
         ret |= add_flags( &cpu0, &cpu1, X264_CPU_XOP, "XOP" );
     if( x264_cpu_detect() & X264_CPU_FMA4 )
         ret |= add_flags( &cpu0, &cpu1, X264_CPU_FMA4, "FMA4" );
+    if( x264_cpu_detect() & X264_CPU_FMA3 )
+        ret |= add_flags( &cpu0, &cpu1, X264_CPU_FMA3, "FMA3" );
+    if( x264_cpu_detect() & X264_CPU_BMI1 )
+    {
+        ret |= add_flags( &cpu0, &cpu1, X264_CPU_LZCNT | X264_CPU_BMI1, "BMI1" );
+        if( x264_cpu_detect() & X264_CPU_BMI2 )
+            ret |= add_flags( &cpu0, &cpu1, X264_CPU_BMI2, "BMI2" );
+    }
+    if( x264_cpu_detect() & X264_CPU_AVX2 )
+        ret |= add_flags( &cpu0, &cpu1, X264_CPU_AVX2, "AVX2" );
 #elif ARCH_PPC
     if( x264_cpu_detect() & X264_CPU_ALTIVEC )
     {
@@ -2447,6 +2577,7 @@ int main(int argc, char *argv[])
         }
     else
         ret = check_all_flags();
+    ret |= check_trellis();
 
     if( ret )
     {
@@ -0,0 +1,184 @@
+/*****************************************************************************
+ * hugebench.c: huge page frame buffer benchmark
+ *****************************************************************************
+ * Copyright (C) 2011 x264 project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at licensing@x264.com.
+ *****************************************************************************/
+
+#include "common/common.h"
+
+#if SYS_LINUX
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#endif
+
+/* Allocates hpel reference planes the size of x264's for a frame and runs a
+ * motion-search-like pattern over them: 16x16 SADs at random candidates near
+ * each macroblock, in every reference and hpel plane.  Each candidate touches
+ * 16 rows a stride apart, so with 4KB pages nearly every row is another TLB
+ * entry.  dTLB misses come from perf events when the kernel exposes them. */
+
+#define REFS 4
+#define CANDIDATES 32
+#define RANGE 64
+
+/* perf event counters, -1 when unavailable */
+static int counter_open( int tlb )
+{
+#if SYS_LINUX && defined(__NR_perf_event_open)
+    struct perf_event_attr attr;
+    memset( &attr, 0, sizeof(attr) );
+    attr.size = sizeof(attr);
+    if( tlb )
+    {
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    }
+    else
+    {
+        attr.type = PERF_TYPE_SOFTWARE;
+        attr.config = PERF_COUNT_SW_PAGE_FAULTS;
+    }
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall( __NR_perf_event_open, &attr, 0, -1, -1, 0 );
+#else
+    return -1;
+#endif
+}
+
+static int64_t counter_read( int fd )
+{
+    int64_t value = -1;
+#if SYS_LINUX
+    if( fd < 0 || read( fd, &value, sizeof(value) ) != sizeof(value) )
+        return -1;
+#endif
+    return value;
+}
+
+static void counter_close( int fd )
+{
+#if SYS_LINUX
+    if( fd >= 0 )
+        close( fd );
+#endif
+}
+
+/* kB of the process on transparent or explicit huge pages */
+static int huge_kb( void )
+{
+    char line[256];
+    int total = 0, kb;
+    FILE *f = fopen( "/proc/self/smaps_rollup", "r" );
+    if( !f )
+        return -1;
+    while( fgets( line, sizeof(line), f ) )
+        if( sscanf( line, "AnonHugePages: %d", &kb ) == 1 ||
+            sscanf( line, "Private_Hugetlb: %d", &kb ) == 1 )
+            total += kb;
+    fclose( f );
+    return total;
+}
+
+static int bench( int mode, int width, int height, int mbs )
+{
+    x264_pixel_function_t pixf;
+    pixel *buffer[REFS];
+    int stride = ALIGN( width + 2*PADH, 64 );
+    int lines = height + 2*PADV;
+    int plane_size = stride * lines;
+    int huge_before = huge_kb();
+    uint32_t seed = 12345;
+
+    x264_pixel_init( x264_cpu_detect(), &pixf );
+
+    int64_t start = x264_mdate();
+    for( int i = 0; i < REFS; i++ )
+    {
+        buffer[i] = x264_malloc_huge( 4 * plane_size * sizeof(pixel), mode );
+        if( !buffer[i] )
+            return -1;
+        for( int j = 0; j < 4 * plane_size; j++ )
+            buffer[i][j] = j * 7 + i;
+    }
+    int64_t fill_time = x264_mdate() - start;
+    int huge = huge_kb() - huge_before;
+
+    int tlb = counter_open( 1 );
+    int faults = counter_open( 0 );
+    int64_t tlb_start = counter_read( tlb );
+    start = x264_mdate();
+    for( int i = 0; i < mbs; i++ )
+    {
+        seed = seed * 1664525 + 1013904223;
+        int mb_x = (seed >> 8) % (width / 16);
+        int mb_y = (seed >> 20) % (height / 16);
+        pixel *fenc = buffer[0] + (PADV + mb_y*16) * stride + PADH + mb_x*16;
+        for( int ref = 0; ref < REFS; ref++ )
+            for( int j = 0; j < CANDIDATES; j++ )
+            {
+                seed = seed * 1664525 + 1013904223;
+                int x = x264_clip3( mb_x*16 + (int)((seed >> 4) % (2*RANGE)) - RANGE, -PADH, width + PADH - 16 );
+                int y = x264_clip3( mb_y*16 + (int)((seed >> 14) % (2*RANGE)) - RANGE, -PADV, height + PADV - 16 );
+                pixel *ref_pix = buffer[ref] + (seed >> 30) * plane_size + (PADV + y) * stride + PADH + x;
+                pixf.sad[PIXEL_16x16]( fenc, stride, ref_pix, stride );
+            }
+    }
+    int64_t time = x264_mdate() - start;
+    int64_t tlb_misses = counter_read( tlb );
+    if( tlb_misses >= 0 )
+        tlb_misses -= tlb_start;
+    int64_t page_faults = counter_read( faults );
+    counter_close( tlb );
+    counter_close( faults );
+
+    for( int i = 0; i < REFS; i++ )
+        x264_free_huge( buffer[i] );
+
+    printf( "%-12s %9.1f ms fill %9.1f ms search %8.3f us/mb", x264_huge_pages_names[mode],
+            fill_time / 1000.0, time / 1000.0, (double)time / mbs );
+    if( tlb_misses >= 0 )
+        printf( " %10.1f dTLB misses/mb", (double)tlb_misses / mbs );
+    else
+        printf( "  dTLB misses n/a" );
+    if( page_faults >= 0 )
+        printf( " %6"PRId64" faults", page_faults );
+    if( huge >= 0 )
+        printf( " %7d kB huge", huge );
+    printf( "\n" );
+    return 0;
+}
+
+int main( int argc, char **argv )
+{
+    int width = argc > 1 ? atoi( argv[1] ) : 3840;
+    int height = argc > 2 ? atoi( argv[2] ) : 2160;
+    int mbs = argc > 3 ? atoi( argv[3] ) : 20000;
+    int ret = 0;
+
+    width = X264_MAX( width, 16 ) & ~15;
+    height = X264_MAX( height, 16 ) & ~15;
+    printf( "%dx%d, %d refs of 4 hpel planes, %d macroblocks x %d candidates per ref\n",
+            width, height, REFS, mbs, CANDIDATES );
+    for( int mode = X264_HUGE_PAGES_NONE; mode <= X264_HUGE_PAGES_EXPLICIT; mode++ )
+        ret |= bench( mode, width, height, mbs );
+    return !!ret;
+}
@@ -0,0 +1,119 @@
+/*****************************************************************************
+ * openbench.c: back-to-back short encode startup benchmark
+ *****************************************************************************
+ * Copyright (C) 2011 x264 project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at licensing@x264.com.
+ *****************************************************************************/
+
+#include "common/common.h"
+
+#if SYS_LINUX
+#include <sys/resource.h>
+#endif
+
+static int64_t page_faults( void )
+{
+#if SYS_LINUX
+    struct rusage usage;
+    if( !getrusage( RUSAGE_SELF, &usage ) )
+        return usage.ru_minflt;
+#endif
+    return -1;
+}
+
+/* Opens an encoder, encodes a few frames, and closes it again, over and over,
+ * the way a service handling many short clips does.  The time to the first
+ * output frame is mostly allocating and faulting in the encoder's frames,
+ * which b_frame_pool lets each encoder take over from the previous one. */
+
+static int bench( int b_pool, const char *preset, int width, int height, int frames, int runs )
+{
+    x264_param_t param;
+    x264_picture_t pic, pic_out;
+    x264_nal_t *nal;
+    int i_nal;
+    int64_t open_time = 0, first_time = 0, total_time = 0, faults = 0;
+
+    if( x264_param_default_preset( &param, preset, NULL ) < 0 )
+        return -1;
+    param.i_width = width;
+    param.i_height = height;
+    param.i_log_level = X264_LOG_ERROR;
+    param.b_frame_pool = b_pool;
+    if( x264_picture_alloc( &pic, X264_CSP_I420, width, height ) < 0 )
+        return -1;
+    for( int y = 0; y < height; y++ )
+        for( int x = 0; x < width; x++ )
+            pic.img.plane[0][y*pic.img.i_stride[0]+x] = x + y;
+    for( int p = 1; p < 3; p++ )
+        memset( pic.img.plane[p], 128, pic.img.i_stride[p] * height/2 );
+
+    for( int run = 0; run < runs; run++ )
+    {
+        int64_t faults_start = page_faults();
+        int64_t start = x264_mdate();
+        x264_t *h = x264_encoder_open( &param );
+        if( !h )
+            return -1;
+        open_time += x264_mdate() - start;
+        int b_first = 1;
+        for( int i = 0; i < frames || x264_encoder_delayed_frames( h ); i++ )
+        {
+            pic.i_pts = i;
+            if( x264_encoder_encode( h, &nal, &i_nal, i < frames ? &pic : NULL, &pic_out ) < 0 )
+                return -1;
+            if( b_first && i_nal )
+            {
+                first_time += x264_mdate() - start;
+                b_first = 0;
+            }
+        }
+        x264_encoder_close( h );
+        total_time += x264_mdate() - start;
+        faults += page_faults() - faults_start;
+    }
+    x264_picture_clean( &pic );
+    x264_frame_pool_flush();
+
+    printf( "%-9s frame pool %-3s: open %7.2f ms  first frame %8.2f ms  total %8.2f ms",
+            preset, b_pool ? "on" : "off", open_time / 1000.0 / runs,
+            first_time / 1000.0 / runs, total_time / 1000.0 / runs );
+    if( faults >= 0 )
+        printf( "  %8"PRId64" page faults", faults / runs );
+    printf( "\n" );
+    return 0;
+}
+
+int main( int argc, char **argv )
+{
+    int width = argc > 1 ? atoi( argv[1] ) : 1920;
+    int height = argc > 2 ? atoi( argv[2] ) : 1080;
+    int frames = argc > 3 ? atoi( argv[3] ) : 4;
+    int runs = argc > 4 ? atoi( argv[4] ) : 10;
+    static const char * const presets[] = { "ultrafast", "veryfast", "medium", 0 };
+    int ret = 0;
+
+    width = X264_MAX( width, 16 ) & ~1;
+    height = X264_MAX( height, 16 ) & ~1;
+    printf( "%dx%d, %d runs of %d frames\n", width, height, runs, frames );
+    for( int i = 0; presets[i]; i++ )
+        for( int b_pool = 0; b_pool <= 1; b_pool++ )
+            ret |= bench( b_pool, presets[i], width, height, frames, runs );
+    return !!ret;
+}
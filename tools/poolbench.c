@@ -0,0 +1,116 @@
+/*****************************************************************************
+ * poolbench.c: thread pool dispatch latency benchmark
+ *****************************************************************************
+ * Copyright (C) 2011 x264 project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at licensing@x264.com.
+ *****************************************************************************/
+
+#include "common/common.h"
+
+/* Each submitter thread repeatedly hands the pool an empty job and waits for it,
+ * so the time per job is the round trip through the pool: queueing, waking a
+ * worker, and signalling the result back.  Several submitters sharing one pool
+ * contend for its jobs and queues. */
+
+#define MAX_SUBMITTERS 16
+
+typedef struct
+{
+    x264_threadpool_t *pool;
+    int jobs;
+    int batch;   /* jobs submitted before joining any of them */
+    int errors;
+    int64_t time;
+} submitter_t;
+
+static void *job_func( void *arg )
+{
+    return arg;
+}
+
+static void *submitter_thread( submitter_t *s )
+{
+    x264_threadpool_job_t *job[X264_THREAD_MAX];
+    int64_t start = x264_mdate();
+    for( int i = 0; i < s->jobs; i += s->batch )
+    {
+        for( int j = 0; j < s->batch; j++ )
+            job[j] = x264_threadpool_submit( s->pool, job_func, (void*)(intptr_t)(i+j+1) );
+        for( int j = 0; j < s->batch; j++ )
+            s->errors += x264_threadpool_join( s->pool, job[j] ) != (void*)(intptr_t)(i+j+1);
+    }
+    s->time = x264_mdate() - start;
+    return NULL;
+}
+
+static int bench( int workers, int submitters, int batch, int jobs )
+{
+    x264_threadpool_t *pool;
+    x264_pthread_t handle[MAX_SUBMITTERS];
+    submitter_t s[MAX_SUBMITTERS];
+    int errors = 0;
+    int64_t time = 0;
+
+    if( x264_threadpool_init( &pool, workers, NULL, NULL ) )
+        return -1;
+    for( int i = 0; i < submitters; i++ )
+    {
+        s[i] = (submitter_t){ pool, jobs, batch, 0, 0 };
+        if( x264_pthread_create( handle+i, NULL, (void*)submitter_thread, s+i ) )
+            return -1;
+    }
+    for( int i = 0; i < submitters; i++ )
+    {
+        x264_pthread_join( handle[i], NULL );
+        errors += s[i].errors;
+        time = X264_MAX( time, s[i].time );
+    }
+    x264_threadpool_delete( pool );
+
+    printf( "workers %3d  submitters %2d  batch %3d: %8.2f us/job  %10.0f jobs/s%s\n",
+            workers, submitters, batch, (double)time / jobs,
+            (double)jobs * submitters * 1000000 / X264_MAX( time, 1 ),
+            errors ? "  FAILED" : "" );
+    return errors ? -1 : 0;
+}
+
+int main( int argc, char **argv )
+{
+#if HAVE_THREAD
+    int max_workers = argc > 1 ? atoi( argv[1] ) : 8;
+    int jobs = argc > 2 ? atoi( argv[2] ) : 20000;
+    int ret = 0;
+
+    if( x264_threading_init() )
+        return 1;
+    max_workers = x264_clip3( max_workers, 1, X264_THREAD_MAX );
+    printf( "%d jobs per submitter, %d cpus\n", jobs, x264_cpu_num_processors() );
+    for( int workers = 1; workers <= max_workers; workers *= 2 )
+    {
+        for( int submitters = 1; submitters <= X264_MIN( workers, MAX_SUBMITTERS ); submitters *= 2 )
+            ret |= bench( workers, submitters, 1, jobs );
+        if( workers > 1 )
+            ret |= bench( workers, 1, workers, jobs - jobs % workers );
+    }
+    return !!ret;
+#else
+    fprintf( stderr, "poolbench requires thread support\n" );
+    return 1;
+#endif
+}
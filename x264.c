@@ -82,6 +82,8 @@ typedef struct {
     FILE *tcfile_out;
     double timebase_convert_multiplier;
     int i_pulldown;
+    FILE *status_file;
+    int64_t i_status_interval;
 } cli_opt_t;
 
 /* file i/o operation structs */
@@ -90,12 +92,14 @@ static cli_output_t cli_output;
 
 /* video filter operation struct */
 static cli_vid_filter_t filter;
+static cli_vid_pipeline_t pipeline;
 
 static const char * const demuxer_names[] =
 {
     "auto",
     "raw",
     "y4m",
+    "synth",
 #if HAVE_AVS
     "avs",
 #endif
@@ -322,6 +326,8 @@ int main( int argc, char **argv )
         fclose( opt.tcfile_out );
     if( opt.qpfile )
         fclose( opt.qpfile );
+    if( opt.status_file )
+        fclose( opt.status_file );
 
     SetConsoleTitle( originalCTitle );
 
@@ -815,6 +821,10 @@ static void help( x264_param_t *defaults, int longhelp )
         "                                  - %s\n", muxer_names[0], stringify_names( buf, muxer_names ) );
     H1( "      --demuxer <string>      Specify input container format [\"%s\"]\n"
         "                                  - %s\n", demuxer_names[0], stringify_names( buf, demuxer_names ) );
+    H2( "                              `synth' generates a test pattern and takes its options\n"
+        "                              in place of the input file name (\"-\" for defaults):\n"
+        "                                  frames=<int>,seed=<int>,cut=<int>,noise=<int>,\n"
+        "                                  text=<bool>,ring=<int> (pre-rendered frames)\n" );
     H1( "      --input-fmt <string>    Specify input file format (requires lavf support)\n" );
     H1( "      --input-csp <string>    Specify input colorspace format for raw input\n" );
     print_csp_names( longhelp );
@@ -823,6 +833,7 @@ static void help( x264_param_t *defaults, int longhelp )
     H1( "      --input-depth <integer> Specify input bit depth for raw input\n" );
     H1( "      --input-res <intxint>   Specify input resolution (width x height)\n" );
     H1( "      --index <string>        Filename for input index file\n" );
+    H2( "      --demuxer-threads <int> Decoding threads for lavf input [0 (auto)]\n" );
     H0( "      --sar width:height      Specify Sample Aspect Ratio\n" );
     H0( "      --fps <float|rational>  Specify framerate\n" );
     H0( "      --seek <integer>        First frame to encode\n" );
@@ -832,14 +843,29 @@ static void help( x264_param_t *defaults, int longhelp )
     H1( "\n" );
     H1( "  -v, --verbose               Print stats for each frame\n" );
     H1( "      --no-progress           Don't show the progress indicator while encoding\n" );
+    H2( "      --status-fd <integer>   Write encoding status as a JSON object per line\n"
+        "                                  to this file descriptor\n" );
+    H2( "      --status-interval <float> Seconds between status lines [1.0]\n" );
     H0( "      --quiet                 Quiet Mode\n" );
     H1( "      --log-level <string>    Specify the maximum level of logging [\"%s\"]\n"
         "                                  - %s\n", strtable_lookup( log_level_names, cli_log_level - X264_LOG_NONE ),
                                        stringify_names( buf, log_level_names ) );
     H1( "      --psnr                  Enable PSNR computation\n" );
     H1( "      --ssim                  Enable SSIM computation\n" );
+    H2( "      --stage-timing          Time encoder stages and summarize them per frame type\n" );
     H1( "      --threads <integer>     Force a specific number of threads\n" );
+    H2( "      --lookahead-threads <integer> Force a specific number of lookahead threads\n" );
     H2( "      --sliced-threads        Low-latency but lower-efficiency threading\n" );
+    H2( "      --frame-threads <integer> With --sliced-threads, encode this many frames\n"
+        "                              in parallel, each split between the threads\n" );
+    H2( "      --filter-thread         Deblock and filter each frame thread's rows on\n"
+        "                              a companion thread\n" );
+    H2( "      --numa                  Spread threads over NUMA nodes, pinned to their\n"
+        "                              node, and keep frames on the node encoding them\n" );
+    H2( "      --huge-pages <string>   Put frame buffers on 2MB pages [%s]\n"
+        "                                  - none, transparent, explicit\n"
+        "                                  explicit needs pages reserved by vm.nr_hugepages\n",
+        strtable_lookup( x264_huge_pages_names, defaults->i_huge_pages ) );
     H2( "      --thread-input          Run Avisynth in its own thread\n" );
     H2( "      --sync-lookahead <integer> Number of buffer frames for threaded lookahead\n" );
     H2( "      --non-deterministic     Slightly improve quality of SMP, at the cost of repeatability\n" );
@@ -849,6 +875,8 @@ static void help( x264_param_t *defaults, int longhelp )
     H2( "      --no-asm                Disable all CPU optimizations\n" );
     H2( "      --visualize             Show MB types overlayed on the encoded video\n" );
     H2( "      --dump-yuv <string>     Save reconstructed frames\n" );
+    H2( "      --trace <string>        Save a timeline of the encoder's threads\n"
+        "                                  as Chrome trace-event JSON\n" );
     H2( "      --sps-id <integer>      Set SPS and PPS id numbers [%d]\n", defaults->i_sps_id );
     H2( "      --aud                   Use access unit delimiters\n" );
     H2( "      --force-cfr             Force constant framerate timestamp generation\n" );
@@ -862,6 +890,9 @@ static void help( x264_param_t *defaults, int longhelp )
     H0( "Filtering:\n" );
     H0( "\n" );
     H0( "      --vf, --video-filter <filter0>/<filter1>/... Apply video filtering to the input file\n" );
+    H2( "      --vf-pipeline <integer> Run the input and the scaling/depth filters on\n"
+        "                              threads of their own, queueing up to <integer>\n"
+        "                              frames between them [0]\n" );
     H0( "\n" );
     H0( "      Filter options may be specified in <filter>:<option>=<value> format.\n" );
     H0( "\n" );
@@ -879,6 +910,8 @@ typedef enum
     OPT_THREAD_INPUT,
     OPT_QUIET,
     OPT_NOPROGRESS,
+    OPT_STATUS_FD,
+    OPT_STATUS_INTERVAL,
     OPT_VISUALIZE,
     OPT_LONGHELP,
     OPT_PROFILE,
@@ -897,10 +930,12 @@ typedef enum
     OPT_PULLDOWN,
     OPT_LOG_LEVEL,
     OPT_VIDEO_FILTER,
+    OPT_VF_PIPELINE,
     OPT_INPUT_FMT,
     OPT_INPUT_RES,
     OPT_INPUT_CSP,
     OPT_INPUT_DEPTH,
+    OPT_DEMUXER_THREADS,
     OPT_DTS_COMPRESSION,
     OPT_OUTPUT_CSP,
     OPT_AUDIOFILE,
@@ -1014,8 +1049,13 @@ static struct option long_options[] =
     { "zones",       required_argument, NULL, 0 },
     { "qpfile",      required_argument, NULL, OPT_QPFILE },
     { "threads",     required_argument, NULL, 0 },
+    { "lookahead-threads", required_argument, NULL, 0 },
     { "sliced-threads",    no_argument, NULL, 0 },
     { "no-sliced-threads", no_argument, NULL, 0 },
+    { "frame-threads",     required_argument, NULL, 0 },
+    { "filter-thread",     no_argument, NULL, 0 },
+    { "numa",              no_argument, NULL, 0 },
+    { "huge-pages",        required_argument, NULL, 0 },
     { "slice-max-size",    required_argument, NULL, 0 },
     { "slice-max-mbs",     required_argument, NULL, 0 },
     { "slices",            required_argument, NULL, 0 },
@@ -1025,12 +1065,16 @@ static struct option long_options[] =
     { "cpu-independent",   no_argument, NULL, 0 },
     { "psnr",              no_argument, NULL, 0 },
     { "ssim",              no_argument, NULL, 0 },
+    { "stage-timing",      no_argument, NULL, 0 },
     { "quiet",             no_argument, NULL, OPT_QUIET },
     { "verbose",           no_argument, NULL, 'v' },
     { "log-level",   required_argument, NULL, OPT_LOG_LEVEL },
     { "no-progress",       no_argument, NULL, OPT_NOPROGRESS },
+    { "status-fd",   required_argument, NULL, OPT_STATUS_FD },
+    { "status-interval", required_argument, NULL, OPT_STATUS_INTERVAL },
     { "visualize",         no_argument, NULL, OPT_VISUALIZE },
     { "dump-yuv",    required_argument, NULL, 0 },
+    { "trace",       required_argument, NULL, 0 },
     { "sps-id",      required_argument, NULL, 0 },
     { "aud",               no_argument, NULL, 0 },
     { "nr",          required_argument, NULL, 0 },
@@ -1065,10 +1109,12 @@ static struct option long_options[] =
     { "frame-packing",     required_argument, NULL, 0 },
     { "vf",          required_argument, NULL, OPT_VIDEO_FILTER },
     { "video-filter", required_argument, NULL, OPT_VIDEO_FILTER },
+    { "vf-pipeline", required_argument, NULL, OPT_VF_PIPELINE },
     { "input-fmt",   required_argument, NULL, OPT_INPUT_FMT },
     { "input-res",   required_argument, NULL, OPT_INPUT_RES },
     { "input-csp",   required_argument, NULL, OPT_INPUT_CSP },
     { "input-depth", required_argument, NULL, OPT_INPUT_DEPTH },
+    { "demuxer-threads", required_argument, NULL, OPT_DEMUXER_THREADS },
     { "dts-compress",      no_argument, NULL, OPT_DTS_COMPRESSION },
     { "output-csp",  required_argument, NULL, OPT_OUTPUT_CSP },
     { "audiofile",   required_argument, NULL, OPT_AUDIOFILE },
@@ -1154,6 +1200,8 @@ static int select_input( const char *demuxer, char *used_demuxer, char *filename
     }
     else if( !strcasecmp( module, "y4m" ) )
         cli_input = y4m_input;
+    else if( !strcasecmp( module, "synth" ) )
+        cli_input = synth_input;
     else if( !strcasecmp( module, "raw" ) || !strcasecmp( ext, "yuv" ) )
         cli_input = raw_input;
     else
@@ -1204,11 +1252,11 @@ static int init_vid_filters( char *sequence, hnd_t *handle, video_info_t *info,
     x264_register_vid_filters();
 
     /* intialize baseline filters */
-    if( x264_init_vid_filter( "source", handle, &filter, info, param, NULL ) ) /* wrap demuxer into a filter */
+    if( x264_init_vid_filter_pipelined( &pipeline, "source", handle, &filter, info, param, NULL ) ) /* wrap demuxer into a filter */
         return -1;
-    if( x264_init_vid_filter( "resize", handle, &filter, info, param, "normcsp" ) ) /* normalize csps to be of a known/supported format */
+    if( x264_init_vid_filter_pipelined( &pipeline, "resize", handle, &filter, info, param, "normcsp" ) ) /* normalize csps to be of a known/supported format */
         return -1;
-    if( x264_init_vid_filter( "fix_vfr_pts", handle, &filter, info, param, NULL ) ) /* fix vfr pts */
+    if( x264_init_vid_filter_pipelined( &pipeline, "fix_vfr_pts", handle, &filter, info, param, NULL ) ) /* fix vfr pts */
         return -1;
 
     /* parse filter chain */
@@ -1220,7 +1268,7 @@ static int init_vid_filters( char *sequence, hnd_t *handle, video_info_t *info,
         int name_len = strcspn( p, ":" );
         p[name_len] = 0;
         name_len += name_len != tok_len;
-        if( x264_init_vid_filter( p, handle, &filter, info, param, p + name_len ) )
+        if( x264_init_vid_filter_pipelined( &pipeline, p, handle, &filter, info, param, p + name_len ) )
             return -1;
         p += X264_MIN( tok_len+1, p_len );
     }
@@ -1244,13 +1292,13 @@ static int init_vid_filters( char *sequence, hnd_t *handle, video_info_t *info,
         param->i_csp = X264_CSP_RGB;
     param->i_csp |= info->csp & X264_CSP_HIGH_DEPTH;
 
-    if( x264_init_vid_filter( "resize", handle, &filter, info, param, NULL ) )
+    if( x264_init_vid_filter_pipelined( &pipeline, "resize", handle, &filter, info, param, NULL ) )
         return -1;
 
     char args[20];
     sprintf( args, "bit_depth=%d", x264_bit_depth );
 
-    if( x264_init_vid_filter( "depth", handle, &filter, info, param, args ) )
+    if( x264_init_vid_filter_pipelined( &pipeline, "depth", handle, &filter, info, param, args ) )
         return -1;
 
     return 0;
@@ -1351,6 +1399,7 @@ static int parse( int argc, char **argv, x264_param_t *param, cli_opt_t *opt )
     input_opt.bit_depth = 8;
     int output_csp = defaults.i_csp;
     opt->b_progress = 1;
+    opt->i_status_interval = 1000000;
 
     /* Presets are applied before all other options. */
     for( optind = 0;; )
@@ -1446,6 +1495,14 @@ static int parse( int argc, char **argv, x264_param_t *param, cli_opt_t *opt )
             case OPT_NOPROGRESS:
                 opt->b_progress = 0;
                 break;
+            case OPT_STATUS_FD:
+                opt->status_file = fdopen( atoi( optarg ), "w" );
+                FAIL_IF_ERROR( !opt->status_file, "can't write status to file descriptor %s\n", optarg )
+                break;
+            case OPT_STATUS_INTERVAL:
+                opt->i_status_interval = atof( optarg ) * 1000000;
+                FAIL_IF_ERROR( opt->i_status_interval <= 0, "status interval must be > 0\n" )
+                break;
             case OPT_VISUALIZE:
 #if HAVE_VISUALIZE
                 param->b_visualize = 1;
@@ -1489,6 +1546,13 @@ static int parse( int argc, char **argv, x264_param_t *param, cli_opt_t *opt )
             case OPT_VIDEO_FILTER:
                 vid_filters = optarg;
                 break;
+            case OPT_VF_PIPELINE:
+                pipeline.queue_size = X264_MAX( atoi( optarg ), 0 );
+#if !HAVE_THREAD
+                if( pipeline.queue_size )
+                    x264_cli_log( "x264", X264_LOG_WARNING, "not compiled with thread support, video filters will not be pipelined\n" );
+#endif
+                break;
             case OPT_INPUT_FMT:
                 input_opt.format = optarg;
                 break;
@@ -1501,6 +1565,9 @@ static int parse( int argc, char **argv, x264_param_t *param, cli_opt_t *opt )
             case OPT_INPUT_DEPTH:
                 input_opt.bit_depth = atoi( optarg );
                 break;
+            case OPT_DEMUXER_THREADS:
+                input_opt.demuxer_threads = X264_MAX( atoi( optarg ), 0 );
+                break;
             case OPT_DTS_COMPRESSION:
                 output_opt.use_dts_compress = 1;
                 break;
@@ -1602,7 +1669,7 @@ generic_option:
 
     input_filename = argv[optind++];
     video_info_t info = {0};
-    char demuxername[5];
+    char demuxername[8];
 
     /* set info flags to param flags to be overwritten by demuxer as necessary. */
     info.csp        = param->i_csp;
@@ -1821,7 +1888,7 @@ static void parse_qpfile( cli_opt_t *opt, x264_picture_t *pic, int i_frame )
     }
 }
 
-static int encode_frame( x264_t *h, hnd_t hout, x264_picture_t *pic, int64_t *last_dts )
+static int encode_frame( x264_t *h, hnd_t hout, x264_picture_t *pic, int64_t *last_dts, int64_t *mux_time )
 {
     x264_picture_t pic_out;
     x264_nal_t *nal;
@@ -1834,13 +1901,25 @@ static int encode_frame( x264_t *h, hnd_t hout, x264_picture_t *pic, int64_t *la
 
     if( i_frame_size )
     {
+        int64_t i_start = x264_mdate();
+        x264_encoder_trace( h, "write", 0 );
         i_frame_size = cli_output.write_frame( hout, nal[0].p_payload, i_frame_size, &pic_out );
+        x264_encoder_trace( h, "write", 1 );
+        *mux_time += x264_mdate() - i_start;
         *last_dts = pic_out.i_dts;
     }
 
     return i_frame_size;
 }
 
+/* kb/s of i_file bytes spanning last_ts timebase ticks */
+static double status_bitrate( int64_t i_file, x264_param_t *param, int64_t last_ts )
+{
+    if( last_ts )
+        return (double) i_file * 8 / ( (double) last_ts * 1000 * param->i_timebase_num / param->i_timebase_den );
+    return (double) i_file * 8 / ( (double) 1000 * param->i_fps_den / param->i_fps_num );
+}
+
 static int64_t print_status( int64_t i_start, int64_t i_previous, int i_frame, int i_frame_total, int64_t i_file, x264_param_t *param, int64_t last_ts )
 {
     char buf[200];
@@ -1849,11 +1928,7 @@ static int64_t print_status( int64_t i_start, int64_t i_previous, int i_frame, i
         return i_previous;
     int64_t i_elapsed = i_time - i_start;
     double fps = i_elapsed > 0 ? i_frame * 1000000. / i_elapsed : 0;
-    double bitrate;
-    if( last_ts )
-        bitrate = (double) i_file * 8 / ( (double) last_ts * 1000 * param->i_timebase_num / param->i_timebase_den );
-    else
-        bitrate = (double) i_file * 8 / ( (double) 1000 * param->i_fps_den / param->i_fps_num );
+    double bitrate = status_bitrate( i_file, param, last_ts );
     if( i_frame_total )
     {
         int eta = i_elapsed * (i_frame_total - i_frame) / ((int64_t)i_frame * 1000000);
@@ -1871,6 +1946,51 @@ static int64_t print_status( int64_t i_start, int64_t i_previous, int i_frame, i
     return i_time;
 }
 
+typedef struct
+{
+    int64_t i_start;
+    int64_t i_previous;       /* time of the last status line */
+    int     i_previous_frame; /* frames output by then */
+    int64_t i_mux_time;       /* time spent in the muxer, including audio encoding */
+} cli_status_t;
+
+/* Writes a JSON object per line to --status-fd for programs watching the encode:
+ * every i_status_interval, and once more when it's done. */
+static void print_status_json( x264_t *h, cli_opt_t *opt, cli_status_t *s, int i_frame_in, int i_frame,
+                               int64_t i_file, x264_param_t *param, int64_t last_ts, int b_done )
+{
+    int64_t i_time = x264_mdate();
+    if( !b_done && i_time - s->i_previous < opt->i_status_interval )
+        return;
+    x264_stats_t stats;
+    cli_vid_stage_stats_t stages[MAX_PIPELINE_STAGES];
+    int i_stages = x264_vid_pipeline_stats( &pipeline, stages, MAX_PIPELINE_STAGES );
+    int i_queued = 0;
+    for( int i = 0; i < i_stages; i++ )
+        i_queued += stages[i].queued;
+    x264_encoder_stats( h, &stats );
+
+    FILE *f = opt->status_file;
+    double elapsed = (i_time - s->i_start) / 1000000.;
+    double interval = (i_time - s->i_previous) / 1000000.;
+    fprintf( f, "{\"time\":%.3f,\"frames\":%d,\"input_frames\":%d,\"total_frames\":%d,"
+                "\"fps\":%.2f,\"avg_fps\":%.2f,\"kbps\":%.2f,\"bytes\":%"PRId64","
+                "\"qp\":%.2f,\"vbv_fullness\":%.3f,\"lookahead_frames\":%d,\"input_queue\":%d,\"mux_time\":%.3f",
+             elapsed, i_frame, i_frame_in, param->i_frame_total,
+             interval > 0 ? (i_frame - s->i_previous_frame) / interval : 0, elapsed > 0 ? i_frame / elapsed : 0,
+             i_frame ? status_bitrate( i_file, param, last_ts ) : 0, i_file,
+             stats.f_qp, stats.f_vbv_fullness, stats.i_lookahead_frames, i_queued, s->i_mux_time / 1000000. );
+    if( param->b_stage_timing )
+        for( int i = 0; i < X264_STAGE_MAX; i++ )
+            fprintf( f, "%s\"%s\":%.3f%s", i ? "," : ",\"stage_time\":{", x264_stage_names[i],
+                     (stats.i_stage_time[0][i] + stats.i_stage_time[1][i] + stats.i_stage_time[2][i]) / 1e9,
+                     i == X264_STAGE_MAX-1 ? "}" : "" );
+    fprintf( f, "%s}\n", b_done ? ",\"done\":true" : "" );
+    fflush( f );
+    s->i_previous = i_time;
+    s->i_previous_frame = i_frame;
+}
+
 static void convert_cli_to_lib_pic( x264_picture_t *lib, cli_pic_t *cli )
 {
     memcpy( lib->img.i_stride, cli->img.stride, sizeof(cli->img.stride) );
@@ -1911,6 +2031,7 @@ static int encode( x264_param_t *param, cli_opt_t *opt )
     double  duration;
     double  pulldown_pts = 0;
     int     retval = 0;
+    cli_status_t status = {0};
 
     opt->b_progress &= param->i_log_level < X264_LOG_DEBUG;
 
@@ -1934,6 +2055,7 @@ static int encode( x264_param_t *param, cli_opt_t *opt )
     FAIL_IF_ERROR2( cli_output.set_param( opt->hout, param ), "can't set outfile param\n" );
 
     i_start = x264_mdate();
+    status.i_start = status.i_previous = i_start;
 
     /* ticks/frame = ticks/second / frames/second */
     ticks_per_frame = (int64_t)param->i_timebase_den * param->i_fps_den / param->i_timebase_num / param->i_fps_num;
@@ -1993,7 +2115,7 @@ static int encode( x264_param_t *param, cli_opt_t *opt )
             parse_qpfile( opt, &pic, i_frame + opt->i_seek );
 
         prev_dts = last_dts;
-        i_frame_size = encode_frame( h, opt->hout, &pic, &last_dts );
+        i_frame_size = encode_frame( h, opt->hout, &pic, &last_dts, &status.i_mux_time );
         if( i_frame_size < 0 )
         {
             b_ctrl_c = 1; /* lie to exit the loop */
@@ -2013,12 +2135,14 @@ static int encode( x264_param_t *param, cli_opt_t *opt )
         /* update status line (up to 1000 times per input file) */
         if( opt->b_progress && i_frame_output )
             i_previous = print_status( i_start, i_previous, i_frame_output, param->i_frame_total, i_file, param, 2 * last_dts - prev_dts - first_dts );
+        if( opt->status_file )
+            print_status_json( h, opt, &status, i_frame + 1, i_frame_output, i_file, param, 2 * last_dts - prev_dts - first_dts, 0 );
     }
     /* Flush delayed frames */
     while( !b_ctrl_c && x264_encoder_delayed_frames( h ) )
     {
         prev_dts = last_dts;
-        i_frame_size = encode_frame( h, opt->hout, NULL, &last_dts );
+        i_frame_size = encode_frame( h, opt->hout, NULL, &last_dts, &status.i_mux_time );
         if( i_frame_size < 0 )
         {
             b_ctrl_c = 1; /* lie to exit the loop */
@@ -2033,7 +2157,11 @@ static int encode( x264_param_t *param, cli_opt_t *opt )
         }
         if( opt->b_progress && i_frame_output )
             i_previous = print_status( i_start, i_previous, i_frame_output, param->i_frame_total, i_file, param, 2 * last_dts - prev_dts - first_dts );
+        if( opt->status_file )
+            print_status_json( h, opt, &status, i_frame, i_frame_output, i_file, param, 2 * last_dts - prev_dts - first_dts, 0 );
     }
+    if( opt->status_file && h )
+        print_status_json( h, opt, &status, i_frame, i_frame_output, i_file, param, 2 * last_dts - prev_dts - first_dts, 1 );
 fail:
     if( pts_warning_cnt >= MAX_PTS_WARNING && cli_log_level < X264_LOG_DEBUG )
         x264_cli_log( "x264", X264_LOG_WARNING, "%d suppressed nonmonotonic pts warnings\n", pts_warning_cnt-MAX_PTS_WARNING );
@@ -41,7 +41,7 @@
 
 #include "x264_config.h"
 
-#define X264_BUILD 119
+#define X264_BUILD 120
 
 /* x264_t:
  *      opaque handler for encoder */
@@ -117,7 +117,7 @@ typedef struct
 #define X264_CPU_SSE4            0x0002000  /* SSE4.1 */
 #define X264_CPU_SSE42           0x0004000  /* SSE4.2 */
 #define X264_CPU_SSE_MISALIGN    0x0008000  /* Phenom support for misaligned SSE instruction arguments */
-#define X264_CPU_LZCNT           0x0010000  /* Phenom support for "leading zero count" instruction. */
+#define X264_CPU_LZCNT           0x0010000  /* Phenom and Haswell support for "leading zero count" instruction. */
 #define X264_CPU_ARMV6           0x0020000
 #define X264_CPU_NEON            0x0040000  /* ARM NEON */
 #define X264_CPU_FAST_NEON_MRC   0x0080000  /* Transfer from NEON to ARM register is fast (Cortex-A9) */
@@ -127,6 +127,10 @@ typedef struct
                                              * aren't used. */
 #define X264_CPU_XOP             0x0800000  /* AMD XOP */
 #define X264_CPU_FMA4            0x1000000  /* AMD FMA4 */
+#define X264_CPU_FMA3            0x2000000  /* FMA3 */
+#define X264_CPU_AVX2            0x4000000  /* AVX2: 256-bit integer simd, requires OS support for YMM registers */
+#define X264_CPU_BMI1            0x8000000  /* BMI1 */
+#define X264_CPU_BMI2           0x10000000  /* BMI2 */
 
 /* Analyse flags
  */
@@ -163,6 +167,9 @@ typedef struct
 #define X264_B_PYRAMID_NONE          0
 #define X264_B_PYRAMID_STRICT        1
 #define X264_B_PYRAMID_NORMAL        2
+#define X264_HUGE_PAGES_NONE         0
+#define X264_HUGE_PAGES_TRANSPARENT  1
+#define X264_HUGE_PAGES_EXPLICIT     2
 #define X264_KEYINT_MIN_AUTO         0
 #define X264_KEYINT_MAX_INFINITE     (1<<30)
 
@@ -176,6 +183,19 @@ static const char * const x264_colorprim_names[] = { "", "bt709", "undef", "", "
 static const char * const x264_transfer_names[] = { "", "bt709", "undef", "", "bt470m", "bt470bg", "smpte170m", "smpte240m", "linear", "log100", "log316", 0 };
 static const char * const x264_colmatrix_names[] = { "GBR", "bt709", "undef", "", "fcc", "bt470bg", "smpte170m", "smpte240m", "YCgCo", 0 };
 static const char * const x264_nal_hrd_names[] = { "none", "vbr", "cbr", 0 };
+static const char * const x264_huge_pages_names[] = { "none", "transparent", "explicit", 0 };
+static const char * const x264_stage_names[] = { "analyse", "encode", "entropy", "filter", "slicetype", "mbtree", "ratecontrol", "wait", 0 };
+
+/* Encoder stages timed with b_stage_timing */
+#define X264_STAGE_ANALYSE      0 /* mode decision and motion search */
+#define X264_STAGE_ENCODE       1 /* transform, quantization and reconstruction */
+#define X264_STAGE_ENTROPY      2 /* CABAC/CAVLC coding of macroblocks */
+#define X264_STAGE_FILTER       3 /* deblocking, hpel filtering and border expansion */
+#define X264_STAGE_SLICETYPE    4 /* lookahead frame type decision */
+#define X264_STAGE_MBTREE       5 /* lookahead macroblock-tree */
+#define X264_STAGE_RATECONTROL  6
+#define X264_STAGE_WAIT         7 /* waiting for rows of reference frames */
+#define X264_STAGE_MAX          8
 
 /* Colorspace type */
 #define X264_CSP_MASK           0x00ff  /* */
@@ -239,7 +259,14 @@ typedef struct x264_param_t
     /* CPU flags */
     unsigned int cpu;
     int         i_threads;       /* encode multiple frames in parallel */
+    int         i_lookahead_threads; /* multiple threads for lookahead analysis */
     int         b_sliced_threads;  /* Whether to use slice-based threading. */
+    int         i_frame_threads; /* with sliced threads: frames encoded in parallel, each by i_threads/i_frame_threads slice threads */
+    int         b_filter_thread; /* deblock and hpel-filter each frame thread's rows on a companion thread */
+    int         b_numa;          /* pin threads to NUMA nodes and allocate each thread's frames on its node */
+    int         i_huge_pages;    /* put frame buffers on huge pages: X264_HUGE_PAGES_* */
+    int         b_frame_pool;    /* leave frames in a process-wide pool at close, and take them from it at open */
+    int         b_stage_timing;  /* time encoder stages, see x264_encoder_stats */
     int         b_deterministic; /* whether to allow non-deterministic optimizations when threaded */
     int         b_cpu_independent; /* force canonical behavior rather than cpu-dependent optimal algorithms */
     int         i_sync_lookahead; /* threaded lookahead buffer */
@@ -319,6 +346,7 @@ typedef struct x264_param_t
     int         i_log_level;
     int         b_visualize;
     char        *psz_dump_yuv;  /* filename for reconstructed frames */
+    char        *psz_trace;     /* filename for a Chrome trace-event timeline of the encoder's threads */
 
     /* Encoder analyser parameters */
     struct
@@ -790,6 +818,10 @@ int     x264_encoder_encode( x264_t *, x264_nal_t **pp_nal, int *pi_nal, x264_pi
 /* x264_encoder_close:
  *      close an encoder handler */
 void    x264_encoder_close  ( x264_t * );
+/* x264_frame_pool_flush:
+ *      free the frames left in the pool by encoders opened with b_frame_pool.
+ *      frames of encoders still open are not affected. */
+void    x264_frame_pool_flush( void );
 /* x264_encoder_delayed_frames:
  *      return the number of currently delayed (buffered) frames
  *      this should be used at the end of the stream, to know when you have all the encoded frames. */
@@ -836,4 +868,33 @@ void    x264_encoder_intra_refresh( x264_t * );
  *      Returns 0 on success, negative on failure. */
 int x264_encoder_invalidate_reference( x264_t *, int64_t pts );
 
+typedef struct x264_stats_t
+{
+    /* indexed by frame type: 0 = P, 1 = B, 2 = I */
+    int     i_frames[3];
+    int64_t i_bytes[3];
+    /* time spent in each X264_STAGE_*, in nanoseconds summed over all threads.
+     * lookahead stages are shared out between the frames they decided. */
+    int64_t i_stage_time[3][X264_STAGE_MAX];
+    /* state as of the last frame output */
+    float   f_qp;               /* average QP of the last frame */
+    float   f_vbv_fullness;     /* fraction of the VBV buffer that is full, 0 without VBV */
+    int     i_lookahead_frames; /* input frames not yet handed on by the lookahead */
+} x264_stats_t;
+
+/* x264_encoder_stats:
+ *      fill *stats with the totals of the frames output so far, and the current state.
+ *      stage times are only collected with b_stage_timing.
+ *
+ *      Should not be called during an x264_encoder_encode. */
+void    x264_encoder_stats( x264_t *, x264_stats_t *stats );
+
+/* x264_encoder_trace:
+ *      with psz_trace, marks the start (b_end = 0) or end (b_end = 1) of an interval
+ *      on the timeline of the thread calling the API, e.g. around muxing a frame.
+ *      Intervals don't nest.  name must remain valid until x264_encoder_close.
+ *
+ *      Should not be called during an x264_encoder_encode. */
+void    x264_encoder_trace( x264_t *, const char *name, int b_end );
+
 #endif